@@ -1,8 +1,18 @@
 #version 330 core
 
+flat in uint colour;
+
 out vec4 finalColor;
 
+// Colours made of the bits of each plane, the first plane being white.
+const vec4 palette[4] = vec4[4](
+  vec4(0.0f, 0.0f, 0.0f, 1.0f),
+  vec4(1.0f),
+  vec4(0.67f, 0.67f, 0.67f, 1.0f),
+  vec4(0.33f, 0.33f, 0.33f, 1.0f)
+);
+
 void main()
 {
-  finalColor = vec4(1.0f);
+  finalColor = palette[colour];
 }
@@ -1,10 +1,20 @@
 #version 330 core
 
 layout (location = 0) in vec3 position;
+layout (location = 1) in uint pixel;
 
-uniform mat4 PxModel;
+// Pixels per row and rows of the display, in its current resolution.
+uniform uvec2 size;
+
+flat out uint colour;
 
 void main()
 {
-  gl_Position = PxModel * vec4(position, 1.0f);
+  // Every instance is a lit pixel, numbered row by row from the top left,
+  // with its colour in the highest bits.
+  uint number = pixel & 0x1FFFu;
+  colour = pixel >> 13u;
+
+  vec2 corner = vec2(number % size.x, number / size.x) + vec2(position.x + 1.0f, 1.0f - position.y) * 0.5f;
+  gl_Position = vec4(corner.x / float(size.x / 2u) - 1.0f, 1.0f - corner.y / float(size.y / 2u), 0.0f, 1.0f);
 }
@@ -1,11 +1,57 @@
+newoption {
+    trigger     = "avx2",
+    description = "Use AVX2 for the batch engine, rather than SSE2"
+}
+
+newoption {
+    trigger     = "profile",
+    description = "Count the time spent by every instruction, see cee-headless --profile"
+}
+
+newoption {
+    trigger     = "aot",
+    value       = "DIR",
+    description = "Link in the translations made by cee-aot found in DIR, see --backend aot"
+}
+
+newoption {
+    trigger     = "fuzz",
+    description = "Build cee-fuzz, a libFuzzer target, with clang"
+}
+
+-- libFuzzer only comes with clang.
+if _OPTIONS["fuzz"] then
+    premake.gcc.cc  = "clang"
+    premake.gcc.cxx = "clang++"
+end
+
+-- Checks the backends run every bundled program just like the
+-- interpreter stepped a cycle at a time does, once cee-bench is built.
+newaction {
+    trigger     = "verify",
+    description = "Run cee-bench --verify over data/programs, with the release or debug build",
+    execute     = function()
+        for _, config in ipairs({"release", "debug"}) do
+            local bench = "bin/" .. config .. "/cee-bench"
+            if os.isfile(bench) then
+                if os.execute(bench .. " --verify data/programs") ~= 0 then
+                    os.exit(1)
+                end
+                return
+            end
+        end
+
+        error("cee-bench isn't built yet", 0)
+    end
+}
+
 solution "cee"
-    configurations {"Debug", "Release"}
+    configurations {"Debug", "Release", "ASan", "UBSan"}
         language "C++"
 
         defines {
             "GLFW_STATIC",
-            "GLEW_STATIC",
-            "GLM_FORCE_RADIANS"
+            "GLEW_STATIC"
         }
 
         libdirs {
@@ -20,51 +66,177 @@ solution "cee"
             "-std=c++11"
         }
 
-    configuration {"macosx"}
-        links {
-            "sfml-audio",
-            "sfml-system",
-            "glfw3",
-            "GLEW",
-            "Cocoa.framework",
-            "OpenGL.framework",
-            "IOKit.framework",
-            "CoreVideo.framework"
-        }
+    configuration {"gmake", "avx2"}
+        buildoptions {"-mavx2"}
 
-    configuration {"linux"}
-        links {
-            "sfml-audio",
-            "sfml-system",
-            "glfw3",
-            "GLEW",
-            "GL",
-            "X11",
-            "Xxf86vm",
-            "Xrandr",
-            "Xinerama",
-            "Xi",
-            "Xcursor",
-            "pthread"
-        }
+    configuration "profile"
+        defines {"CEE_PROFILE"}
+
+    -- Everything is instrumented for coverage, the fuzzer itself is only
+    -- linked into cee-fuzz.
+    configuration "fuzz"
+        buildoptions {"-fsanitize=fuzzer-no-link"}
 
     configuration "Release"
         defines {"NDEBUG"}
         objdir "obj/release"
         targetdir "bin/release"
-        kind "WindowedApp"
         flags {"Optimize"}
 
     configuration "Debug"
         defines {"DEBUG"}
         objdir "obj/debug"
         targetdir "bin/debug"
-        kind "ConsoleApp"
         flags {"Symbols"}
 
-    project "cee"
+    -- Sanitized builds are optimized, to fuzz at a useful pace, but keep
+    -- the assertions Release leaves out.
+    configuration "ASan"
+        defines {"DEBUG"}
+        objdir "obj/asan"
+        targetdir "bin/asan"
+        flags {"Symbols", "Optimize"}
+        buildoptions {"-fsanitize=address", "-fno-omit-frame-pointer"}
+        linkoptions {"-fsanitize=address"}
+
+    configuration "UBSan"
+        defines {"DEBUG"}
+        objdir "obj/ubsan"
+        targetdir "bin/ubsan"
+        flags {"Symbols", "Optimize"}
+        buildoptions {"-fsanitize=undefined", "-fno-sanitize-recover=undefined"}
+        linkoptions {"-fsanitize=undefined"}
+
+    -- Emulator core, shared by every executable and free of any
+    -- graphics, windowing or audio dependency.
+    project "cee-core"
         location "build"
+        kind "StaticLib"
         files {
             "src/**.cpp",
             "src/**.hpp"
         }
+        excludes {
+            "src/main.cpp",
+            "src/headless.cpp",
+            "src/bench.cpp",
+            "src/disasm.cpp",
+            "src/fuzz.cpp",
+            "src/recompiler.cpp",
+            "src/renderer.cpp",
+            "src/renderer.hpp"
+        }
+
+    project "cee"
+        location "build"
+        files {
+            "src/main.cpp",
+            "src/renderer.cpp",
+            "src/renderer.hpp"
+        }
+        links {"cee-core"}
+
+        if _OPTIONS["aot"] then
+            files {_OPTIONS["aot"] .. "/*.cpp"}
+            includedirs {"src"}
+        end
+
+        configuration {"macosx"}
+            links {
+                "sfml-audio",
+                "sfml-system",
+                "glfw3",
+                "GLEW",
+                "Cocoa.framework",
+                "OpenGL.framework",
+                "IOKit.framework",
+                "CoreVideo.framework"
+            }
+
+        configuration {"linux"}
+            links {
+                "sfml-audio",
+                "sfml-system",
+                "glfw3",
+                "GLEW",
+                "GL",
+                "X11",
+                "Xxf86vm",
+                "Xrandr",
+                "Xinerama",
+                "Xi",
+                "Xcursor",
+                "pthread"
+            }
+
+        configuration "Release"
+            kind "WindowedApp"
+
+        configuration "Debug or ASan or UBSan"
+            kind "ConsoleApp"
+
+    -- Runs programs without a display, for batch jobs on servers.
+    project "cee-headless"
+        location "build"
+        kind "ConsoleApp"
+        files {
+            "src/headless.cpp"
+        }
+        links {"cee-core"}
+
+        -- Translations register themselves as they start up, so they're
+        -- linked into each executable rather than left in the library.
+        if _OPTIONS["aot"] then
+            files {_OPTIONS["aot"] .. "/*.cpp"}
+            includedirs {"src"}
+        end
+
+        configuration {"linux"}
+            links {"pthread"}
+
+    -- Measures emulation throughput of the different engines.
+    project "cee-bench"
+        location "build"
+        kind "ConsoleApp"
+        files {
+            "src/bench.cpp"
+        }
+        links {"cee-core"}
+
+        if _OPTIONS["aot"] then
+            files {_OPTIONS["aot"] .. "/*.cpp"}
+            includedirs {"src"}
+        end
+
+    -- Translates programs to C++ ahead of time, for the aot backend.
+    project "cee-aot"
+        location "build"
+        kind "ConsoleApp"
+        files {
+            "src/recompiler.cpp"
+        }
+        links {"cee-core"}
+
+    -- Disassembles programs and recovers their flow graph.
+    project "cee-disasm"
+        location "build"
+        kind "ConsoleApp"
+        files {
+            "src/disasm.cpp"
+        }
+        links {"cee-core"}
+
+    -- Runs arbitrary programs under the sanitizers, with libFuzzer.
+    if _OPTIONS["fuzz"] then
+    project "cee-fuzz"
+        location "build"
+        kind "ConsoleApp"
+        files {
+            "src/fuzz.cpp"
+        }
+        links {"cee-core"}
+        linkoptions {"-fsanitize=fuzzer"}
+
+        configuration {"linux"}
+            links {"pthread"}
+    end
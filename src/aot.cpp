@@ -0,0 +1,122 @@
+#include "aot.hpp"
+
+#include <cstdio>
+
+#include <algorithm>
+
+// Memory pages are tracked the same way as cee::Chip8 does for its
+// cached blocks, with pages beyond 4K sharing bits with those 4K apart.
+static constexpr size_t PAGE_SHIFT = 6;
+
+cee::Aot::Registration::Registration(const Program & program)
+{
+    // Translations made for another version may not match how blocks
+    // are cached anymore, so they're left out.
+    if (program.version != VERSION)
+    {
+        printf("Chip8 Error: Translation of %s is for version %u, rather than %u\n",
+               program.name, program.version, VERSION);
+        return;
+    }
+
+    getPrograms().push_back(&program);
+}
+
+cee::Aot::Aot(size_t memorySize)
+    : mBlocks(memorySize, nullptr)
+    , mLengths(memorySize, 0)
+    , mLongest(0)
+    , mPages(0)
+{
+}
+
+bool cee::Aot::hasPrograms()
+{
+    return ! getPrograms().empty();
+}
+
+bool cee::Aot::load(uint64_t hash, cee::Quirks quirks)
+{
+    flush();
+
+    for (const auto program : getPrograms())
+    {
+        if (program->hash != hash || program->quirks != quirks)
+            continue;
+
+        for (size_t i = 0; i < program->size; i++)
+        {
+            const auto & entry = program->blocks[i];
+            if (entry.length == 0 || size_t(entry.address) + entry.length * 2 > mBlocks.size())
+                continue;
+
+            mBlocks[entry.address]  = entry.block;
+            mLengths[entry.address] = entry.length;
+            mLongest = std::max<size_t>(mLongest, entry.length);
+
+            const size_t first = entry.address >> PAGE_SHIFT;
+            const size_t last  = (entry.address + entry.length * 2 - 1) >> PAGE_SHIFT;
+            for (size_t page = first; page <= last; page++)
+                mPages |= uint64_t(1) << (page & 63);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+cee::Aot::Block cee::Aot::find(uint16_t address) const
+{
+    return mBlocks[address];
+}
+
+void cee::Aot::invalidate(uint16_t address, uint16_t size)
+{
+    // Same as for cached blocks: writes to pages without translated
+    // code are let through, and an instruction starting one byte ahead
+    // of the write is affected too.
+    const size_t lower = address > 0 ? address - 1 : 0;
+    const size_t upper = size_t(address) + size - 1;
+
+    uint64_t pages = 0;
+    for (size_t page = lower >> PAGE_SHIFT; page <= upper >> PAGE_SHIFT; page++)
+        pages |= uint64_t(1) << (page & 63);
+
+    if ((mPages & pages) == 0)
+        return;
+
+    // Blocks dropped stay dropped, the interpreter taking over from them
+    // until the next program is loaded.
+    const size_t first = address > mLongest * 2 ? address - mLongest * 2 : 0;
+    for (size_t start = first; start <= upper && start < mBlocks.size(); start++)
+    {
+        if (mBlocks[start] && start + mLengths[start] * 2 > address)
+            mBlocks[start] = nullptr;
+    }
+}
+
+void cee::Aot::flush()
+{
+    std::fill(mBlocks.begin(), mBlocks.end(), nullptr);
+    std::fill(mLengths.begin(), mLengths.end(), 0);
+    mLongest = 0;
+    mPages   = 0;
+}
+
+void cee::Aot::catchUpTimers(Chip8 * chip)
+{
+    chip->catchUpTimers();
+}
+
+void cee::Aot::interpret(Chip8 * chip)
+{
+    chip->execute(chip->decode(chip->mCounter));
+}
+
+std::vector<const cee::Aot::Program *> & cee::Aot::getPrograms()
+{
+    // Built on first use, as translation units start up in no particular order.
+    static std::vector<const Program *> programs;
+    return programs;
+}
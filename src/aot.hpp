@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef CEE_AOT_HPP
+#define CEE_AOT_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+
+#include "chip8.hpp"
+#include "quirks.hpp"
+
+namespace cee
+{
+    // Runs blocks of a program translated to C++ ahead of time by cee-aot,
+    // for hosts which don't allow pages to be writable and executable.
+    // Translations are linked in, and picked by the hash of the memory
+    // image and the quirks profile when a program is loaded. Blocks only
+    // run natively while memory under them is left as it was; the rest
+    // goes through the interpreter, as do the operations without a
+    // translation (e.g. drawing, calls and returns).
+    class Aot
+    {
+    public:
+        using Block = void (*)(Chip8 *);
+
+        static constexpr uint32_t VERSION = 1;          // Bumped whenever translated code has to be made again
+
+        // Translated block starting at an address.
+        struct Entry
+        {
+            uint16_t address; // Address of the first instruction
+            uint8_t  length;  // Number of instructions
+            Block    block;   // Native code
+        };
+
+        // Translation of a program, as cee-aot writes it out.
+        struct Program
+        {
+            uint32_t      version; // VERSION it was made for
+            uint64_t      hash;    // Hash of the memory image it was made from
+            cee::Quirks   quirks;  // Profile it was made for
+            const Entry * blocks;  // Blocks, by address
+            size_t        size;    // Number of blocks
+            const char *  name;    // Name of the program
+        };
+
+        // Adds a translation to the ones looked up, from the translation
+        // unit holding it as it starts up.
+        struct Registration
+        {
+            explicit Registration(const Program & program);
+        };
+
+        explicit Aot(size_t memorySize);
+
+        Aot(const Aot &) = delete;
+        Aot & operator=(const Aot &) = delete;
+
+        static bool hasPrograms();                      // Whether any translation is linked in
+
+        bool  load(uint64_t hash, cee::Quirks quirks);  // Picks up the translation of a memory image, false if none
+        Block find(uint16_t address) const;             // Translated block starting at address
+        void  invalidate(uint16_t address, uint16_t size); // Drops blocks overwritten in memory
+        void  flush();                                  // Forgets every translated block
+
+        // Emulator state, for translated code to work on.
+        static uint8_t *  registers(Chip8 * chip) { return chip->mRegisters.data(); }
+        static uint16_t & index(Chip8 * chip)     { return chip->mIndex; }
+        static uint16_t & counter(Chip8 * chip)   { return chip->mCounter; }
+
+        // Lets cycles go by, ticking the timers when they're due.
+        static void advanceTimers(Chip8 * chip, uint32_t cycles)
+        {
+            chip->mTimerPhase -= static_cast<int32_t>(TIMER_RATE * cycles);
+            if (chip->mTimerPhase <= 0)
+                catchUpTimers(chip);
+        }
+
+        static void catchUpTimers(Chip8 * chip);        // Ticks the timers until the phase is positive again
+        static void interpret(Chip8 * chip);            // Executes the instruction at the program counter, which has no translation
+    private:
+        std::vector<Block>   mBlocks;  // Translated blocks by start address
+        std::vector<uint8_t> mLengths; // Instructions of the translated blocks, by start address
+        size_t               mLongest; // Most instructions of a translated block
+        uint64_t             mPages;   // Memory pages holding translated blocks, as in cee::Chip8
+
+        static std::vector<const Program *> & getPrograms(); // Translations linked in
+    };
+}
+
+#endif // CEE_AOT_HPP
@@ -0,0 +1,632 @@
+#include "batch.hpp"
+#include "layout.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Vectors holding one value per lane. These are compiler vector
+// extensions, lowered to AVX2 or SSE depending on the target.
+// They never cross the boundary of this file, so ABI notes about
+// passing them around don't concern us.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef uint8_t  U8  __attribute__((vector_size(32)));
+typedef int8_t   M8  __attribute__((vector_size(32)));
+typedef uint16_t U16 __attribute__((vector_size(64)));
+typedef int16_t  M16 __attribute__((vector_size(64)));
+typedef uint32_t U32 __attribute__((vector_size(128)));
+
+static_assert(sizeof(U8) == cee::Chip8Batch::LANES, "A vector must hold one byte per lane");
+
+// Lanes only ever behave like the default profile of cee::Chip8.
+using BatchQuirks = cee::ModernQuirks;
+
+static_assert(! BatchQuirks::resetVf && ! BatchQuirks::shiftVy && ! BatchQuirks::jumpVx
+              && BatchQuirks::incrementIndex && ! BatchQuirks::indexOneShort
+              && ! BatchQuirks::superChip && ! BatchQuirks::xoChip,
+              "The batch implements the quirks of the modern profile");
+
+template <typename V, typename T>
+static inline V load(const T & lanes)
+{
+    V v;
+    std::memcpy(&v, lanes.data(), sizeof(v));
+    return v;
+}
+
+template <typename V, typename T>
+static inline void store(T & lanes, const V & v)
+{
+    std::memcpy(lanes.data(), &v, sizeof(v));
+}
+
+// Picks a where the mask is set, and b elsewhere.
+template <typename V, typename M>
+static inline V select(M mask, V a, V b)
+{
+    return (a & (V) mask) | (b & ~(V) mask);
+}
+
+// Bit mask of the lanes set in a vector mask.
+static inline uint32_t bits(M8 mask)
+{
+#if defined(__AVX2__)
+    __m256i v;
+    std::memcpy(&v, &mask, sizeof(v));
+    return _mm256_movemask_epi8(v);
+#elif defined(__SSE2__)
+    __m128i v[2];
+    std::memcpy(v, &mask, sizeof(v));
+    return _mm_movemask_epi8(v[0]) | _mm_movemask_epi8(v[1]) << 16;
+#else
+    uint32_t result = 0;
+    for (size_t i = 0; i < cee::Chip8Batch::LANES; i++)
+        result |= (mask[i] ? 1u : 0u) << i;
+    return result;
+#endif
+}
+
+// Vector mask of the lanes set in a bit mask.
+static inline M8 lanes(uint32_t mask)
+{
+    U32 bit = {};
+    for (size_t i = 0; i < cee::Chip8Batch::LANES; i++)
+        bit[i] = 1u << i;
+    return __builtin_convertvector((bit & mask) != 0, M8);
+}
+
+cee::Chip8Batch::Chip8Batch()
+    : mTimerPhase(DEFAULT_CYCLE_RATE)
+    , mCycleRate(DEFAULT_CYCLE_RATE)
+    , mMemory(MEMORY_SIZE)
+    , mReported(false)
+{
+    mSeeds.fill(0);
+    mSeeded.fill(false);
+}
+
+void cee::Chip8Batch::loadProgram(const std::vector<uint8_t> & program)
+{
+    loadProgram(program.data(), program.size());
+}
+
+void cee::Chip8Batch::loadProgram(const uint8_t * program, size_t size)
+{
+    this->reset();
+
+    // Prevent Memory Overflow, in release builds too, as programs come
+    // from anywhere.
+    if (size >= mMemory.size() - PROG_OFFSET)
+    {
+        printf("Chip8 Error: Program of %zu bytes doesn't fit in memory\n", size);
+        size = mMemory.size() - PROG_OFFSET - 1;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        mMemory[i + PROG_OFFSET].fill(program[i]);
+}
+
+void cee::Chip8Batch::reset()
+{
+    mCounter.fill(0x200);
+    mIndex.fill(0);
+    mStackPointer.fill(0);
+    mDelayTimer.fill(0);
+    mSoundTimer.fill(0);
+    mTimerPhase = static_cast<int32_t>(mCycleRate);
+    mKeysPressed.fill(0);
+    mLastKeyPressed.fill(0);
+
+    for (auto & registers : mRegisters)
+        registers.fill(0);
+    for (auto & level : mStack)
+        level.fill(0);
+    for (auto & gfx : mGfx)
+        gfx.fill(0);
+    mDirtyRows.fill(~cee::GfxRows(0));
+    mDrawCount = 0;
+    mReported  = false;
+    for (auto & byte : mMemory)
+        byte.fill(0);
+
+    for (size_t i = 0; i < CHIP8_FONTSET.size(); i++)
+        mMemory[i].fill(CHIP8_FONTSET[i]);
+
+    // Lanes given a seed start over from it, just like emulators of a
+    // pool do, and the others from a random one.
+    std::random_device rd;
+    for (size_t lane = 0; lane < LANES; lane++)
+        mRandState[lane] = mSeeded[lane] ? cee::mixSeed(mSeeds[lane]) : rd() | 1;
+}
+
+void cee::Chip8Batch::setSeed(uint32_t seed)
+{
+    for (size_t lane = 0; lane < LANES; lane++)
+        setSeed(lane, seed);
+}
+
+void cee::Chip8Batch::setSeed(size_t lane, uint32_t seed)
+{
+    mSeeds[lane]     = seed;
+    mSeeded[lane]    = true;
+    mRandState[lane] = cee::mixSeed(seed);
+}
+
+void cee::Chip8Batch::updateKeys(size_t lane, cee::Keys keys)
+{
+    mKeysPressed[lane]    = keys.keysPressed;
+    mLastKeyPressed[lane] = keys.lastKeyPressed;
+}
+
+bool cee::Chip8Batch::setCycleRate(uint32_t rate)
+{
+    // Same as for cee::Chip8, the phase counts in 32 bits.
+    if (rate > cee::MAX_CYCLE_RATE)
+    {
+        printf("Chip8 Error: %u instructions per second is too many\n", rate);
+        return false;
+    }
+
+    mCycleRate  = rate;
+    mTimerPhase = static_cast<int32_t>(rate);
+    return true;
+}
+
+void cee::Chip8Batch::updateCycles(size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        updateCycle();
+}
+
+void cee::Chip8Batch::updateCycle()
+{
+    const auto counters = load<U16>(mCounter);
+    auto pending = ~0u;
+
+    // Each round takes the first pending lane, and runs its opcode on
+    // every other lane which is at the same address with the same opcode.
+    while (pending != 0)
+    {
+        const auto lane = __builtin_ctz(pending);
+        const auto pc   = mCounter[lane];
+        const auto hi   = load<U8>(mMemory[pc & 0xFFF]);
+        const auto lo   = load<U8>(mMemory[(pc + 1) & 0xFFF]);
+
+        const uint16_t opcode = hi[lane] << 8 | lo[lane];
+        const auto same = __builtin_convertvector(counters == pc, M8) & (hi == hi[lane]) & (lo == lo[lane]);
+        const auto group = bits(same) & pending;
+
+        if (! executeGroup(group, opcode))
+        {
+            for (auto left = group; left != 0; left &= left - 1)
+                executeLane(__builtin_ctz(left), opcode);
+        }
+
+        pending &= ~group;
+    }
+
+    // Every lane runs the same number of cycles, so they all share the
+    // timer phase. It's counted down the same way as in cee::Chip8.
+    if (mCycleRate == 0)
+        return;
+
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE);
+    while (mTimerPhase <= 0)
+    {
+        updateTimers();
+        mTimerPhase += static_cast<int32_t>(mCycleRate);
+    }
+}
+
+void cee::Chip8Batch::updateTimers()
+{
+    // Count down timers that haven't reached 0 yet.
+    auto delay = load<U8>(mDelayTimer);
+    auto sound = load<U8>(mSoundTimer);
+    delay += (U8) (delay != 0);
+    sound += (U8) (sound != 0);
+    store(mDelayTimer, delay);
+    store(mSoundTimer, sound);
+}
+
+bool cee::Chip8Batch::executeGroup(uint32_t group, uint16_t opcode)
+{
+    const auto mask = lanes(group);
+    const auto wide = __builtin_convertvector(mask, M16);
+
+    const uint8_t  x   = (opcode & 0x0F00) >> 8;
+    const uint8_t  y   = (opcode & 0x00F0) >> 4;
+    const uint8_t  nn  = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+
+    auto counters = load<U16>(mCounter);
+    auto vx       = load<U8>(mRegisters[x]);
+    auto vy       = load<U8>(mRegisters[y]);
+    auto vf       = load<U8>(mRegisters[0xF]);
+
+    // Skips are taken where the condition holds.
+    auto skip = [&](M8 condition)
+    {
+        auto step = (U16) __builtin_convertvector(condition, M16) & 2;
+        store(mCounter, select(wide, counters + 2 + step, counters));
+    };
+
+    // VX is written before VF, so that VF wins when X is F.
+    auto write = [&](U8 value, U8 flag)
+    {
+        store(mRegisters[x], select(mask, value, vx));
+        vf = load<U8>(mRegisters[0xF]);
+        store(mRegisters[0xF], select(mask, flag, vf));
+    };
+
+    switch (opcode & 0xF000)
+    {
+    case 0x1000:
+        store(mCounter, select(wide, (U16) {} + nnn, counters));
+        return true;
+    case 0x3000:
+        skip(vx == nn);
+        return true;
+    case 0x4000:
+        skip(vx != nn);
+        return true;
+    case 0x5000:
+        skip(vx == vy);
+        return true;
+    case 0x9000:
+        skip(vx != vy);
+        return true;
+    case 0x6000:
+        store(mRegisters[x], select(mask, (U8) {} + nn, vx));
+        break;
+    case 0x7000:
+        store(mRegisters[x], select(mask, vx + nn, vx));
+        break;
+    case 0x8000:
+        switch (opcode & 0x000F)
+        {
+        case 0x0:
+            store(mRegisters[x], select(mask, vy, vx));
+            break;
+        case 0x1:
+            store(mRegisters[x], select(mask, vx | vy, vx));
+            break;
+        case 0x2:
+            store(mRegisters[x], select(mask, vx & vy, vx));
+            break;
+        case 0x3:
+            store(mRegisters[x], select(mask, vx ^ vy, vx));
+            break;
+        case 0x4:
+            write(vx + vy, (U8) (vx + vy < vx) & 1);
+            break;
+        case 0x5:
+            write(vx - vy, (U8) (vx >= vy) & 1);
+            break;
+        case 0x7:
+            write(vy - vx, (U8) (vy >= vx) & 1);
+            break;
+        case 0x6:
+            // VF is set first, and VX is read again in case X is F.
+            store(mRegisters[0xF], select(mask, vx & 1, vf));
+            vx = load<U8>(mRegisters[x]);
+            store(mRegisters[x], select(mask, vx >> 1, vx));
+            break;
+        case 0xE:
+            store(mRegisters[0xF], select(mask, vx >> 7, vf));
+            vx = load<U8>(mRegisters[x]);
+            store(mRegisters[x], select(mask, vx << 1, vx));
+            break;
+        default:
+            return false;
+        }
+        break;
+    case 0xA000:
+        store(mIndex, select(wide, (U16) {} + nnn, load<U16>(mIndex)));
+        break;
+    case 0xE000:
+    {
+        // Keys are tested by X itself, just like cee::Chip8 does.
+        const uint16_t key     = 1 << x;
+        const auto     pressed = (load<U16>(mKeysPressed) & key) != 0;
+        if (nn == 0x9E)
+            skip(__builtin_convertvector(pressed, M8));
+        else if (nn == 0xA1)
+            skip(__builtin_convertvector(pressed == 0, M8));
+        else
+            return false;
+        return true;
+    }
+    case 0xF000:
+    {
+        const auto index = load<U16>(mIndex);
+
+        switch (nn)
+        {
+        case 0x07:
+            store(mRegisters[x], select(mask, load<U8>(mDelayTimer), vx));
+            break;
+        case 0x0A:
+            // Lanes keep waiting as long as none of them has a key pressed.
+            if (bits(__builtin_convertvector(load<U16>(mKeysPressed) != 0, M8)) & group)
+                return false;
+            return true;
+        case 0x15:
+            store(mDelayTimer, select(mask, vx, load<U8>(mDelayTimer)));
+            break;
+        case 0x18:
+            store(mSoundTimer, select(mask, vx, load<U8>(mSoundTimer)));
+            break;
+        case 0x1E:
+        {
+            // VF is set first, and VX is read again in case X is F.
+            const auto sum = index + __builtin_convertvector(vx, U16);
+            store(mRegisters[0xF], select(mask, (U8) __builtin_convertvector(sum > 0xFFF, M8) & 1, vf));
+            vx = load<U8>(mRegisters[x]);
+            store(mIndex, select(wide, index + __builtin_convertvector(vx, U16), index));
+            break;
+        }
+        case 0x29:
+            store(mIndex, select(wide, __builtin_convertvector(vx, U16) * 5, index));
+            break;
+        default:
+            return false;
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+
+    store(mCounter, select(wide, counters + 2, counters));
+    return true;
+}
+
+// Same operations as cee::Chip8, for a single lane.
+void cee::Chip8Batch::executeLane(size_t lane, uint16_t opcode)
+{
+    const uint8_t  x   = (opcode & 0x0F00) >> 8;
+    const uint8_t  y   = (opcode & 0x00F0) >> 4;
+    const uint8_t  n   = opcode & 0x000F;
+    const uint8_t  nn  = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+
+    auto & pc  = mCounter[lane];
+    auto & i   = mIndex[lane];
+    auto & sp  = mStackPointer[lane];
+    auto & vx  = mRegisters[x][lane];
+    auto & vy  = mRegisters[y][lane];
+    auto & vf  = mRegisters[0xF][lane];
+    auto & gfx = mGfx[lane];
+
+    // Memory accesses wrap around, rather than running off the end.
+    auto memory = [&](size_t address) -> uint8_t &
+    {
+        return mMemory[address & 0xFFF][lane];
+    };
+
+    switch (opcode & 0xF000)
+    {
+    case 0x0000:
+        if (nn == 0xE0)
+        {
+            cee::clearGfx(gfx, mDirtyRows[lane]);
+        }
+        else if (nn == 0xEE)
+        {
+            sp -= 1;
+            pc = mStack[sp & 0xF][lane];
+        }
+        pc += 2;
+        return;
+    case 0x1000:
+        pc = nnn;
+        return;
+    case 0x2000:
+        mStack[sp & 0xF][lane] = pc;
+        sp += 1;
+        pc = nnn;
+        return;
+    case 0x3000:
+        pc += (vx == nn ? 4 : 2);
+        return;
+    case 0x4000:
+        pc += (vx == nn ? 2 : 4);
+        return;
+    case 0x5000:
+        pc += (vx == vy ? 4 : 2);
+        return;
+    case 0x6000:
+        vx = nn;
+        break;
+    case 0x7000:
+        vx += nn;
+        break;
+    case 0x8000:
+    {
+        const uint8_t a = vx;
+        const uint8_t b = vy;
+
+        switch (n)
+        {
+        case 0x0: vx = b; break;
+        case 0x1: vx |= b; break;
+        case 0x2: vx &= b; break;
+        case 0x3: vx ^= b; break;
+        case 0x4: vx = a + b; vf = (b > (0xFF - a)) ? 1 : 0; break;
+        case 0x5: vx = a - b; vf = (b > a) ? 0 : 1; break;
+        case 0x6: vf = vx & 1; vx >>= 1; break;
+        case 0x7: vx = b - a; vf = (a > b) ? 0 : 1; break;
+        case 0xE: vf = vx >> 7; vx <<= 1; break;
+        default:
+            reportUnknown(opcode);
+            return;
+        }
+        break;
+    }
+    case 0x9000:
+        pc += (vx != vy ? 4 : 2);
+        return;
+    case 0xA000:
+        i = nnn;
+        break;
+    case 0xB000:
+        pc = nnn + mRegisters[0x0][lane];
+        return;
+    case 0xC000:
+    {
+        auto & state = mRandState[lane];
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        vx = (state >> 24) & nn;
+        break;
+    }
+    case 0xD000:
+    {
+        // Lanes stay in low resolution, using the left half of the rows.
+        const size_t px = vx % cee::LORES_WIDTH;
+        const size_t py = vy % cee::LORES_HEIGHT;
+        vf = 0;
+        mDrawCount++;
+
+        for (uint8_t row = 0; row < n; row++)
+        {
+            if (! BatchQuirks::wrapSprites && py + row >= cee::LORES_HEIGHT)
+                break;
+
+            const auto y = (py + row) % cee::LORES_HEIGHT;
+            const auto pixels = uint16_t(memory(i + row) << 8);
+            if (cee::drawSpriteRow(gfx, px, y, pixels, false, BatchQuirks::wrapSprites, mDirtyRows[lane]))
+                vf = 1;
+        }
+        break;
+    }
+    case 0xE000:
+    {
+        const auto pressed = mKeysPressed[lane] & (1 << x);
+        if (nn == 0x9E)
+            pc += pressed ? 4 : 2;
+        else if (nn == 0xA1)
+            pc += pressed ? 2 : 4;
+        else
+            reportUnknown(opcode);
+        return;
+    }
+    case 0xF000:
+        switch (nn)
+        {
+        case 0x07:
+            vx = mDelayTimer[lane];
+            break;
+        case 0x0A:
+            if (mKeysPressed[lane] == 0)
+                return;
+            vx = mLastKeyPressed[lane];
+            break;
+        case 0x15:
+            mDelayTimer[lane] = vx;
+            break;
+        case 0x18:
+            mSoundTimer[lane] = vx;
+            break;
+        case 0x1E:
+            vf = (i + vx > 0xFFF) ? 1 : 0;
+            i += vx;
+            break;
+        case 0x29:
+            i = vx * 5;
+            break;
+        case 0x33:
+            memory(i)     = vx / 100;
+            memory(i + 1) = (vx / 10) % 10;
+            memory(i + 2) = vx % 10;
+            break;
+        case 0x55:
+            for (size_t r = 0; r <= x; r++)
+                memory(i + r) = mRegisters[r][lane];
+            i += x + 1;
+            break;
+        case 0x65:
+            for (size_t r = 0; r <= x; r++)
+                mRegisters[r][lane] = memory(i + r);
+            i += x + 1;
+            break;
+        default:
+            reportUnknown(opcode);
+            return;
+        }
+        break;
+    }
+
+    pc += 2;
+}
+
+void cee::Chip8Batch::reportUnknown(uint16_t opcode)
+{
+    // Lanes stay stuck on an unknown opcode, their program counter left
+    // where it is, which is only reported the first time in the batch.
+    if (mReported)
+        return;
+
+    mReported = true;
+    printf("Chip8 Error: Unknown OpCode 0x%x\n", opcode);
+}
+
+const cee::Gfx & cee::Chip8Batch::getGfx(size_t lane) const
+{
+    return mGfx[lane];
+}
+
+cee::GfxRows cee::Chip8Batch::getDirtyRows(size_t lane) const
+{
+    return mDirtyRows[lane];
+}
+
+void cee::Chip8Batch::clearDirtyRows(size_t lane)
+{
+    mDirtyRows[lane] = 0;
+}
+
+uint8_t cee::Chip8Batch::getRegister(size_t lane, size_t index) const
+{
+    return mRegisters[index][lane];
+}
+
+uint16_t cee::Chip8Batch::getIndex(size_t lane) const
+{
+    return mIndex[lane];
+}
+
+uint16_t cee::Chip8Batch::getCounter(size_t lane) const
+{
+    return mCounter[lane];
+}
+
+uint8_t cee::Chip8Batch::getDelayTimer(size_t lane) const
+{
+    return mDelayTimer[lane];
+}
+
+uint8_t cee::Chip8Batch::getSoundTimer(size_t lane) const
+{
+    return mSoundTimer[lane];
+}
+
+bool cee::Chip8Batch::isBeeping(size_t lane) const
+{
+    return mSoundTimer[lane] > 0;
+}
+
+uint64_t cee::Chip8Batch::getDrawCount() const
+{
+    return mDrawCount;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifndef CEE_BATCH_HPP
+#define CEE_BATCH_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <vector>
+
+#include "chip8.hpp"
+#include "gfx.hpp"
+#include "keys.hpp"
+
+namespace cee
+{
+    // Runs a batch of emulators in lockstep, with their state laid out as a
+    // structure of arrays: each register holds one value per lane, and so
+    // does every byte of memory. Lanes at the same instruction execute it
+    // together, with arithmetic done across all lanes at once using SIMD.
+    // Lanes that diverge fall back to executing one at a time.
+    // Every lane follows the modern quirks, which are the default.
+    class Chip8Batch
+    {
+    public:
+        static constexpr size_t LANES = 32;              // Emulators in a batch
+        static constexpr size_t MEMORY_SIZE = 4096;      // Bytes of memory of every lane
+
+        explicit Chip8Batch();
+
+        void reset();                                    // Reset every lane to default settings
+        void loadProgram(const std::vector<uint8_t> & program); // Load program into every lane
+        void loadProgram(const uint8_t * program, size_t size); // Same, from any buffer
+        void updateKeys(size_t lane, cee::Keys keys);    // Updates key states of a lane
+        void updateCycle();                              // Emulates one cycle on every lane
+        void updateCycles(size_t count);                 // Emulates a number of cycles on every lane
+        void updateTimers();                             // Counts down the timers of every lane, as a 60 Hz tick does
+        bool setCycleRate(uint32_t rate);                // Instructions per second, pacing the timers (0 leaves them to updateTimers), false above MAX_CYCLE_RATE
+        void setSeed(uint32_t seed);                     // Seeds the random generator of every lane, now and on every reset
+        void setSeed(size_t lane, uint32_t seed);        // Same, for a single lane
+
+        const cee::Gfx & getGfx(size_t lane) const;      // Graphics of a lane.
+        cee::GfxRows     getDirtyRows(size_t lane) const; // Rows of a lane's display changed since the last clearDirtyRows.
+        void             clearDirtyRows(size_t lane);    // Marks the display of a lane as seen.
+        uint8_t         getRegister(size_t lane, size_t index) const; // Register VX of a lane.
+        uint16_t        getIndex(size_t lane) const;     // Index register of a lane.
+        uint16_t        getCounter(size_t lane) const;   // Program counter of a lane.
+        uint8_t         getDelayTimer(size_t lane) const; // Delay timer of a lane.
+        uint8_t         getSoundTimer(size_t lane) const; // Sound timer of a lane.
+        bool            isBeeping(size_t lane) const;    // Check if a lane is beeping.
+        uint64_t        getDrawCount() const;            // Sprites drawn by every lane since reset.
+    private:
+        template <typename T>
+        using Lanes = std::array<T, LANES>;
+
+        Lanes<uint16_t>                 mIndex;        // Index Register
+        Lanes<uint16_t>                 mCounter;      // Program Counter (PC)
+        Lanes<uint8_t>                  mStackPointer; // Current stack level
+        Lanes<uint8_t>                  mDelayTimer;   // Counts down to 0
+        Lanes<uint8_t>                  mSoundTimer;   // Counts down to 0, buzzes when 0
+        int32_t                         mTimerPhase;   // Counts down by TIMER_RATE a cycle, ticks the timers at 0
+        uint32_t                        mCycleRate;    // Instructions per second
+        std::array<Lanes<uint8_t>, 16>  mRegisters;    // General Purpose Registers
+        std::array<Lanes<uint16_t>, 16> mStack;        // 16 levels of stack
+        std::vector<Lanes<uint8_t>>     mMemory;       // 4K available space
+        Lanes<cee::Gfx>                 mGfx;          // 64 x 32 Pixel Resolution, a bit per pixel
+        Lanes<cee::GfxRows>             mDirtyRows;    // Rows of the display changed since last seen
+        uint64_t                        mDrawCount;    // Sprites drawn by every lane since reset
+        bool                            mReported;     // Whether an unknown opcode was reported since reset
+        Lanes<uint32_t>                 mRandState;    // Pseudo-Random Number Generators (xorshift)
+        Lanes<uint32_t>                 mSeeds;        // Seed given to each generator on reset
+        Lanes<bool>                     mSeeded;       // Whether each seed is used, rather than a random one
+        Lanes<uint16_t>                 mKeysPressed;  // Current key states, as a bit per key
+        Lanes<uint16_t>                 mLastKeyPressed;
+
+        bool executeGroup(uint32_t group, uint16_t opcode); // Executes an opcode on many lanes at once
+        void executeLane(size_t lane, uint16_t opcode);  // Executes an opcode on a single lane
+        void reportUnknown(uint16_t opcode);             // Reports an opcode that has no operation, once
+    };
+}
+
+#endif // CEE_BATCH_HPP
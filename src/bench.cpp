@@ -0,0 +1,624 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "aot.hpp"
+#include "batch.hpp"
+#include "chip8.hpp"
+#include "jit.hpp"
+#include "layout.hpp"
+#include "library.hpp"
+#include "replay.hpp"
+
+// Cycles run between comparisons by --verify, at most.
+static constexpr uint64_t VERIFY_STRIDE = 997;
+
+// Ways of running a program which get measured.
+enum class Engine
+{
+    Step,        // Interpreter, stepped one cycle at a time
+    Interpreter, // Interpreter, running cached blocks
+    Jit,         // Translated blocks
+    Aot,         // Blocks translated ahead of time, where linked in
+    Batch        // Emulators in SIMD lanes, in lockstep
+};
+
+// What a run of a program on an engine came to.
+struct Result
+{
+    std::string program;      // Name of the program
+    Engine      engine;
+    uint64_t    cycles;       // Cycles emulated, over every emulator
+    uint64_t    instructions; // Instructions actually run, leaving out idle loops skipped over
+    uint64_t    draws;        // Sprites drawn, over every emulator
+    double      seconds;      // Time taken
+    long        peakRss;      // Peak resident memory of the process running it, in KB
+};
+
+static void
+printUsage();
+
+static const char *
+getName(Engine engine);
+
+static cee::Backend
+getBackend(Engine engine);
+
+static std::vector<cee::InputEvent>
+makeInput(uint64_t cycles);
+
+static Result
+run(Engine engine, const cee::Rom & program,
+    const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed);
+
+static Result
+runApart(Engine engine, const cee::Rom & program,
+         const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed);
+
+static void
+advance(cee::Chip8 & chip, Engine engine, uint64_t cycles);
+
+static uint64_t
+verify(Engine engine, Engine reference, const cee::Rom & program, cee::Quirks quirks,
+       const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed);
+
+static int
+verifyAll(const cee::RomLibrary & library, const std::vector<Engine> & engines,
+          const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed);
+
+static long
+getPeakRss();
+
+static std::string
+quote(const std::string & text);
+
+static std::string
+formatRatio(const char * format, double value, double by, const char * none);
+
+static void
+printText(const std::vector<Result> & results);
+
+static void
+printJson(const std::vector<Result> & results, uint64_t cycles, uint32_t seed);
+
+int main(int argc, char ** argv)
+{
+    auto paths   = std::vector<std::string>();
+    auto cycles  = uint64_t(1000000);
+    auto seed    = uint32_t(1);
+    auto engines = std::vector<Engine>();
+    auto events  = std::vector<cee::InputEvent>();
+    auto scripts = false;
+    auto json    = false;
+    auto check   = false;
+    auto archive = std::string();
+
+    for (int i = 1; i < argc; i++)
+    {
+        const auto arg = std::string(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--cycles" && hasValue)
+        {
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--seed" && hasValue)
+        {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--backend" && hasValue)
+        {
+            const auto name = std::string(argv[++i]);
+            auto found = false;
+
+            for (auto engine : {Engine::Step, Engine::Interpreter, Engine::Jit, Engine::Aot, Engine::Batch})
+            {
+                if (name == getName(engine))
+                {
+                    engines.push_back(engine);
+                    found = true;
+                }
+            }
+
+            if (! found)
+            {
+                printf("Chip8 Error: Unknown backend %s\n", name.c_str());
+                return -1;
+            }
+        }
+        else if (arg == "--input" && hasValue)
+        {
+            if (! cee::loadInputScript(argv[++i], events))
+                return -1;
+            scripts = true;
+        }
+        else if (arg == "--save-archive" && hasValue)
+        {
+            archive = argv[++i];
+        }
+        else if (arg == "--json")
+        {
+            json = true;
+        }
+        else if (arg == "--verify")
+        {
+            check = true;
+        }
+        else if (arg[0] != '-')
+        {
+            paths.push_back(arg);
+        }
+        else
+        {
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (paths.empty())
+    {
+        printf("Chip8 Error: Wrong number of arguments\n");
+        printUsage();
+        return -1;
+    }
+
+    // Programs are mapped rather than read, and only run once however
+    // many times they're found.
+    cee::RomLibrary library;
+    for (const auto & path : paths)
+        if (! library.add(path.c_str()))
+            return -1;
+
+    if (! archive.empty())
+        return library.saveArchive(archive.c_str()) ? 0 : -1;
+
+    if (check && engines.empty())
+    {
+        engines = {Engine::Interpreter, Engine::Jit};
+        if (! cee::Jit::isSupported())
+            engines.erase(std::find(engines.begin(), engines.end(), Engine::Jit));
+        if (cee::Aot::hasPrograms())
+            engines.push_back(Engine::Aot);
+    }
+
+    if (engines.empty())
+    {
+        engines = {Engine::Step, Engine::Interpreter, Engine::Jit, Engine::Batch};
+        if (! cee::Jit::isSupported())
+            engines.erase(std::find(engines.begin(), engines.end(), Engine::Jit));
+        if (cee::Aot::hasPrograms())
+            engines.insert(std::find(engines.begin(), engines.end(), Engine::Batch), Engine::Aot);
+    }
+
+    if (scripts)
+    {
+        std::stable_sort(events.begin(), events.end(), [](const cee::InputEvent & a, const cee::InputEvent & b)
+        {
+            return a.cycle < b.cycle;
+        });
+    }
+    else
+    {
+        events = makeInput(cycles);
+    }
+
+    if (check)
+        return verifyAll(library, engines, events, cycles, seed);
+
+    auto results = std::vector<Result>();
+    for (size_t i = 0; i < library.size(); i++)
+    {
+        for (const auto engine : engines)
+        {
+            // Programs only fitting in XO-CHIP's memory run with its
+            // quirks, which the batch doesn't have.
+            if (engine == Engine::Batch && library[i].size >= cee::Chip8Batch::MEMORY_SIZE - cee::PROG_OFFSET)
+                continue;
+
+            results.push_back(runApart(engine, library[i], events, cycles, seed));
+            results.back().program = library[i].name;
+        }
+    }
+
+    if (json)
+        printJson(results, cycles, seed);
+    else
+        printText(results);
+
+    return 0;
+}
+
+void
+printUsage()
+{
+    printf("Usage: cee-bench [OPTIONS] PATH...\n"
+           "  PATH              Program, directory of programs, or archive made by --save-archive\n"
+           "  --cycles N        Number of cycles each emulator runs (default: 1000000)\n"
+           "  --backend NAME    Backend to measure: step, interpreter, jit, aot or batch (default: all of them)\n"
+           "  --input FILE      Scripted input, one \"CYCLE KEYS\" line per change (default: every key in turn)\n"
+           "  --seed N          Seed of the random generator (default: 1)\n"
+           "  --json            Print the results as JSON\n"
+           "  --verify          Check the backends end up just like the interpreter stepped a cycle at a time instead, for every quirks profile\n"
+           "  --save-archive F  Pack the programs found into an archive, rather than running them\n");
+}
+
+const char *
+getName(Engine engine)
+{
+    switch (engine)
+    {
+    case Engine::Step:        return "step";
+    case Engine::Interpreter: return "interpreter";
+    case Engine::Jit:         return "jit";
+    case Engine::Aot:         return "aot";
+    case Engine::Batch:       return "batch";
+    }
+
+    return "";
+}
+
+cee::Backend
+getBackend(Engine engine)
+{
+    switch (engine)
+    {
+    case Engine::Jit: return cee::Backend::Jit;
+    case Engine::Aot: return cee::Backend::Aot;
+    default:          return cee::Backend::Interpreter;
+    }
+}
+
+// Most programs sit waiting for a key at some point, so unless told
+// otherwise every key gets a short press in turn, 5 seconds apart.
+std::vector<cee::InputEvent>
+makeInput(uint64_t cycles)
+{
+    constexpr uint64_t PERIOD = 5 * cee::DEFAULT_CYCLE_RATE;
+    constexpr uint64_t PRESS  = cee::DEFAULT_CYCLE_RATE / 10;
+
+    auto events = std::vector<cee::InputEvent>();
+    for (uint64_t cycle = 0, key = 0; cycle < cycles; cycle += PERIOD, key = (key + 1) % 16)
+    {
+        events.push_back({cycle, {uint16_t(1 << key), uint16_t(key)}});
+        events.push_back({cycle + PRESS, {0, uint16_t(key)}});
+    }
+
+    return events;
+}
+
+// Runs a program up to each input change in one go, just like the
+// headless runner does. The batch runs as many emulators as it has
+// lanes, so its instructions and draws are over all of them. Cycles
+// of idle loops skipped over aren't instructions run, which would
+// otherwise make up most of the time of programs waiting on a key.
+Result
+run(Engine engine, const cee::Rom & program,
+    const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto result   = Result();
+    result.engine = engine;
+
+    auto next = events.begin();
+    auto done = uint64_t(0);
+    auto start = Clock::now();
+
+    if (engine == Engine::Batch)
+    {
+        cee::Chip8Batch batch;
+        batch.setSeed(seed);
+        batch.loadProgram(program.data, program.size);
+
+        start = Clock::now();
+        while (done < cycles)
+        {
+            for (; next != events.end() && next->cycle <= done; next++)
+                for (size_t lane = 0; lane < cee::Chip8Batch::LANES; lane++)
+                    batch.updateKeys(lane, next->keys);
+
+            const auto until = next == events.end() ? cycles : std::min(cycles, next->cycle);
+            batch.updateCycles(until - done);
+            done = until;
+        }
+
+        result.cycles       = done * cee::Chip8Batch::LANES;
+        result.instructions = result.cycles;
+        result.draws        = batch.getDrawCount();
+    }
+    else
+    {
+        cee::Chip8 chip(getBackend(engine));
+        chip.setSeed(seed);
+        if (program.size >= chip.getMemorySize() - cee::PROG_OFFSET)
+            chip.setQuirks(cee::Quirks::XoChip);
+        chip.loadProgram(program.data, program.size);
+
+        start = Clock::now();
+        while (done < cycles)
+        {
+            for (; next != events.end() && next->cycle <= done; next++)
+                chip.updateKeys(next->keys);
+
+            const auto until = next == events.end() ? cycles : std::min(cycles, next->cycle);
+            advance(chip, engine, until - done);
+            done = until;
+        }
+
+        result.cycles       = done;
+        result.instructions = done - chip.getSkipCount();
+        result.draws        = chip.getDrawCount();
+    }
+
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    result.seconds = elapsed.count();
+    result.peakRss = getPeakRss();
+    return result;
+}
+
+// Runs a program in a process of its own, as the peak memory of a
+// process only ever grows, so that it's the peak of that run alone on
+// top of what the process started out with. Runs where the process
+// can't be made are left to this one.
+Result
+runApart(Engine engine, const cee::Rom & program,
+         const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return run(engine, program, events, cycles, seed);
+
+    fflush(stdout);
+    const auto pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return run(engine, program, events, cycles, seed);
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        const auto result = run(engine, program, events, cycles, seed);
+        const uint64_t counts[] = {result.cycles, result.instructions, result.draws};
+        const auto written = write(fds[1], counts, sizeof(counts)) == sizeof(counts) &&
+                             write(fds[1], &result.seconds, sizeof(result.seconds)) == sizeof(result.seconds) &&
+                             write(fds[1], &result.peakRss, sizeof(result.peakRss)) == sizeof(result.peakRss);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    auto result   = Result();
+    result.engine = engine;
+
+    uint64_t counts[3] = {};
+    const auto read = ::read(fds[0], counts, sizeof(counts)) == sizeof(counts) &&
+                      ::read(fds[0], &result.seconds, sizeof(result.seconds)) == sizeof(result.seconds) &&
+                      ::read(fds[0], &result.peakRss, sizeof(result.peakRss)) == sizeof(result.peakRss);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (! read || ! WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return run(engine, program, events, cycles, seed);
+
+    result.cycles       = counts[0];
+    result.instructions = counts[1];
+    result.draws        = counts[2];
+    return result;
+}
+
+void
+advance(cee::Chip8 & chip, Engine engine, uint64_t cycles)
+{
+    if (engine == Engine::Step)
+    {
+        for (uint64_t cycle = 0; cycle < cycles; cycle++)
+            chip.updateCycle();
+    }
+    else
+    {
+        chip.updateCycles(cycles);
+    }
+}
+
+// Runs a program on an engine and on the reference side by side, with
+// the same input, and compares their snapshots at every input change
+// and every VERIFY_STRIDE cycles in between. The stride being odd, runs
+// of blocks get cut short anywhere in them, fused instructions too.
+// Returns the cycle they were first seen to differ by, or 0 if never.
+uint64_t
+verify(Engine engine, Engine reference, const cee::Rom & program, cee::Quirks quirks,
+       const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed)
+{
+    cee::Chip8 chip(getBackend(engine));
+    cee::Chip8 expected(getBackend(reference));
+    for (auto emulator : {&chip, &expected})
+    {
+        emulator->setQuirks(quirks);
+        emulator->setSeed(seed);
+        emulator->loadProgram(program.data, program.size);
+    }
+
+    auto next = events.begin();
+    auto done = uint64_t(0);
+    while (done < cycles)
+    {
+        for (; next != events.end() && next->cycle <= done; next++)
+        {
+            chip.updateKeys(next->keys);
+            expected.updateKeys(next->keys);
+        }
+
+        const auto change = next == events.end() ? cycles : std::min(cycles, next->cycle);
+        const auto until  = std::min(change, done + VERIFY_STRIDE);
+        advance(chip, engine, until - done);
+        advance(expected, reference, until - done);
+        done = until;
+
+        if (chip.saveState() != expected.saveState())
+            return done;
+    }
+
+    return 0;
+}
+
+// Verifies every engine with a state to compare, on every program, for
+// every quirks profile whose memory the program fits in. Returns the
+// exit status, failing if any run differs.
+int
+verifyAll(const cee::RomLibrary & library, const std::vector<Engine> & engines,
+          const std::vector<cee::InputEvent> & events, uint64_t cycles, uint32_t seed)
+{
+    constexpr auto REFERENCE = Engine::Step;
+    constexpr auto PROFILES  = sizeof(cee::QUIRKS_NAMES) / sizeof(cee::QUIRKS_NAMES[0]);
+
+    size_t runs     = 0;
+    size_t failures = 0;
+    for (size_t profile = 0; profile < PROFILES; profile++)
+    {
+        const auto quirks = static_cast<cee::Quirks>(profile);
+
+        cee::Chip8 probe;
+        probe.setQuirks(quirks);
+        const auto capacity = probe.getMemorySize() - cee::PROG_OFFSET;
+
+        for (size_t i = 0; i < library.size(); i++)
+        {
+            if (library[i].size >= capacity)
+                continue;
+
+            for (const auto engine : engines)
+            {
+                if (engine == REFERENCE || engine == Engine::Batch)
+                    continue;
+
+                const auto cycle = verify(engine, REFERENCE, library[i], quirks, events, cycles, seed);
+                if (cycle == 0)
+                {
+                    printf("%-12s %-8s %-12s ok\n", library[i].name.c_str(), cee::getName(quirks), getName(engine));
+                }
+                else
+                {
+                    printf("%-12s %-8s %-12s differs from %s by cycle %llu\n",
+                           library[i].name.c_str(), cee::getName(quirks), getName(engine),
+                           getName(REFERENCE), static_cast<unsigned long long>(cycle));
+                    failures += 1;
+                }
+
+                runs += 1;
+            }
+        }
+    }
+
+    printf("%zu of %zu runs differ\n", failures, runs);
+    return failures == 0 ? 0 : 1;
+}
+
+long
+getPeakRss()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // Given in bytes
+#else
+    return usage.ru_maxrss;        // Given in kilobytes
+#endif
+}
+
+// Escapes a name to go in a JSON string, control characters included.
+std::string
+quote(const std::string & text)
+{
+    std::string quoted;
+    for (const auto c : text)
+    {
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            quoted += escaped;
+            continue;
+        }
+
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+
+    return quoted;
+}
+
+// Formats value divided by another, or none when it's divided by 0, as
+// runs of no cycles or of nothing but idle loops have no rate.
+std::string
+formatRatio(const char * format, double value, double by, const char * none)
+{
+    if (by == 0)
+        return none;
+
+    char text[32];
+    snprintf(text, sizeof(text), format, value / by);
+    return text;
+}
+
+void
+printText(const std::vector<Result> & results)
+{
+    printf("%-12s %-12s %14s %14s %10s %14s %10s\n",
+           "program", "backend", "cycles/s", "ips", "ns/instr", "draws/s", "peak KB");
+
+    for (const auto & result : results)
+    {
+        printf("%-12s %-12s %14s %14s %10s %14s %10ld\n",
+               result.program.c_str(), getName(result.engine),
+               formatRatio("%.0f", result.cycles, result.seconds, "-").c_str(),
+               formatRatio("%.0f", result.instructions, result.seconds, "-").c_str(),
+               formatRatio("%.2f", result.seconds * 1e9, result.instructions, "-").c_str(),
+               formatRatio("%.0f", result.draws, result.seconds, "-").c_str(),
+               result.peakRss);
+    }
+}
+
+void
+printJson(const std::vector<Result> & results, uint64_t cycles, uint32_t seed)
+{
+    printf("{\n");
+    printf("  \"cycles\": %llu,\n", static_cast<unsigned long long>(cycles));
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"results\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto & result = results[i];
+        printf("    {\"program\": \"%s\", \"backend\": \"%s\", "
+               "\"cycles\": %llu, \"instructions\": %llu, \"draws\": %llu, \"seconds\": %.6f, "
+               "\"cycles_per_second\": %s, \"ips\": %s, \"ns_per_instruction\": %s, \"draws_per_second\": %s, "
+               "\"peak_rss_kb\": %ld}%s\n",
+               quote(result.program).c_str(), getName(result.engine),
+               static_cast<unsigned long long>(result.cycles),
+               static_cast<unsigned long long>(result.instructions),
+               static_cast<unsigned long long>(result.draws),
+               result.seconds,
+               formatRatio("%.0f", result.cycles, result.seconds, "null").c_str(),
+               formatRatio("%.0f", result.instructions, result.seconds, "null").c_str(),
+               formatRatio("%.3f", result.seconds * 1e9, result.instructions, "null").c_str(),
+               formatRatio("%.0f", result.draws, result.seconds, "null").c_str(),
+               result.peakRss,
+               i + 1 < results.size() ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef CEE_BYTES_HPP
+#define CEE_BYTES_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+
+// Hashing and byte order shared by the formats and tools.
+namespace cee
+{
+    // FNV-1a hash of a run of bytes, which memory images, programs and
+    // displays are all told apart by.
+    inline uint64_t hashBytes(const uint8_t * data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Appends the lowest size bytes of a number, little-endian.
+    inline void putNumber(std::vector<uint8_t> & out, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            out.push_back(uint8_t(value >> (i * 8)));
+    }
+
+    // Reads a number of size bytes, little-endian.
+    inline uint64_t getNumber(const uint8_t * in, size_t size)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++)
+            value |= uint64_t(in[i]) << (i * 8);
+        return value;
+    }
+}
+
+#endif // CEE_BYTES_HPP
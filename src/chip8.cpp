@@ -1,97 +1,373 @@
 #include "chip8.hpp"
+#include "aot.hpp"
+#include "bytes.hpp"
+#include "jit.hpp"
+#include "layout.hpp"
 
 #include <cassert>
+#include <cstring>
 
 #include <bitset>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <stack>
+#include <random>
 
-static constexpr std::array<uint8_t, 80> CHIP8_FONTSET =
-{{
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-}};
-
-// This is the starting location on where the emulator should start
-// reading any loaded program.
-static constexpr size_t PROG_OFFSET = 512;
-
-cee::Chip8::Chip8()
-{
-    // Load operations
-    #ifndef ADD_OP
-    #define ADD_OP(n) mOps.emplace(n, std::bind(&Chip8::op##n, this));
-
-    ADD_OP(0x0000)
-    ADD_OP(0x00E0)
-    ADD_OP(0x00EE)
-    ADD_OP(0x1000)
-    ADD_OP(0x2000)
-    ADD_OP(0x3000)
-    ADD_OP(0x4000)
-    ADD_OP(0x5000)
-    ADD_OP(0x6000)
-    ADD_OP(0x7000)
-    ADD_OP(0x8000)
-    ADD_OP(0x8001)
-    ADD_OP(0x8002)
-    ADD_OP(0x8003)
-    ADD_OP(0x8004)
-    ADD_OP(0x8005)
-    ADD_OP(0x8006)
-    ADD_OP(0x8007)
-    ADD_OP(0x800E)
-    ADD_OP(0x9000)
-    ADD_OP(0xA000)
-    ADD_OP(0xB000)
-    ADD_OP(0xC000)
-    ADD_OP(0xD000)
-    ADD_OP(0xE0A1)
-    ADD_OP(0xE09E)
-    ADD_OP(0xF007)
-    ADD_OP(0xF00A)
-    ADD_OP(0xF015)
-    ADD_OP(0xF018)
-    ADD_OP(0xF01E)
-    ADD_OP(0xF029)
-    ADD_OP(0xF033)
-    ADD_OP(0xF055)
-    ADD_OP(0xF065)
-
-    #undef ADD_OP
-    #endif // ADD_OP
-}
-
-void cee::Chip8::loadProgram(std::vector<uint8_t> program)
-{
-    this->reset();
-
-    // Prevent Memory Overflow
-    assert(program.size() < (mMemory.size() - PROG_OFFSET));
-    for (size_t i = 0; i < program.size(); i++)
-        mMemory[i + PROG_OFFSET] = program[i];
+// Maximum number of instructions that can be cached as a single block.
+static constexpr size_t MAX_BLOCK = 32;
+
+// Size of the memory pages tracked for cached code and snapshots.
+static constexpr size_t PAGE_SHIFT = 6;
+
+// Bytes in each of those pages.
+static constexpr size_t PAGE_SIZE = 1 << PAGE_SHIFT;
+
+// Pages of the largest memory, as a bit each.
+static constexpr size_t MAX_PAGES = cee::MAX_MEMORY_SIZE / PAGE_SIZE;
+
+// Size of the spans of memory tracked for running blocks of the image,
+// which are finer than pages to tell code from data next to it.
+static constexpr size_t SPAN_SHIFT = 3;
+
+// Spans tracked, as a bit each. Beyond 4K, spans share their bits with
+// the ones 4K apart.
+static constexpr size_t SPANS = 4096 >> SPAN_SHIFT;
+
+// Snapshots are made of this header, followed by the planes set in
+// `planes`, as many rows of them as the resolution has, and then the
+// memory pages set in `pages`, in ascending order. Numbers are stored in
+// the byte order of the host, which is little-endian on every host we
+// support.
+struct State
+{
+    char     magic[4];            // Always "CEE8"
+    uint16_t version;             // Bumped whenever the layout changes
+    uint16_t stackPointer;
+    uint64_t imageHash;           // Memory image the snapshot was taken against
+    uint64_t pages[MAX_PAGES / 64]; // Memory pages stored after the planes
+    uint16_t index;
+    uint16_t counter;
+    uint8_t  delayTimer;
+    uint8_t  soundTimer;
+    uint16_t keysPressed;
+    uint16_t lastKeyPressed;
+    uint8_t  quirks;              // Profile the snapshot was taken with
+    uint8_t  hires;
+    int32_t  timerPhase;
+    uint32_t cycleRate;
+    uint32_t randState;
+    uint8_t  planes;              // Planes drawn to
+    uint8_t  storedPlanes;        // Planes stored after the header, the others being blank
+    uint8_t  pitch;
+    uint8_t  reserved;
+    uint32_t reserved2;
+    uint64_t dirtyRows;
+    uint16_t stack[16];
+    uint8_t  registers[16];
+    uint8_t  flags[16];
+    uint8_t  pattern[16];
+};
+
+static_assert(sizeof(State) == 264, "Changes to the snapshot layout need a new version");
+static_assert(cee::MAX_STATE_SIZE == sizeof(State) + sizeof(cee::GfxPlanes) + cee::MAX_MEMORY_SIZE,
+              "Snapshots can hold every plane and every page of memory");
+
+static constexpr char     STATE_MAGIC[4] = {'C', 'E', 'E', '8'};
+static constexpr uint16_t STATE_VERSION  = 2;
+
+// Longest stretch of cycles skipped over at once, so that the timer
+// phase can't overflow however long a program idles for.
+static constexpr size_t MAX_SKIP = INT32_MAX / cee::TIMER_RATE;
+
+// Entry of the decoding tables of an opcode.
+static constexpr size_t getSlot(uint16_t opcode)
+{
+    return (opcode & 0xF000) >> 4 | (opcode & 0x00FF);
+}
+
+// Bytes of memory of a profile.
+static constexpr size_t getProfileMemory(bool xoChip)
+{
+    return xoChip ? cee::MAX_MEMORY_SIZE : 4096;
+}
+
+cee::Chip8::Chip8(cee::Backend backend)
+    : mTimerPhase(DEFAULT_CYCLE_RATE)
+    , mCycleRate(DEFAULT_CYCLE_RATE)
+    , mMemory(getProfileMemory(false))
+    , mHires(false)
+    , mPlanes(1)
+    , mPitch(64)
+    , mReported(false)
+    , mOps(&getOps<cee::ModernQuirks>())
+    , mCodePages(0)
+    , mSeed(0)
+    , mSeeded(false)
+#ifdef CEE_PROFILE
+    , mProfiler(getProfileMemory(false))
+#endif
+{
+    // Emulators start out with blank memory, sharing its image until
+    // they're reset or load a program. It's decoded right away, as it's
+    // shared by every emulator there is.
+    static const std::shared_ptr<Image> blank = []
+    {
+        const std::vector<uint8_t> memory(getProfileMemory(false), 0);
+        const auto image = std::make_shared<Image>(memory.data(), memory.size(), &getOps<cee::ModernQuirks>());
+        decodeBlocks(*image);
+        return image;
+    }();
+
+    mImage = blank;
+    mWrittenPages.fill(0);
+    mStaleSpans.fill(0);
+
+    if (backend == cee::Backend::Jit && cee::Jit::isSupported())
+        mJit.reset(new cee::Jit(*this, mMemory.size()));
+
+    if (backend == cee::Backend::Aot)
+        mAot.reset(new cee::Aot(mMemory.size()));
+}
+
+cee::Chip8::Image::Image(const uint8_t * memory, size_t size, const Ops * ops)
+    : memory(memory, memory + size)
+    , hash(cee::hashBytes(memory, size))
+    , ops(ops)
+    , decoded(false)
+{
+}
+
+cee::Chip8::~Chip8() = default;
+cee::Chip8::Chip8(Chip8 &&) = default;
+cee::Chip8 & cee::Chip8::operator=(Chip8 &&) = default;
+
+template <typename Policy>
+const cee::Chip8::Ops & cee::Chip8::getOps()
+{
+    // Every opcode is reduced to its highest nibble and lowest byte,
+    // which is enough to tell apart all of the operations. Groups with
+    // a single operation simply fill all of their 256 entries with it.
+    static const Ops ops = []
+    {
+        Ops table = {};
+        table.quirks  = Policy::profile;
+        table.resetVf = Policy::resetVf;
+        table.shiftVy = Policy::shiftVy;
+        table.jumpVx  = Policy::jumpVx;
+        table.superChip = Policy::superChip;
+        table.xoChip    = Policy::xoChip;
+
+        auto add = [&table](Op op, const char * name, bool branch) -> uint8_t
+        {
+            table.handlers[table.size] = op;
+            table.branches[table.size] = branch;
+            table.names[table.size]    = name;
+            return table.size++;
+        };
+
+        auto fill = [&table](uint16_t group, uint8_t op)
+        {
+            for (size_t i = 0; i < 256; i++)
+                table.index[(group >> 4) | i] = op;
+        };
+
+        // Operations that change the flow of the program end a block,
+        // and so do the ones writing to memory as they might overwrite
+        // the instructions following them.
+        table.unknown = add(&Chip8::opUnknown, "opUnknown", true);
+        table.index.fill(table.unknown);
+
+        #ifndef ADD_OP
+        #define ADD_OP(n, b) table.index[(n & 0xF000) >> 4 | (n & 0x00FF)] = add(&Chip8::op##n, "op" #n, b);
+        #define FILL_OP(n, b) fill(n, add(&Chip8::op##n, "op" #n, b));
+        #define ADD_QUIRK_OP(n, b) table.index[(n & 0xF000) >> 4 | (n & 0x00FF)] = add(&Chip8::op##n<Policy>, "op" #n, b);
+        #define FILL_QUIRK_OP(n, b) fill(n, add(&Chip8::op##n<Policy>, "op" #n, b));
+
+        FILL_OP(0x0000, false)
+        FILL_OP(0x1000, true)
+        FILL_OP(0x2000, true)
+        FILL_QUIRK_OP(0x3000, true)
+        FILL_QUIRK_OP(0x4000, true)
+        FILL_QUIRK_OP(0x5000, true)
+        FILL_OP(0x6000, false)
+        FILL_OP(0x7000, false)
+        FILL_QUIRK_OP(0x9000, true)
+        FILL_OP(0xA000, false)
+        FILL_QUIRK_OP(0xB000, true)
+        FILL_OP(0xC000, false)
+        FILL_QUIRK_OP(0xD000, false)
+
+        ADD_OP(0x00E0, false)
+        ADD_OP(0x00EE, true)
+        ADD_QUIRK_OP(0xE0A1, true)
+        ADD_QUIRK_OP(0xE09E, true)
+        ADD_OP(0xF007, false)
+        ADD_OP(0xF00A, true)
+        ADD_OP(0xF015, false)
+        ADD_OP(0xF018, false)
+        ADD_OP(0xF01E, false)
+        ADD_OP(0xF029, false)
+        ADD_OP(0xF033, true)
+        ADD_QUIRK_OP(0xF055, true)
+        ADD_QUIRK_OP(0xF065, false)
+
+        #undef FILL_QUIRK_OP
+        #undef ADD_QUIRK_OP
+        #undef FILL_OP
+        #undef ADD_OP
+        #endif // ADD_OP
+
+        // Extensions are added to every table, keeping the indices the
+        // same, but only decoded by the profiles that have them. Others
+        // keep decoding those opcodes as they did before. Some carry an
+        // operand in the lowest byte, and so take up a range of entries.
+        auto extend = [&table](bool enabled, uint16_t opcode, uint16_t step, uint8_t op)
+        {
+            for (size_t i = 0; enabled && i < 16; i++)
+                table.index[(opcode & 0xF000) >> 4 | ((opcode + i * step) & 0x00FF)] = op;
+        };
+
+        #ifndef EXTEND_OP
+        #define EXTEND_OP(e, n, step, b) extend(e, n, step, add(&Chip8::op##n, "op" #n, b));
+
+        EXTEND_OP(Policy::superChip, 0x00C0, 1, false)
+        EXTEND_OP(Policy::xoChip,    0x00D0, 1, false)
+        EXTEND_OP(Policy::superChip, 0x00FB, 0, false)
+        EXTEND_OP(Policy::superChip, 0x00FC, 0, false)
+        EXTEND_OP(Policy::superChip, 0x00FD, 0, true)
+        EXTEND_OP(Policy::superChip, 0x00FE, 0, false)
+        EXTEND_OP(Policy::superChip, 0x00FF, 0, false)
+        EXTEND_OP(Policy::xoChip,    0x5002, 16, true)
+        EXTEND_OP(Policy::xoChip,    0x5003, 16, false)
+        EXTEND_OP(Policy::xoChip,    0xF000, 0, true)
+        EXTEND_OP(Policy::xoChip,    0xF001, 0, false)
+        EXTEND_OP(Policy::xoChip,    0xF002, 0, false)
+        EXTEND_OP(Policy::superChip, 0xF030, 0, false)
+        EXTEND_OP(Policy::xoChip,    0xF03A, 0, false)
+        EXTEND_OP(Policy::superChip, 0xF075, 0, false)
+        EXTEND_OP(Policy::superChip, 0xF085, 0, false)
+
+        #undef EXTEND_OP
+        #endif // EXTEND_OP
+
+        // Arithmetic operations only vary by their lowest nibble.
+        const uint8_t arithmetic[] =
+        {
+            add(&Chip8::op0x8000, "op0x8000", false),
+            add(&Chip8::op0x8001<Policy>, "op0x8001", false),
+            add(&Chip8::op0x8002<Policy>, "op0x8002", false),
+            add(&Chip8::op0x8003<Policy>, "op0x8003", false),
+            add(&Chip8::op0x8004, "op0x8004", false),
+            add(&Chip8::op0x8005, "op0x8005", false),
+            add(&Chip8::op0x8006<Policy>, "op0x8006", false),
+            add(&Chip8::op0x8007, "op0x8007", false),
+            add(&Chip8::op0x800E<Policy>, "op0x800E", false)
+        };
+
+        const uint8_t nibbles[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+
+        for (size_t i = 0; i < 256; i += 16)
+            for (size_t j = 0; j < sizeof(nibbles); j++)
+                table.index[0x800 | i | nibbles[j]] = arithmetic[j];
+
+        // Fused operations aren't decoded from any opcode, but run in
+        // place of the first instruction of the sequences they stand for.
+        table.fused[FUSE_LOAD_LOAD_DRAW] = add(&Chip8::fuseLoadLoadDraw<Policy>, "fuseLoadLoadDraw", false);
+        table.fused[FUSE_LOAD_LOAD]      = add(&Chip8::fuseLoadLoad, "fuseLoadLoad", false);
+        table.fused[FUSE_INDEX_DRAW]     = add(&Chip8::fuseIndexDraw<Policy>, "fuseIndexDraw", false);
+        table.fused[FUSE_ADD_SKIP]       = add(&Chip8::fuseAddSkip<Policy>, "fuseAddSkip", true);
+        table.fused[FUSE_DELAY_SKIP]     = add(&Chip8::fuseDelaySkip<Policy>, "fuseDelaySkip", true);
+
+        table.sizes.fill(1);
+        table.sizes[table.fused[FUSE_LOAD_LOAD_DRAW]] = 3;
+        table.sizes[table.fused[FUSE_LOAD_LOAD]]      = 2;
+        table.sizes[table.fused[FUSE_INDEX_DRAW]]     = 2;
+        table.sizes[table.fused[FUSE_ADD_SKIP]]       = 2;
+        table.sizes[table.fused[FUSE_DELAY_SKIP]]     = 2;
+
+        // Loops a program idles in start with one of these, which are
+        // looked into further before skipping anything.
+        table.idles[table.index[getSlot(0x1000)]] = true;
+        table.idles[table.index[getSlot(0xF007)]] = true;
+        table.idles[table.index[getSlot(0xF00A)]] = true;
+        table.idles[table.index[getSlot(0x00FD)]] = Policy::superChip;
+        table.idles[table.unknown] = true;
+
+        return table;
+    }();
+
+    return ops;
+}
+
+void cee::Chip8::loadProgram(const std::vector<uint8_t> & program)
+{
+    loadProgram(program.data(), program.size());
+}
+
+void cee::Chip8::loadProgram(const uint8_t * program, size_t size)
+{
+    restart();
+
+    // Prevent Memory Overflow, in release builds too, as programs come
+    // from anywhere.
+    if (size >= mMemory.size() - PROG_OFFSET)
+    {
+        printf("Chip8 Error: Program of %zu bytes doesn't fit in memory\n", size);
+        size = mMemory.size() - PROG_OFFSET - 1;
+    }
+
+    if (size > 0)
+        std::memcpy(&mMemory[PROG_OFFSET], program, size);
+
+    // Snapshots only hold memory which changed from here on.
+    updateImage();
+
+    // Translations are made for a memory image.
+    if (mAot) mAot->load(mImage->hash, mOps->quirks);
+}
+
+void cee::Chip8::loadProgram(const Chip8 & source)
+{
+    // Blocks are decoded with the tables of a profile, so the image
+    // can only be shared with the same one.
+    if (source.mImage->ops != mOps)
+        setQuirks(source.mImage->ops->quirks);
+
+    restart();
+
+    // The blocks are decoded before the image is shared, so that it
+    // never changes while any of the emulators sharing it run.
+    mImage = source.mImage;
+    getImageBlocks();
+
+    std::copy(mImage->memory.begin(), mImage->memory.end(), mMemory.begin());
+    mWrittenPages.fill(0);
+    mStaleSpans.fill(0);
+
+    if (mAot) mAot->load(mImage->hash, mOps->quirks);
+}
+
+void cee::Chip8::shareImage(const Chip8 & source)
+{
+    if (mImage == source.mImage || mImage->ops != source.mImage->ops || mImage->memory != source.mImage->memory)
+        return;
+
+    mImage = source.mImage;
+    getImageBlocks();
 }
 
 void cee::Chip8::reset()
+{
+    restart();
+
+    // Memory written to is tracked against the image from now on.
+    updateImage();
+}
+
+void cee::Chip8::restart()
 {
     mCounter      = 0x200; // Program counter starts at 0x200
-    mOpCode       = 0;     // Reset current opcode
     mIndex        = 0;     // Reset index register
     mStackPointer = 0;     // Reset stack pointer
     mDelayTimer   = 0;     // Reset delay timer
@@ -99,51 +375,854 @@ void cee::Chip8::reset()
     mKeys         = {};    // Reset key states
     mRegisters.fill(0);    // Reset registers
     mStack.fill(0);        // Reset stack
-    mGfx.fill(0);          // Reset display
-    mMemory.fill(0);       // Reset memory
+    mFlags.fill(0);        // Reset user flags
+    for (auto & plane : mGfx)
+        plane.fill(0);     // Reset display
+    mHires        = false; // Reset to low resolution
+    mPlanes       = 1;     // Reset to drawing the first plane
+    mDirtyRows    = ~cee::GfxRows(0); // Reset dirty rows to all of them
+    mDrawCount    = 0;     // Reset sprites drawn
+    mSkipCount    = 0;     // Reset idle cycles skipped
+    mReported     = false; // Reset unknown opcodes reported
+    mPattern.fill(0);      // Reset audio pattern
+    mPitch        = 64;    // Reset pitch to 4000 Hz
+    std::fill(mMemory.begin(), mMemory.end(), 0); // Reset memory
+    mCache.reset();        // Reset cached blocks
+    mCodePages    = 0;     // Reset pages holding cached blocks
+
+    // The first timer tick is a whole period away.
+    mTimerPhase = static_cast<int32_t>(mCycleRate);
+
+    // Reset translated blocks
+    if (mJit) mJit->flush();
+    if (mAot) mAot->flush();
+
+#ifdef CEE_PROFILE
+    // Reset the call chain being profiled
+    mProfiler.enter(mStack.data(), 0, mMemory.data());
+#endif
 
     // Load chip8 fontset
     for (size_t i = 0; i < CHIP8_FONTSET.size(); i++)
         mMemory[i] = CHIP8_FONTSET[i];
 
-    // Get a new random number as seed for pseudo-random generator.
-    // Also acts as a restart procedure for the generator.
+    // Load the big fontset, leaving memory as it was for the others
+    if (mOps->superChip)
+    {
+        for (size_t i = 0; i < BIG_FONTSET.size(); i++)
+            mMemory[BIG_FONT_OFFSET + i] = BIG_FONTSET[i];
+    }
+
+    // Get a new random number as seed for pseudo-random generator,
+    // unless one was given. Also acts as a restart procedure for the
+    // generator. Xorshift gets stuck on a zero state, so it is always
+    // kept off it.
+    if (mSeeded)
+    {
+        setSeed(mSeed);
+        return;
+    }
+
     std::random_device rd;
-    mRandGen.seed(rd());
+    mRandState = rd() | 1;
 }
 
 void cee::Chip8::updateCycle()
 {
-    // Fetch opcode
-    mOpCode = mMemory[mCounter] << 8 | mMemory[mCounter + 1];
-
-    // Decode opcode
-    auto op = mOpCode & 0xF000;
+    // Fetch, decode and execute opcode. The program counter wraps around
+    // memory, wherever jumps and returns took it.
+    mCounter &= mMemory.size() - 1;
+    execute(decode(mCounter));
+    advanceTimers(1);
+}
 
-    // In cases when there's variation of options for an instruction.
-    switch (op)
+void cee::Chip8::updateCycles(size_t count)
+{
+    // Blocks run from the ones decoded from the image, which emulators
+    // that loaded the same program share, for as long as memory still
+    // holds them. Translations are dropped along with the blocks they
+    // came from, which only the emulator's own cache keeps track of, so
+    // that's where the JIT takes all of its blocks from.
+    const auto image = mJit ? nullptr : &getImageBlocks();
+
+    while (count > 0)
     {
-    case 0x0000: case 0xE000: case 0xF000:
-        op = mOpCode & 0xF0FF;
-        break;
-    case 0x8000:
-        op = mOpCode & 0xF00F;
-        break;
-    default:
-        // Do nothing...
-        break;
+        // An instruction running off the end of memory can't be cached,
+        // so it's stepped on its own.
+        mCounter &= mMemory.size() - 1;
+        if (mCounter + 1u == mMemory.size())
+        {
+            updateCycle();
+            count -= 1;
+            continue;
+        }
+
+        const auto start = mCounter;
+        auto block = image ? &image->cache[start] : nullptr;
+        auto fused = image ? &image->fused[start] : nullptr;
+
+        if (! image || isStale(start))
+        {
+            auto & cache = getCache();
+            block = &cache.cache[start];
+            fused = &cache.fused[start];
+
+            if (block->length == 0)
+                cacheBlock(start);
+        }
+
+        assert(block->length > 0);
+
+        const auto length = std::min<size_t>(block->length, count);
+
+        // Translated blocks can only run as a whole. They also can't
+        // be profiled, so profiling builds interpret everything. Loops
+        // the program might idle in are never translated, which keeps
+        // looking out for them off the path of translated blocks.
+#ifndef CEE_PROFILE
+        if (mJit && length == block->length)
+        {
+            auto code = mJit->find(mCounter);
+            if (! code && (! mOps->idles[block->op] || getLoop(*block) == cee::Idle::None))
+                code = mJit->compile(*this, mCounter);
+
+            if (code)
+            {
+                code(this);
+                count -= length;
+                continue;
+            }
+        }
+
+        // Blocks translated ahead of time are cached the same way, and
+        // leave out idle loops too.
+        if (mAot && length == block->length)
+        {
+            const auto code = mAot->find(mCounter);
+            if (code)
+            {
+                code(this);
+                count -= length;
+                continue;
+            }
+        }
+
+        // Loops only waiting for something to change are skipped over
+        // in one go, leaving the emulator just as running them would.
+        // Profiling builds run them, to count what they do.
+        if (mOps->idles[block->op])
+        {
+            const auto skipped = skipIdle(*block, count);
+            if (skipped > 0)
+            {
+                mSkipCount += skipped;
+                count -= skipped;
+                continue;
+            }
+        }
+#endif
+
+        // Instructions of a block are laid out at the same addresses
+        // they have in memory, so they're two entries apart. Sequences
+        // fused into a single operation run as one, when all of them are
+        // left to run. Profiling builds keep them apart to count them.
+#ifdef CEE_PROFILE
+        (void) fused;
+        for (size_t i = 0; i < length; i++)
+        {
+            execute(block[i * 2]);
+            advanceTimers(1);
+        }
+#else
+        const auto & ops = *mOps;
+        for (size_t i = 0; i < length; )
+        {
+            const auto & in = block[i * 2];
+            auto   op   = fused[i * 2];
+            size_t size = 1;
+            if (op != in.op)
+            {
+                size = ops.sizes[op];
+                if (size > length - i)
+                {
+                    op   = in.op;
+                    size = 1;
+                }
+            }
+
+            (this->*ops.handlers[op])(in);
+            advanceTimers(1);
+            i += size;
+        }
+#endif
+
+        count -= length;
     }
+}
+
+cee::Chip8::Instruction cee::Chip8::decode(const Ops & ops, const uint8_t * memory, size_t size, uint16_t address)
+{
+    const size_t mask = size - 1;
+    uint16_t opcode = memory[address & mask] << 8 | memory[(address + 1) & mask];
+
+    Instruction in;
+    in.op     = ops.index[(opcode & 0xF000) >> 4 | (opcode & 0x00FF)];
+    in.length = 0;
+    in.x      = (opcode & 0x0F00) >> 8;
+    in.y      = (opcode & 0x00F0) >> 4;
+    in.n      = opcode & 0x000F;
+    in.nn     = opcode & 0x00FF;
+    in.nnn    = opcode & 0x0FFF;
+    return in;
+}
 
-    // Execute opcode
-    if (mOps.count(op)) mOps[op]();
-    else printf("Chip8 Error: Unknown OpCode 0x%x\n", op);
+cee::Chip8::Instruction cee::Chip8::decode(uint16_t address) const
+{
+    return decode(*mOps, mMemory.data(), mMemory.size(), address);
+}
 
+void cee::Chip8::execute(const Instruction & in)
+{
+#ifdef CEE_PROFILE
+    const auto pc    = mCounter;
+    const auto depth = mStackPointer;
+    const auto start = cee::readTicks();
+
+    (this->*mOps->handlers[in.op])(in);
+    mProfiler.record(in.op, pc, cee::readTicks() - start);
+
+    // Calls and returns move along the call chain.
+    if (mStackPointer != depth)
+        mProfiler.enter(mStack.data(), mStackPointer, mMemory.data());
+#else
+    (this->*mOps->handlers[in.op])(in);
+#endif
+}
+
+void cee::Chip8::updateTimers()
+{
     // Update delay timer
     if (mDelayTimer > 0) mDelayTimer -= 1;
 
     // Update sound timer
     if (mSoundTimer > 0) mSoundTimer -= 1;
+}
+
+bool cee::Chip8::setCycleRate(uint32_t rate)
+{
+    // The phase goes up by the rate at each tick, which has to leave it
+    // positive for the timers to catch up.
+    if (rate > cee::MAX_CYCLE_RATE)
+    {
+        printf("Chip8 Error: %u instructions per second is too many\n", rate);
+        return false;
+    }
+
+    mCycleRate  = rate;
+    mTimerPhase = static_cast<int32_t>(rate);
+    catchUpTimers();
+    return true;
+}
+
+inline void cee::Chip8::advanceTimers(uint32_t cycles)
+{
+    // Timers tick TIMER_RATE times for every mCycleRate cycles, which
+    // is counted without rounding by taking TIMER_RATE off the phase
+    // each cycle, and adding mCycleRate back at each tick.
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE * cycles);
+    if (mTimerPhase <= 0)
+        catchUpTimers();
+}
+
+void cee::Chip8::catchUpTimers()
+{
+    // Without a rate, the phase is just kept from reaching 0.
+    if (mCycleRate == 0)
+    {
+        mTimerPhase = INT32_MAX;
+        return;
+    }
+
+    while (mTimerPhase <= 0)
+    {
+        updateTimers();
+        mTimerPhase += static_cast<int32_t>(mCycleRate);
+    }
+}
+
+void cee::Chip8::skipCycles(size_t cycles)
+{
+    // The timers tick just as many times as advanceTimers would have
+    // ticked them, working the ticks out rather than counting them.
+    for (; cycles > 0; cycles -= std::min(cycles, MAX_SKIP))
+    {
+        const auto phase = int64_t(mTimerPhase) - int64_t(TIMER_RATE * std::min(cycles, MAX_SKIP));
+        if (phase > 0)
+        {
+            mTimerPhase = static_cast<int32_t>(phase);
+        }
+        else if (mCycleRate == 0)
+        {
+            mTimerPhase = INT32_MAX;
+        }
+        else
+        {
+            const auto ticks = uint64_t(-phase) / mCycleRate + 1;
+            mDelayTimer -= std::min<uint64_t>(ticks, mDelayTimer);
+            mSoundTimer -= std::min<uint64_t>(ticks, mSoundTimer);
+            mTimerPhase  = static_cast<int32_t>(phase + int64_t(ticks * mCycleRate));
+        }
+    }
+}
+
+size_t cee::Chip8::skipIdle(const Instruction & in, size_t count)
+{
+    switch (getIdle(in))
+    {
+    case cee::Idle::Key:
+    case cee::Idle::Halt:
+        // Nothing but the timers changes until the keys are updated,
+        // which can't happen before this run of cycles is over.
+        skipCycles(count);
+        return count;
+
+    case cee::Idle::Timer:
+    {
+        // Each round of FX07, 3X00 and the jump back takes 3 cycles,
+        // and all the rounds skipped have to read the timer before it
+        // runs out. The cycles of the last one are let go by after VX
+        // got its reading. Without a rate, the timers stay put.
+        size_t rounds = count / 3;
+        if (mCycleRate > 0)
+        {
+            const auto reads = (int64_t(mTimerPhase) + int64_t(mDelayTimer - 1) * mCycleRate - 1) / TIMER_RATE;
+            rounds = std::min<size_t>(rounds, reads / 3 + 1);
+        }
+
+        if (rounds == 0)
+            return 0;
+
+        skipCycles((rounds - 1) * 3);
+        mRegisters[in.x] = mDelayTimer;
+        skipCycles(3);
+        return rounds * 3;
+    }
+
+    case cee::Idle::None:
+        break;
+    }
+
+    return 0;
+}
+
+void cee::Chip8::setQuirks(cee::Quirks quirks)
+{
+    const auto previous = mOps;
+
+    switch (quirks)
+    {
+    case cee::Quirks::Modern:    mOps = &getOps<cee::ModernQuirks>();    break;
+    case cee::Quirks::CosmacVip: mOps = &getOps<cee::CosmacVipQuirks>(); break;
+    case cee::Quirks::Chip48:    mOps = &getOps<cee::Chip48Quirks>();    break;
+    case cee::Quirks::SuperChip: mOps = &getOps<cee::SuperChipQuirks>(); break;
+    case cee::Quirks::XoChip:    mOps = &getOps<cee::XoChipQuirks>();    break;
+    }
+
+    // Blocks decoded so far call the handlers of the previous profile,
+    // and so do the ones of the image, which is made again.
+    mCache.reset();
+    mCodePages = 0;
+    mImage = std::make_shared<Image>(mImage->memory.data(), mImage->memory.size(), mOps);
+    if (mJit) mJit->flush();
+    if (mAot) mAot->load(mImage->hash, mOps->quirks);
+
+    // Memory is laid out differently by the extensions, so the emulator
+    // starts over when switching to or from them, with translated
+    // blocks looked up over the whole of it.
+    if (previous->superChip != mOps->superChip || previous->xoChip != mOps->xoChip)
+    {
+        const auto size = getProfileMemory(mOps->xoChip);
+        if (size != mMemory.size())
+        {
+            mMemory.assign(size);
+            if (mJit) mJit.reset(new cee::Jit(*this, size));
+            if (mAot) mAot.reset(new cee::Aot(size));
+#ifdef CEE_PROFILE
+            mProfiler = cee::Profiler(size);
+#endif
+        }
+
+        reset();
+    }
+}
+
+void cee::Chip8::setSeed(uint32_t seed)
+{
+    mSeed      = seed;
+    mSeeded    = true;
+    mRandState = mixSeed(seed);
+}
+
+inline uint8_t cee::Chip8::random()
+{
+    // A 32-bit xorshift is plenty for games and, unlike mt19937,
+    // keeps the emulator small enough to run thousands of them.
+    mRandState ^= mRandState << 13;
+    mRandState ^= mRandState >> 17;
+    mRandState ^= mRandState << 5;
+    return mRandState >> 24;
+}
+
+void cee::Chip8::updateImage()
+{
+    // Images never change once shared, so a new one is made unless the
+    // memory is the same as the one it has, keeping its decoded blocks.
+    if (mImage && mImage->ops == mOps && mImage->memory.size() == mMemory.size()
+        && std::equal(mMemory.begin(), mMemory.end(), mImage->memory.begin()))
+    {
+        mWrittenPages.fill(0);
+        mStaleSpans.fill(0);
+        return;
+    }
+
+    mImage = std::make_shared<Image>(mMemory.data(), mMemory.size(), mOps);
+    mWrittenPages.fill(0);
+    mStaleSpans.fill(0);
+}
+
+const cee::Chip8::Blocks & cee::Chip8::getImageBlocks()
+{
+    if (! mImage->decoded)
+        decodeBlocks(*mImage);
 
+    return mImage->blocks;
+}
+
+void cee::Chip8::decodeBlocks(Image & image)
+{
+    // A block starts at every address, made of the instruction there
+    // and of the block after it, up to the first instruction ending
+    // one. They're decoded backwards to work out their lengths that way.
+    const auto & ops  = *image.ops;
+    const auto   size = image.memory.size();
+    auto & cache = image.blocks.cache;
+    auto & fused = image.blocks.fused;
+    cache.assign(size, Instruction());
+    fused.assign(size, 0);
+
+    for (size_t address = size - 1; address-- > 0; )
+    {
+        auto & in = cache[address];
+        in = decode(ops, image.memory.data(), size, static_cast<uint16_t>(address));
+
+        if (ops.branches[in.op] || address + 3 >= size)
+            in.length = 1;
+        else
+            in.length = static_cast<uint8_t>(std::min<size_t>(MAX_BLOCK, cache[address + 2].length + 1));
+    }
+
+    auto & reaches = image.reaches;
+    reaches.assign(size >> SPAN_SHIFT, 0);
+
+    for (size_t address = 0; address + 1 < size; address++)
+    {
+        const size_t length = cache[address].length;
+        const size_t span   = address >> SPAN_SHIFT;
+        fused[address]   = fuse(ops, &cache[address], length);
+        reaches[span]    = std::max<size_t>(reaches[span], ((address + length * 2 - 1) >> SPAN_SHIFT) - span);
+    }
+
+    image.decoded = true;
+}
+
+inline bool cee::Chip8::isStale(uint16_t address) const
+{
+    const size_t span = address >> SPAN_SHIFT;
+    return (mStaleSpans[(span % SPANS) / 64] >> (span & 63) & 1) != 0;
+}
+
+void cee::Chip8::markStale(size_t start, size_t end)
+{
+    // Blocks of the image starting up to a whole block ahead of memory
+    // written to may run over it, so none of them run from the image
+    // anymore, which is all it takes to tell as they start. Once the
+    // image is decoded, it's known which of them do go that far.
+    const auto & reaches = mImage->reaches;
+    const size_t reach   = (MAX_BLOCK * 2) >> SPAN_SHIFT;
+    for (size_t written = start >> SPAN_SHIFT; written <= (end - 1) >> SPAN_SHIFT; written++)
+    {
+        for (size_t span = written > reach ? written - reach : 0; span <= written; span++)
+        {
+            if (reaches.empty() || span + reaches[span] >= written)
+                mStaleSpans[(span % SPANS) / 64] |= uint64_t(1) << (span & 63);
+        }
+    }
+}
+
+cee::Chip8::Blocks & cee::Chip8::getCache()
+{
+    // The cache is only allocated once it's needed, so that emulators
+    // running the image's blocks stay small.
+    if (! mCache)
+    {
+        mCache.reset(new Blocks());
+        mCache->cache.resize(mMemory.size());
+        mCache->fused.resize(mMemory.size());
+    }
+
+    return *mCache;
+}
+
+void cee::Chip8::cacheBlock(uint16_t address)
+{
+    // Decode instructions up until the first one ending the block,
+    // without running off the end of memory.
+    assert(address + 1u < mMemory.size());
+    auto & cache = getCache().cache;
+    size_t length = 0;
+    while (length < MAX_BLOCK && address + length * 2 + 1 < mMemory.size())
+    {
+        // Blocks starting within this one lose their length, which writes
+        // go by to drop them, so their translations have to go now.
+        auto & entry = cache[address + length * 2];
+        if (mJit && length > 0 && entry.length > 0)
+            mJit->drop(address + length * 2);
+
+        entry = decode(address + length * 2);
+        length += 1;
+
+        const auto & in = entry;
+
+        if (mOps->branches[in.op])
+            break;
+    }
+
+    cache[address].length = length;
+
+    // Every instruction of the block gets the operation it runs as, and
+    // only the cache is read by the translators.
+    for (size_t i = 0; i < length; i++)
+        mCache->fused[address + i * 2] = fuse(*mOps, &cache[address + i * 2], length - i);
+
+    // Mark the pages covered by the block as holding code.
+    const size_t first = address >> PAGE_SHIFT;
+    const size_t last  = (address + length * 2 - 1) >> PAGE_SHIFT;
+    for (size_t page = first; page <= last; page++)
+        mCodePages |= uint64_t(1) << (page & 63);
+}
+
+uint8_t cee::Chip8::fuse(const Ops & ops, const Instruction * in, size_t length)
+{
+    const auto is = [&ops, in, length](size_t i, uint16_t opcode)
+    {
+        return i < length && in[i * 2].op == ops.index[getSlot(opcode)];
+    };
+
+    if (is(0, 0x6000) && is(1, 0x6000))
+        return ops.fused[is(2, 0xD000) ? FUSE_LOAD_LOAD_DRAW : FUSE_LOAD_LOAD];
+
+    if (is(0, 0xA000) && is(1, 0xD000))
+        return ops.fused[FUSE_INDEX_DRAW];
+
+    if (is(0, 0x7000) && is(1, 0x3000))
+        return ops.fused[FUSE_ADD_SKIP];
+
+    if (is(0, 0xF007) && is(1, 0x3000))
+        return ops.fused[FUSE_DELAY_SKIP];
+
+    return in->op;
+}
+
+void cee::Chip8::memoryWritten(uint16_t address, uint16_t size)
+{
+    // Writes running off the end of memory land at its start, and so
+    // do writes past it, which I can point anywhere.
+    const size_t start = address & (mMemory.size() - 1);
+    const size_t end   = start + size;
+    const size_t pages = mMemory.size() / PAGE_SIZE;
+    const size_t first = start >> PAGE_SHIFT;
+    const size_t last  = (end - 1) >> PAGE_SHIFT;
+    for (size_t page = first; page <= last; page++)
+        mWrittenPages[(page % pages) / 64] |= uint64_t(1) << (page & 63);
+
+    markStale(start, std::min(end, mMemory.size()));
+    if (end > mMemory.size())
+        markStale(0, end - mMemory.size());
+
+    invalidate(start, std::min(end, mMemory.size()) - start);
+    if (end > mMemory.size())
+        invalidate(0, end - mMemory.size());
+}
+
+void cee::Chip8::invalidate(uint16_t address, uint16_t size)
+{
+    // Blocks translated ahead of time are there before anything's cached.
+    if (mAot) mAot->invalidate(address, size);
+
+    if (! mCache)
+        return;
+
+    // Most writes land on data, which we can tell by checking the pages.
+    // An instruction starting one byte ahead of the write is affected too.
+    // Beyond 4K, pages share their bits with the ones 4K apart.
+    const size_t lower = address > 0 ? address - 1 : 0;
+    const size_t upper = size_t(address) + size - 1;
+
+    uint64_t pages = 0;
+    for (size_t page = lower >> PAGE_SHIFT; page <= upper >> PAGE_SHIFT; page++)
+        pages |= uint64_t(1) << (page & 63);
+
+    if ((mCodePages & pages) == 0)
+        return;
+
+    // Drop every block overlapping the written range.
+    const size_t first = address > MAX_BLOCK * 2 ? address - MAX_BLOCK * 2 : 0;
+    auto & cache = mCache->cache;
+    for (size_t start = first; start <= upper && start < cache.size(); start++)
+    {
+        auto & block = cache[start];
+        if (block.length > 0 && start + block.length * 2 > address)
+        {
+            block.length = 0;
+            if (mJit) mJit->drop(start);
+        }
+    }
+}
+
+std::vector<uint8_t> cee::Chip8::saveState() const
+{
+    std::vector<uint8_t> state;
+    saveState(state);
+    return state;
+}
+
+void cee::Chip8::saveState(std::vector<uint8_t> & out) const
+{
+    State state = {};
+    std::memcpy(state.magic, STATE_MAGIC, sizeof(state.magic));
+    state.version        = STATE_VERSION;
+    state.stackPointer   = mStackPointer;
+    state.imageHash      = mImage->hash;
+    state.index          = mIndex;
+    state.counter        = mCounter;
+    state.delayTimer     = mDelayTimer;
+    state.soundTimer     = mSoundTimer;
+    state.keysPressed    = mKeys.keysPressed;
+    state.lastKeyPressed = mKeys.lastKeyPressed;
+    state.quirks         = static_cast<uint8_t>(mOps->quirks);
+    state.hires          = mHires;
+    state.timerPhase     = mTimerPhase;
+    state.cycleRate      = mCycleRate;
+    state.randState      = mRandState;
+    state.planes         = mPlanes;
+    state.pitch          = mPitch;
+    state.dirtyRows      = mDirtyRows;
+    std::memcpy(state.pages, mWrittenPages.data(), sizeof(state.pages));
+    std::memcpy(state.stack, mStack.data(), sizeof(state.stack));
+    std::memcpy(state.registers, mRegisters.data(), sizeof(state.registers));
+    std::memcpy(state.flags, mFlags.data(), sizeof(state.flags));
+    std::memcpy(state.pattern, mPattern.data(), sizeof(state.pattern));
+
+    // Planes are only stored when something is drawn on them, and only
+    // as far as the resolution goes, which leaves programs without
+    // colours or high resolution with the same 256 bytes as before.
+    const size_t words = mHires ? cee::GFX_HEIGHT * 2 : cee::LORES_HEIGHT;
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+    {
+        const auto & gfx = mGfx[plane];
+        if (std::any_of(gfx.begin(), gfx.begin() + words, [](uint64_t word) { return word != 0; }))
+            state.storedPlanes |= 1 << plane;
+    }
+
+    // Memory is only stored where it was written to, which for most
+    // programs is a page or two of variables.
+    size_t pages = 0;
+    for (const auto word : mWrittenPages)
+        pages += __builtin_popcountll(word);
+
+    out.resize(sizeof(State)
+               + __builtin_popcount(state.storedPlanes) * words * sizeof(uint64_t)
+               + pages * PAGE_SIZE);
+    std::memcpy(out.data(), &state, sizeof(State));
+
+    auto cursor = out.data() + sizeof(State);
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+    {
+        if (state.storedPlanes & (1 << plane))
+        {
+            std::memcpy(cursor, mGfx[plane].data(), words * sizeof(uint64_t));
+            cursor += words * sizeof(uint64_t);
+        }
+    }
+
+    for (size_t i = 0; i < mWrittenPages.size(); i++)
+    {
+        for (auto bits = mWrittenPages[i]; bits != 0; bits &= bits - 1)
+        {
+            const auto page = i * 64 + __builtin_ctzll(bits);
+            std::memcpy(cursor, &mMemory[page * PAGE_SIZE], PAGE_SIZE);
+            cursor += PAGE_SIZE;
+        }
+    }
+}
+
+bool cee::Chip8::loadState(const std::vector<uint8_t> & state)
+{
+    return loadState(state.data(), state.size());
+}
+
+bool cee::Chip8::loadState(const uint8_t * data, size_t size)
+{
+    State state;
+    if (size < sizeof(State))
+    {
+        printf("Chip8 Error: Save state is too small\n");
+        return false;
+    }
+
+    std::memcpy(&state, data, sizeof(State));
+    if (std::memcmp(state.magic, STATE_MAGIC, sizeof(state.magic)) != 0 || state.version != STATE_VERSION
+        || (state.storedPlanes >> cee::GFX_PLANES) != 0)
+    {
+        printf("Chip8 Error: Unsupported save state\n");
+        return false;
+    }
+
+    if (state.imageHash != mImage->hash)
+    {
+        printf("Chip8 Error: Save state was taken with another program\n");
+        return false;
+    }
+
+    if (state.quirks != static_cast<uint8_t>(mOps->quirks))
+    {
+        printf("Chip8 Error: Save state was taken with other quirks\n");
+        return false;
+    }
+
+    // The timers only ever catch up with a rate the phase can count in,
+    // and a phase between ticks. The display only ever has what the
+    // profile can draw.
+    const auto rate = int64_t(state.cycleRate);
+    if (state.cycleRate > cee::MAX_CYCLE_RATE
+        || state.timerPhase <= -int64_t(TIMER_RATE)
+        || (rate > 0 && state.timerPhase > rate)
+        || state.hires > (mOps->superChip ? 1 : 0)
+        || (mOps->xoChip ? state.planes >> cee::GFX_PLANES != 0 : state.planes != 1))
+    {
+        printf("Chip8 Error: Unsupported save state\n");
+        return false;
+    }
+
+    // Only pages within memory can be stored, which quirks matching
+    // means is as much memory as there is here.
+    const size_t words = state.hires ? cee::GFX_HEIGHT * 2 : cee::LORES_HEIGHT;
+    const size_t limit = mMemory.size() / PAGE_SIZE;
+    size_t pages   = 0;
+    bool   outside = false;
+    for (size_t i = 0; i < MAX_PAGES / 64; i++)
+    {
+        pages   += __builtin_popcountll(state.pages[i]);
+        outside |= i * 64 >= limit && state.pages[i] != 0;
+    }
+
+    if (outside || size != sizeof(State)
+                + __builtin_popcount(state.storedPlanes) * words * sizeof(uint64_t)
+                + pages * PAGE_SIZE)
+    {
+        printf("Chip8 Error: Save state has the wrong size\n");
+        return false;
+    }
+
+    mStackPointer      = state.stackPointer;
+    mIndex             = state.index;
+    mCounter           = state.counter;
+    mDelayTimer        = state.delayTimer;
+    mSoundTimer        = state.soundTimer;
+    mKeys              = {state.keysPressed, state.lastKeyPressed};
+    mTimerPhase        = state.timerPhase;
+    mCycleRate         = state.cycleRate;
+    mRandState         = state.randState;
+    mHires             = state.hires != 0;
+    mPlanes            = state.planes;
+    mPitch             = state.pitch;
+    std::memcpy(mStack.data(), state.stack, sizeof(state.stack));
+    std::memcpy(mRegisters.data(), state.registers, sizeof(state.registers));
+    std::memcpy(mFlags.data(), state.flags, sizeof(state.flags));
+    std::memcpy(mPattern.data(), state.pattern, sizeof(state.pattern));
+
+    // Planes which weren't stored are blank. Rows which differ from
+    // what's on the display now need showing too.
+    auto source = data + sizeof(State);
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+    {
+        const bool stored = state.storedPlanes & (1 << plane);
+        auto & gfx = mGfx[plane];
+
+        for (size_t i = 0; i < gfx.size(); i++)
+        {
+            uint64_t word = 0;
+            if (stored && i < words)
+                std::memcpy(&word, source + i * sizeof(uint64_t), sizeof(uint64_t));
+
+            state.dirtyRows |= cee::GfxRows(gfx[i] != word) << (i % cee::GFX_HEIGHT);
+            gfx[i] = word;
+        }
+
+        if (stored)
+            source += words * sizeof(uint64_t);
+    }
+
+    mDirtyRows = state.dirtyRows;
+
+    // Pages written to by either side are brought back from the snapshot,
+    // or from the image when the snapshot didn't need them. Cached code
+    // only needs dropping where the memory actually differs.
+    for (size_t i = 0; i < mWrittenPages.size(); i++)
+    {
+        for (auto bits = mWrittenPages[i] | state.pages[i]; bits != 0; bits &= bits - 1)
+        {
+            const auto page = i * 64 + __builtin_ctzll(bits);
+            const auto to        = &mMemory[page * PAGE_SIZE];
+            const uint8_t * from = &mImage->memory[page * PAGE_SIZE];
+
+            if (state.pages[i] & (uint64_t(1) << (page & 63)))
+            {
+                from = source;
+                source += PAGE_SIZE;
+            }
+
+            if (std::memcmp(to, from, PAGE_SIZE) != 0)
+            {
+                std::memcpy(to, from, PAGE_SIZE);
+                invalidate(page * PAGE_SIZE, PAGE_SIZE);
+            }
+        }
+    }
+
+    std::memcpy(mWrittenPages.data(), state.pages, sizeof(state.pages));
+
+    // Snapshots don't keep which spans were written to, so they're told
+    // from the ones differing from the image instead.
+    mStaleSpans.fill(0);
+    for (size_t i = 0; i < mWrittenPages.size(); i++)
+    {
+        for (auto bits = mWrittenPages[i]; bits != 0; bits &= bits - 1)
+        {
+            const auto page = i * 64 + __builtin_ctzll(bits);
+            for (size_t offset = page * PAGE_SIZE; offset < (page + 1) * PAGE_SIZE; offset += size_t(1) << SPAN_SHIFT)
+            {
+                if (std::memcmp(&mMemory[offset], &mImage->memory[offset], size_t(1) << SPAN_SHIFT) != 0)
+                    markStale(offset, offset + (size_t(1) << SPAN_SHIFT));
+            }
+        }
+    }
+
+#ifdef CEE_PROFILE
+    mProfiler.enter(mStack.data(), mStackPointer, mMemory.data());
+#endif
+
+    return true;
 }
 
 void cee::Chip8::updateKeys(cee::Keys keys)
@@ -156,6 +1235,98 @@ bool cee::Chip8::isBeeping() const
     return mSoundTimer > 0;
 }
 
+cee::Quirks cee::Chip8::getQuirks() const
+{
+    return mOps->quirks;
+}
+
+size_t cee::Chip8::getMemorySize() const
+{
+    return mMemory.size();
+}
+
+cee::Idle cee::Chip8::getIdle() const
+{
+    // The instruction is decoded from memory rather than taken from the
+    // cache, which may not have got to it yet.
+    return getIdle(decode(mCounter));
+}
+
+cee::Idle cee::Chip8::getIdle(const Instruction & in) const
+{
+    const auto loop = getLoop(in);
+
+    if (loop == cee::Idle::Key && mKeys.keysPressed > 0)
+        return cee::Idle::None;
+
+    if (loop == cee::Idle::Timer && mDelayTimer == 0)
+        return cee::Idle::None;
+
+    return loop;
+}
+
+cee::Idle cee::Chip8::getLoop(const Instruction & in) const
+{
+    if (in.op == mOps->index[getSlot(0x1000)] && in.nnn == mCounter)
+        return cee::Idle::Halt;
+
+    if (mOps->superChip && in.op == mOps->index[getSlot(0x00FD)])
+        return cee::Idle::Halt;
+
+    // Unknown opcodes leave the program counter where it is.
+    if (in.op == mOps->unknown)
+        return cee::Idle::Halt;
+
+    if (in.op == mOps->index[getSlot(0xF00A)])
+        return cee::Idle::Key;
+
+    // The delay timer is polled with FX07, skipping out of the loop
+    // with 3X00 once it reads 0, and jumping back otherwise.
+    if (in.op == mOps->index[getSlot(0xF007)] && size_t(mCounter) + 5 < mMemory.size())
+    {
+        const auto test = decode(mCounter + 2);
+        const auto jump = decode(mCounter + 4);
+
+        if (test.op == mOps->index[getSlot(0x3000)] && test.x == in.x && test.nn == 0 &&
+            jump.op == mOps->index[getSlot(0x1000)] && jump.nnn == mCounter)
+            return cee::Idle::Timer;
+    }
+
+    return cee::Idle::None;
+}
+
+const std::array<uint8_t, 16> & cee::Chip8::getAudioPattern() const
+{
+    return mPattern;
+}
+
+uint8_t cee::Chip8::getPitch() const
+{
+    return mPitch;
+}
+
+uint64_t cee::Chip8::getDrawCount() const
+{
+    return mDrawCount;
+}
+
+uint64_t cee::Chip8::getSkipCount() const
+{
+    return mSkipCount;
+}
+
+#ifdef CEE_PROFILE
+void cee::Chip8::writeProfile(FILE * file, cee::ProfileFormat format) const
+{
+    mProfiler.write(file, format, mOps->names.data());
+}
+
+void cee::Chip8::clearProfile()
+{
+    mProfiler.clear();
+}
+#endif
+
 /*
   ___  ____   ____ ___  ____  _____ ____
  / _ \|  _ \ / ___/ _ \|  _ \| ____/ ___|
@@ -165,182 +1336,311 @@ bool cee::Chip8::isBeeping() const
 
 */
 
+// Reports an opcode that has no operation.
+void cee::Chip8::opUnknown(const Instruction &)
+{
+    // The program counter is left untouched, so the program is stuck
+    // on it, which is only reported the first time.
+    if (mReported)
+        return;
+
+    mReported = true;
+    const size_t mask = mMemory.size() - 1;
+    auto opcode = mMemory[mCounter & mask] << 8 | mMemory[(mCounter + 1) & mask];
+    printf("Chip8 Error: Unknown OpCode 0x%x\n", opcode);
+}
+
 // Calls RCA 1802 program at address NNN.
-void cee::Chip8::op0x0000()
+void cee::Chip8::op0x0000(const Instruction &)
 {
     // This is ignored since we don't have that microprocessor.
     mCounter += 2;
 }
 
+// Scrolls the display down by N rows.
+void cee::Chip8::op0x00C0(const Instruction & in)
+{
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+        if (mPlanes & (1 << plane))
+            cee::scrollGfxDown(mGfx[plane], in.n, mHires, mDirtyRows);
+
+    mCounter += 2;
+}
+
+// Scrolls the display up by N rows.
+void cee::Chip8::op0x00D0(const Instruction & in)
+{
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+        if (mPlanes & (1 << plane))
+            cee::scrollGfxUp(mGfx[plane], in.n, mHires, mDirtyRows);
+
+    mCounter += 2;
+}
+
 // Clears the screen.
-void cee::Chip8::op0x00E0()
+void cee::Chip8::op0x00E0(const Instruction &)
 {
-    mGfx.fill(0);
+    // Only the planes drawn to, which is just the first but on XO-CHIP.
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+        if (mPlanes & (1 << plane))
+            cee::clearGfx(mGfx[plane], mDirtyRows);
+
     mCounter += 2;
 }
 
 // Returns from a subroutine.
-void cee::Chip8::op0x00EE()
+void cee::Chip8::op0x00EE(const Instruction &)
 {
+    // Levels past the 16th wrap around, as memory no longer sits
+    // right after the stack to take them, just like in the batch.
     mStackPointer -= 1;
-    mCounter = mStack[mStackPointer];
+    mCounter = mStack[mStackPointer % mStack.size()];
+    mCounter += 2;
+}
+
+// Scrolls the display right by 4 pixels.
+void cee::Chip8::op0x00FB(const Instruction &)
+{
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+        if (mPlanes & (1 << plane))
+            cee::scrollGfxRight(mGfx[plane], 4, mHires, mDirtyRows);
+
+    mCounter += 2;
+}
+
+// Scrolls the display left by 4 pixels.
+void cee::Chip8::op0x00FC(const Instruction &)
+{
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
+        if (mPlanes & (1 << plane))
+            cee::scrollGfxLeft(mGfx[plane], 4, mHires, mDirtyRows);
+
+    mCounter += 2;
+}
+
+// Exits the interpreter, which stops on the spot.
+void cee::Chip8::op0x00FD(const Instruction &)
+{
+    // There's nothing to exit to, so the program counter stays put,
+    // the same as a jump to itself.
+}
+
+// Switches to low resolution.
+void cee::Chip8::op0x00FE(const Instruction &)
+{
+    setHires(false);
+    mCounter += 2;
+}
+
+// Switches to high resolution.
+void cee::Chip8::op0x00FF(const Instruction &)
+{
+    setHires(true);
     mCounter += 2;
 }
 
 // Jumps to address NNN.
-void cee::Chip8::op0x1000()
+void cee::Chip8::op0x1000(const Instruction & in)
 {
-    mCounter = mOpCode & 0x0FFF;
+    mCounter = in.nnn;
 }
 
 // Calls subroutine at NNN.
-void cee::Chip8::op0x2000()
+void cee::Chip8::op0x2000(const Instruction & in)
 {
-    mStack[mStackPointer] = mCounter;
+    mStack[mStackPointer % mStack.size()] = mCounter;
     mStackPointer += 1;
-    mCounter = mOpCode & 0x0FFF;
+    mCounter = in.nnn;
 }
 
 // Skips the next instruction if VX equals NN.
-void cee::Chip8::op0x3000()
+template <typename Policy>
+void cee::Chip8::op0x3000(const Instruction & in)
 {
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
-    uint8_t nn = mOpCode & 0x00FF;
-    mCounter += (vx == nn ? 4 : 2);
+    uint8_t vx = mRegisters[in.x];
+    uint8_t nn = in.nn;
+    mCounter += (vx == nn ? skip<Policy>() : 2);
 }
 
 // Skips the next instruction if VX doesn't equal NN.
-void cee::Chip8::op0x4000()
+template <typename Policy>
+void cee::Chip8::op0x4000(const Instruction & in)
 {
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
-    uint8_t nn = mOpCode & 0x00FF;
-    mCounter += (vx == nn ? 2 : 4);
+    uint8_t vx = mRegisters[in.x];
+    uint8_t nn = in.nn;
+    mCounter += (vx == nn ? 2 : skip<Policy>());
 }
 
 // Skips the next instruction if VX equals VY.
-void cee::Chip8::op0x5000()
+template <typename Policy>
+void cee::Chip8::op0x5000(const Instruction & in)
+{
+    uint8_t vx = mRegisters[in.x];
+    uint8_t vy = mRegisters[in.y];
+    mCounter += (vx == vy ? skip<Policy>() : 2);
+}
+
+// Stores VX to VY in memory starting at address I, either way round.
+// I is left alone.
+void cee::Chip8::op0x5002(const Instruction & in)
+{
+    const size_t count = (in.x < in.y ? in.y - in.x : in.x - in.y) + 1;
+    const int    step  = in.x < in.y ? 1 : -1;
+
+    for (size_t i = 0; i < count; i++)
+        mMemory[(mIndex + i) & (mMemory.size() - 1)] = mRegisters[in.x + int(i) * step];
+
+    memoryWritten(mIndex, count);
+    mCounter += 2;
+}
+
+// Fills VX to VY with values from memory starting at address I, either
+// way round. I is left alone.
+void cee::Chip8::op0x5003(const Instruction & in)
 {
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    mCounter += (vx == vy ? 4 : 2);
+    const size_t count = (in.x < in.y ? in.y - in.x : in.x - in.y) + 1;
+    const int    step  = in.x < in.y ? 1 : -1;
+
+    for (size_t i = 0; i < count; i++)
+        mRegisters[in.x + int(i) * step] = mMemory[(mIndex + i) & (mMemory.size() - 1)];
+
+    mCounter += 2;
 }
 
 // Sets VX to NN.
-void cee::Chip8::op0x6000()
+void cee::Chip8::op0x6000(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] = mOpCode & 0x00FF;
+    mRegisters[in.x] = in.nn;
     mCounter += 2;
 }
 
 // Adds NN to VX.
-void cee::Chip8::op0x7000()
+void cee::Chip8::op0x7000(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] += mOpCode & 0x00FF;
+    mRegisters[in.x] += in.nn;
     mCounter += 2;
 }
 
 // Sets VX to the value of VY.
-void cee::Chip8::op0x8000()
+void cee::Chip8::op0x8000(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] = mRegisters[(mOpCode & 0x00F0) >> 4];
+    mRegisters[in.x] = mRegisters[in.y];
     mCounter += 2;
 }
 
 // Sets VX to VX or VY.
-void cee::Chip8::op0x8001()
+template <typename Policy>
+void cee::Chip8::op0x8001(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] |= mRegisters[(mOpCode & 0x00F0) >> 4];
+    mRegisters[in.x] |= mRegisters[in.y];
+    if (Policy::resetVf) mRegisters[0xF] = 0;
     mCounter += 2;
 }
 
 // Sets VX to VX and VY.
-void cee::Chip8::op0x8002()
+template <typename Policy>
+void cee::Chip8::op0x8002(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] &= mRegisters[(mOpCode & 0x00F0) >> 4];
+    mRegisters[in.x] &= mRegisters[in.y];
+    if (Policy::resetVf) mRegisters[0xF] = 0;
     mCounter += 2;
 }
 
 // Sets VX to VX xor VY.
-void cee::Chip8::op0x8003()
+template <typename Policy>
+void cee::Chip8::op0x8003(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] ^= mRegisters[(mOpCode & 0x00F0) >> 4];
+    mRegisters[in.x] ^= mRegisters[in.y];
+    if (Policy::resetVf) mRegisters[0xF] = 0;
     mCounter += 2;
 }
 
 // Adds VY to VX. VF is set to 1 when carry, and to 0 when isn't.
-void cee::Chip8::op0x8004()
+void cee::Chip8::op0x8004(const Instruction & in)
 {
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
+    uint8_t vy = mRegisters[in.y];
+    uint8_t vx = mRegisters[in.x];
 
-    mRegisters[(mOpCode & 0x0F00) >> 8] = vx + vy;
+    mRegisters[in.x] = vx + vy;
     mRegisters[0xF] = (vy > (0xFF - vx)) ? 1 : 0;
     mCounter += 2;
 }
 
 // VY is subtracted from VX. VF is set to 0 when borrow, and 1 when isn't.
-void cee::Chip8::op0x8005()
+void cee::Chip8::op0x8005(const Instruction & in)
 {
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
+    uint8_t vy = mRegisters[in.y];
+    uint8_t vx = mRegisters[in.x];
 
-    mRegisters[(mOpCode & 0x0F00) >> 8] = vx - vy;
+    mRegisters[in.x] = vx - vy;
     mRegisters[0xF] = (vy > vx) ? 0 : 1;
     mCounter += 2;
 }
 
 // Shifts VX right by 1. VF is set value of the least sig bit of VX before shift.
-void cee::Chip8::op0x8006()
+// The original interpreter shifts VY into VX instead.
+template <typename Policy>
+void cee::Chip8::op0x8006(const Instruction & in)
 {
-    mRegisters[0xF] = mRegisters[(mOpCode & 0x0F00) >> 8] & 1;
-    mRegisters[(mOpCode & 0x0F00) >> 8] >>= 1;
+    const auto source = Policy::shiftVy ? in.y : in.x;
+
+    // VF is set first, and the source is read again in case it's VF.
+    mRegisters[0xF] = mRegisters[source] & 1;
+    mRegisters[in.x] = mRegisters[source] >> 1;
     mCounter += 2;
 }
 
 // Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when isn't.
-void cee::Chip8::op0x8007()
+void cee::Chip8::op0x8007(const Instruction & in)
 {
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
+    uint8_t vy = mRegisters[in.y];
+    uint8_t vx = mRegisters[in.x];
 
-    mRegisters[(mOpCode & 0x0F00) >> 8] = vy - vx;
+    mRegisters[in.x] = vy - vx;
     mRegisters[0xF] = (vx > vy) ? 0 : 1;
     mCounter += 2;
 }
 
 // Shifts VX left by 1. VF is set value of the most sig bit of VX before shift.
-void cee::Chip8::op0x800E()
+// The original interpreter shifts VY into VX instead.
+template <typename Policy>
+void cee::Chip8::op0x800E(const Instruction & in)
 {
-    mRegisters[0xF] = mRegisters[(mOpCode & 0x0F00) >> 8] >> 7;
-    mRegisters[(mOpCode & 0x0F00) >> 8] <<= 1;
+    const auto source = Policy::shiftVy ? in.y : in.x;
+
+    mRegisters[0xF] = mRegisters[source] >> 7;
+    mRegisters[in.x] = mRegisters[source] << 1;
     mCounter += 2;
 }
 
 // Skips the next instruction if VX doesn't equal VY.
-void cee::Chip8::op0x9000()
+template <typename Policy>
+void cee::Chip8::op0x9000(const Instruction & in)
 {
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
-    mCounter += (vx != vy ? 4 : 2);
+    uint8_t vy = mRegisters[in.y];
+    uint8_t vx = mRegisters[in.x];
+    mCounter += (vx != vy ? skip<Policy>() : 2);
 }
 
 // Sets I to the address NNN.
-void cee::Chip8::op0xA000()
+void cee::Chip8::op0xA000(const Instruction & in)
 {
-    mIndex = mOpCode & 0x0FFF;
+    mIndex = in.nnn;
     mCounter += 2;
 }
 
 // Jumps to the address NNN plus V0.
-void cee::Chip8::op0xB000()
+// CHIP-48 got this wrong, jumping to XNN plus VX.
+template <typename Policy>
+void cee::Chip8::op0xB000(const Instruction & in)
 {
-    mCounter = (mOpCode & 0x0FFF) + mRegisters[0x0];
+    mCounter = in.nnn + mRegisters[Policy::jumpVx ? in.x : 0x0];
 }
 
 // Sets VX to a random number, masked by NN.
-void cee::Chip8::op0xC000()
+void cee::Chip8::op0xC000(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] = mDist(mRandGen) & (mOpCode & 0x00FF);
+    mRegisters[in.x] = random() & in.nn;
     mCounter += 2;
 }
 
@@ -351,75 +1651,123 @@ void cee::Chip8::op0xC000()
 // I value doesn’t change after the execution of this instruction.
 // As described above, VF is set to 1 if any screen pixels are flipped from set
 // to unset when the sprite is drawn, and to 0 if that doesn’t happen.
-void cee::Chip8::op0xD000()
+template <typename Policy>
+void cee::Chip8::op0xD000(const Instruction & in)
 {
-    uint8_t nr = mOpCode & 0x000F; // Number of rows.
-    uint8_t vy = mRegisters[(mOpCode & 0x00F0) >> 4];
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
+    // SUPER-CHIP draws sprites of 16 x 16 pixels when asked for no rows,
+    // which take two bytes a row.
+    const bool   big    = Policy::superChip && in.n == 0;
+    const size_t nr     = big ? 16 : in.n; // Number of rows.
+    const size_t stride = big ? 2 : 1;     // Bytes per row.
+
+    // Only SUPER-CHIP and XO-CHIP have a high resolution to check for.
+    const bool   hires  = Policy::superChip && mHires;
+    const size_t width  = hires ? cee::GFX_WIDTH : cee::LORES_WIDTH;
+    const size_t height = hires ? cee::GFX_HEIGHT : cee::LORES_HEIGHT;
+    const size_t mask   = mMemory.size() - 1;
+
+    // The sprite starts on the display wherever VX and VY point, and
+    // depending on the profile, either wraps around or is clipped at
+    // the edges from there.
+    const size_t vx = mRegisters[in.x] % width;
+    const size_t vy = mRegisters[in.y] % height;
 
     // Start with VF being 0, presuming that no screen pixels were flipped.
-    // The for-loop below will determine if that's not the case though.
+    // Each row is XORed onto the display at once, and any pixel set on
+    // both of them means a collision, which is registered in VF.
     mRegisters[0xF] = 0;
+    mDrawCount++;
 
-    for (uint8_t y = 0; y < nr; y++)
+    // XO-CHIP draws a sprite on every plane selected, one after the
+    // other in memory. The others only ever draw on the first plane.
+    const size_t planes = Policy::xoChip ? mPlanes : 1;
+    size_t address = mIndex;
+
+    for (size_t plane = 0; plane < cee::GFX_PLANES; plane++)
     {
-        uint8_t pixels = mMemory[mIndex + y];
+        if (! (planes & (1 << plane)))
+            continue;
 
-        for (uint8_t x = 0; x < 8; ++x)
+        for (size_t y = 0; y < nr; y++)
         {
-            // Check if the pixel on the display is set to 1.
-            // If it is set, we need to register the collision
-            // by setting the VF register.
-            if ((pixels & (0x80 >> x)) != 0)
-            {
-                // Y represents the row so multiplying the row
-                // by 64 (which is the max width of our pixel resolution)
-                // gets us the current row.
-                auto location = (vx + x + ((vy + y) * 64));
+            if (! Policy::wrapSprites && vy + y >= height)
+                break;
 
-                if (mGfx[location] == 1)
-                {
-                    mRegisters[0xF] = 1;
-                }
+            // Sprites read past the end of memory wrap around too.
+            uint16_t pixels = mMemory[(address + y * stride) & mask] << 8;
+            if (big)
+                pixels |= mMemory[(address + y * 2 + 1) & mask];
 
-                mGfx[location] ^= 1;
+            const size_t row = (vy + y) % height;
+            if (cee::drawSpriteRow(mGfx[plane], vx, row, pixels, hires, Policy::wrapSprites, mDirtyRows))
+            {
+                mRegisters[0xF] = 1;
             }
         }
+
+        address += nr * stride;
     }
 
     mCounter += 2;
 }
 
 // Skips the next instruction if the key stored in VX is pressed.
-void cee::Chip8::op0xE09E()
+template <typename Policy>
+void cee::Chip8::op0xE09E(const Instruction & in)
 {
-    auto x = (mOpCode & 0x0F00) >> 8;
-    mCounter += (mKeys.keysPressed & (1 << x)) ? 4 : 2;
+    auto x = in.x;
+    mCounter += (mKeys.keysPressed & (1 << x)) ? skip<Policy>() : 2;
 }
 
 // Skips the next instruction if the key stored in VX isn't pressed.
-void cee::Chip8::op0xE0A1()
+template <typename Policy>
+void cee::Chip8::op0xE0A1(const Instruction & in)
 {
-    auto x = (mOpCode & 0x0F00) >> 8;
-    mCounter += (mKeys.keysPressed & (1 << x)) ? 2 : 4;
+    auto x = in.x;
+    mCounter += (mKeys.keysPressed & (1 << x)) ? 2 : skip<Policy>();
+}
+
+// Sets I to the 16-bit address following the instruction, which makes
+// it twice as long as the others.
+void cee::Chip8::op0xF000(const Instruction &)
+{
+    const size_t mask = mMemory.size() - 1;
+    mIndex = mMemory[(mCounter + 2) & mask] << 8 | mMemory[(mCounter + 3) & mask];
+    mCounter += 4;
+}
+
+// Selects the planes drawn to, as a bit each in X.
+void cee::Chip8::op0xF001(const Instruction & in)
+{
+    mPlanes = in.x & ((1 << cee::GFX_PLANES) - 1);
+    mCounter += 2;
+}
+
+// Loads the audio pattern from the 16 bytes at address I.
+void cee::Chip8::op0xF002(const Instruction &)
+{
+    for (size_t i = 0; i < mPattern.size(); i++)
+        mPattern[i] = mMemory[(mIndex + i) & (mMemory.size() - 1)];
+
+    mCounter += 2;
 }
 
 // Sets VX to the value of the delay timer.
-void cee::Chip8::op0xF007()
+void cee::Chip8::op0xF007(const Instruction & in)
 {
-    mRegisters[(mOpCode & 0x0F00) >> 8] = mDelayTimer;
+    mRegisters[in.x] = mDelayTimer;
     mCounter += 2;
 }
 
 // A key press is awaited, and then stored in VX.
-void cee::Chip8::op0xF00A()
+void cee::Chip8::op0xF00A(const Instruction & in)
 {
     // If any of the bits are on, then an integer representation
     // of keysPressed should more than 0, which means that there
     // must be key being pressed.
     if (mKeys.keysPressed > 0)
     {
-        mRegisters[(mOpCode & 0x0F00) >> 8] = mKeys.lastKeyPressed;
+        mRegisters[in.x] = mKeys.lastKeyPressed;
         mCounter += 2;
     }
 
@@ -427,33 +1775,40 @@ void cee::Chip8::op0xF00A()
 }
 
 // Sets the delay timer to VX.
-void cee::Chip8::op0xF015()
+void cee::Chip8::op0xF015(const Instruction & in)
 {
-    mDelayTimer = mRegisters[(mOpCode & 0x0F00) >> 8];
+    mDelayTimer = mRegisters[in.x];
     mCounter += 2;
 }
 
 // Sets the sound timer to VX.
-void cee::Chip8::op0xF018()
+void cee::Chip8::op0xF018(const Instruction & in)
 {
-    mSoundTimer = mRegisters[(mOpCode & 0x0F00) >> 8];
+    mSoundTimer = mRegisters[in.x];
     mCounter += 2;
 }
 
 // Adds VX to I.
-void cee::Chip8::op0xF01E()
+void cee::Chip8::op0xF01E(const Instruction & in)
 {
-    uint8_t vx = mRegisters[(mOpCode & 0x0F00) >> 8];
+    uint8_t vx = mRegisters[in.x];
     mRegisters[0xF] = (mIndex + vx > 0xFFF) ? 1 : 0;
-    mIndex += mRegisters[(mOpCode & 0x0F00) >> 8];
+    mIndex += mRegisters[in.x];
     mCounter += 2;
 }
 
 // Sets I to the location of the sprite for the character in VX.
 // Characters 0-F (in hexadecimal) are represented by a 4x5 font.
-void cee::Chip8::op0xF029()
+void cee::Chip8::op0xF029(const Instruction & in)
+{
+    mIndex = mRegisters[in.x] * 5;
+    mCounter += 2;
+}
+
+// Same, for the 8x10 font of SUPER-CHIP.
+void cee::Chip8::op0xF030(const Instruction & in)
 {
-    mIndex = mRegisters[((mOpCode & 0x0F00) >> 8)] * 5;
+    mIndex = BIG_FONT_OFFSET + (mRegisters[in.x] & 0xF) * 10;
     mCounter += 2;
 }
 
@@ -463,39 +1818,200 @@ void cee::Chip8::op0xF029()
 // (In other words, take the decimal representation of VX,
 // place the hundreds digit in memory at location in I, the tens digit at location I+1,
 // and the ones digit at location I+2.).
-void cee::Chip8::op0xF033()
+void cee::Chip8::op0xF033(const Instruction & in)
 {
-    mMemory[mIndex] = mRegisters[(mOpCode & 0x0F00) >> 8] / 100;
-    mMemory[mIndex + 1] = (mRegisters[(mOpCode & 0x0F00) >> 8] / 10) % 10;
-    mMemory[mIndex + 2] = (mRegisters[(mOpCode & 0x0F00) >> 8] % 100) % 10;
+    const size_t mask = mMemory.size() - 1;
+    mMemory[mIndex & mask] = mRegisters[in.x] / 100;
+    mMemory[(mIndex + 1) & mask] = (mRegisters[in.x] / 10) % 10;
+    mMemory[(mIndex + 2) & mask] = (mRegisters[in.x] % 100) % 10;
+    memoryWritten(mIndex, 3);
+    mCounter += 2;
+}
+
+// Sets the pitch of the audio pattern to VX.
+void cee::Chip8::op0xF03A(const Instruction & in)
+{
+    mPitch = mRegisters[in.x];
     mCounter += 2;
 }
 
 // Stores V0 to VX in memory starting at address I.
-void cee::Chip8::op0xF055()
+template <typename Policy>
+void cee::Chip8::op0xF055(const Instruction & in)
 {
-    auto x = (mOpCode & 0x0F00) >> 8;
+    auto x = in.x;
     for (size_t i = 0; i <= x; i++)
-        mMemory[mIndex + i] = mRegisters[i];
+        mMemory[(mIndex + i) & (mMemory.size() - 1)] = mRegisters[i];
+
+    memoryWritten(mIndex, x + 1);
 
     // On the original interpreter, when the operation is done, I = I + X + 1.
-    mIndex += x + 1;
+    // CHIP-48 stops one short of that, and SUPER-CHIP leaves I alone.
+    if (Policy::incrementIndex)
+        mIndex += Policy::indexOneShort ? x : x + 1;
     mCounter += 2;
 }
 
 // Fills V0 to VX with values from memory starting at address I.
-void cee::Chip8::op0xF065()
+template <typename Policy>
+void cee::Chip8::op0xF065(const Instruction & in)
 {
-    auto x = (mOpCode & 0x0F00) >> 8;
+    auto x = in.x;
     for (size_t i = 0; i <= x; i++)
-        mRegisters[i] = mMemory[mIndex + i];
+        mRegisters[i] = mMemory[(mIndex + i) & (mMemory.size() - 1)];
 
-    // On the original interpreter, when the operation is done, I = I + X + 1.
-    mIndex += x + 1;
+    // Moves I along, the same as when storing them.
+    if (Policy::incrementIndex)
+        mIndex += Policy::indexOneShort ? x : x + 1;
+    mCounter += 2;
+}
+
+// Stores V0 to VX in the RPL user flags.
+void cee::Chip8::op0xF075(const Instruction & in)
+{
+    std::copy(mRegisters.begin(), mRegisters.begin() + in.x + 1, mFlags.begin());
+    mCounter += 2;
+}
+
+// Fills V0 to VX from the RPL user flags.
+void cee::Chip8::op0xF085(const Instruction & in)
+{
+    std::copy(mFlags.begin(), mFlags.begin() + in.x + 1, mRegisters.begin());
     mCounter += 2;
 }
 
-const uint8_t * cee::Chip8::getGfx() const
+// Fused operations call the handlers of the instructions they run one
+// after the other, which the compiler inlines into a single body. They
+// find those following the first, two entries apart. None of the instructions
+// after the first touch the timers, so the cycles they take are counted
+// straight off the phase, leaving the ticks due to the end.
+
+// Sets VX and VY to NN, then draws a sprite at them.
+template <typename Policy>
+void cee::Chip8::fuseLoadLoadDraw(const Instruction & in)
+{
+    const auto block = &in;
+    op0x6000(block[0]);
+    op0x6000(block[2]);
+    op0xD000<Policy>(block[4]);
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE * 2);
+}
+
+// Sets VX and VY to NN.
+void cee::Chip8::fuseLoadLoad(const Instruction & in)
+{
+    const auto block = &in;
+    op0x6000(block[0]);
+    op0x6000(block[2]);
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE);
+}
+
+// Sets I to NNN, then draws a sprite from it.
+template <typename Policy>
+void cee::Chip8::fuseIndexDraw(const Instruction & in)
+{
+    const auto block = &in;
+    op0xA000(block[0]);
+    op0xD000<Policy>(block[2]);
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE);
+}
+
+// Adds NN to VX, then skips if VX equals NN.
+template <typename Policy>
+void cee::Chip8::fuseAddSkip(const Instruction & in)
+{
+    const auto block = &in;
+    op0x7000(block[0]);
+    op0x3000<Policy>(block[2]);
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE);
+}
+
+// Reads the delay timer into VX, then skips if VX equals NN.
+template <typename Policy>
+void cee::Chip8::fuseDelaySkip(const Instruction & in)
+{
+    const auto block = &in;
+    op0xF007(block[0]);
+    op0x3000<Policy>(block[2]);
+    mTimerPhase -= static_cast<int32_t>(TIMER_RATE);
+}
+
+// Bytes a skip moves the program counter by. XO-CHIP skips over the
+// whole of F000 NNNN, which is twice as long as other instructions.
+template <typename Policy>
+inline uint16_t cee::Chip8::skip() const
+{
+    if (Policy::xoChip)
+    {
+        const size_t mask = mMemory.size() - 1;
+        if (mMemory[(mCounter + 2) & mask] == 0xF0 && mMemory[(mCounter + 3) & mask] == 0x00)
+            return 6;
+    }
+
+    return 4;
+}
+
+// Switches resolution, which clears the display.
+void cee::Chip8::setHires(bool hires)
+{
+    for (auto & plane : mGfx)
+        plane.fill(0);
+
+    mHires     = hires;
+    mDirtyRows = ~cee::GfxRows(0);
+}
+
+const cee::Gfx & cee::Chip8::getGfx() const
+{
+    return mGfx[0];
+}
+
+const cee::GfxPlanes & cee::Chip8::getPlanes() const
+{
+    return mGfx;
+}
+
+bool cee::Chip8::isHires() const
+{
+    return mHires;
+}
+
+cee::GfxRows cee::Chip8::getDirtyRows() const
+{
+    return mDirtyRows;
+}
+
+void cee::Chip8::clearDirtyRows()
+{
+    mDirtyRows = 0;
+}
+
+const uint8_t * cee::Chip8::getRegisters() const
+{
+    return mRegisters.data();
+}
+
+uint16_t cee::Chip8::getIndex() const
+{
+    return mIndex;
+}
+
+uint16_t cee::Chip8::getCounter() const
+{
+    return mCounter;
+}
+
+uint16_t cee::Chip8::getStackPointer() const
+{
+    return mStackPointer;
+}
+
+uint8_t cee::Chip8::getDelayTimer() const
+{
+    return mDelayTimer;
+}
+
+uint8_t cee::Chip8::getSoundTimer() const
 {
-    return mGfx.data();
+    return mSoundTimer;
 }
@@ -5,71 +5,336 @@
 
 #include <cstdint>
 
-#include <functional>
+#include <algorithm>
 #include <vector>
 #include <array>
-#include <random>
-#include <map>
+#include <memory>
 
+#include "gfx.hpp"
 #include "keys.hpp"
+#include "quirks.hpp"
+
+#ifdef CEE_PROFILE
+#include "profiler.hpp"
+#endif
 
 namespace cee
 {
+    class Jit;
+    class Aot;
+    class Translator;
+    class FlowGraph;
+
+    static constexpr uint32_t TIMER_RATE         = 60;  // Ticks per second of the delay and sound timers
+    static constexpr uint32_t DEFAULT_CYCLE_RATE = 600; // Instructions per second, unless set otherwise
+    static constexpr uint32_t MAX_CYCLE_RATE     = INT32_MAX; // Most instructions per second, as the timer phase counts in 32 bits
+    static constexpr size_t   MAX_MEMORY_SIZE    = 65536; // Bytes of memory of XO-CHIP, the others having 4K
+    static constexpr size_t   MAX_STATE_SIZE     = 67848; // Bytes of the largest snapshot saveState makes
+
+    // Ways of executing a program, picked when creating the emulator.
+    enum class Backend
+    {
+        Interpreter, // Decoded instructions are dispatched one by one
+        Jit,         // Blocks are translated to native code when supported
+        Aot          // Blocks translated ahead of time by cee-aot run natively, where linked in
+    };
+
+    // What a program is waiting on, when it's stuck in a loop which
+    // changes nothing but the timers until then. Cycles spent in one
+    // are skipped over rather than run, and frontends can sleep through
+    // them.
+    enum class Idle
+    {
+        None,  // Running, as far as can be told
+        Key,   // Waits for a key press with FX0A
+        Timer, // Polls the delay timer until it runs out, in getDelayTimer() ticks
+        Halt   // Jumps to itself, exited or reached an unknown opcode, so only the timers ever change
+    };
+
+    // Starting state of the xorshift generators for a seed. Every bit of
+    // the seed is mixed in (a splitmix32 step, which maps seeds one to
+    // one), and the one seed mixed to zero, where xorshift gets stuck,
+    // is moved off it.
+    inline uint32_t mixSeed(uint32_t seed)
+    {
+        seed += 0x9E3779B9u;
+        seed  = (seed ^ (seed >> 16)) * 0x85EBCA6Bu;
+        seed  = (seed ^ (seed >> 13)) * 0xC2B2AE35u;
+        seed ^= seed >> 16;
+        return seed != 0 ? seed : 0x9E3779B9u;
+    }
+
     class Chip8
     {
+        friend class Jit;
+        friend class Aot;
+        friend class Translator;
+        friend class FlowGraph;
+        friend class Chip8Pool;
     public:
-        explicit Chip8();
+        explicit Chip8(cee::Backend backend = cee::Backend::Interpreter);
+        ~Chip8();
+
+        Chip8(Chip8 &&);
+        Chip8 & operator=(Chip8 &&);
 
         void reset();                                    // Reset emulation state to default settings
-        void loadProgram(std::vector<uint8_t> program);  // Load program into emulator's memory
+        void loadProgram(const std::vector<uint8_t> & program); // Load program into emulator's memory
+        void loadProgram(const uint8_t * program, size_t size); // Same, from any buffer
+        void loadProgram(const Chip8 & source);          // Loads the program another emulator loaded, sharing what never changes of it (while neither runs)
         void updateKeys(cee::Keys keys);                 // Updates key states
         void updateCycle();                              // Emulates one cycle
+        void updateCycles(size_t count);                 // Emulates a number of cycles
+        void updateTimers();                             // Counts down the timers, as a 60 Hz tick does
+        bool setCycleRate(uint32_t rate);                // Instructions per second, pacing the timers (0 leaves them to updateTimers), false above MAX_CYCLE_RATE
+        void setSeed(uint32_t seed);                     // Seeds the random generator, now and on every reset
+        void setQuirks(cee::Quirks quirks);              // Behaves like the interpreter of the profile from now on, starting over when its extensions differ
 
-        const uint8_t * getGfx() const;                  // Chip8 Graphics Representation.
+        std::vector<uint8_t> saveState() const;          // Snapshot of the emulation state
+        void saveState(std::vector<uint8_t> & state) const; // Same, reusing the buffer given
+        bool loadState(const std::vector<uint8_t> & state); // Restores a snapshot of the same program
+        bool loadState(const uint8_t * state, size_t size);
+
+        const cee::Gfx & getGfx() const;                 // Chip8 Graphics Representation, its first plane.
+        const cee::GfxPlanes & getPlanes() const;        // Every plane of the display, for XO-CHIP's colours.
+        bool            isHires() const;                 // Whether the display is in high resolution.
+        cee::GfxRows     getDirtyRows() const;           // Rows of the display changed since the last clearDirtyRows.
+        void             clearDirtyRows();               // Marks the display as seen.
+        const uint8_t * getRegisters() const;            // General purpose registers V0 - VF.
+        uint16_t        getIndex() const;                // Index register.
+        uint16_t        getCounter() const;              // Program counter.
+        uint16_t        getStackPointer() const;         // Current stack level.
+        uint8_t         getDelayTimer() const;           // Delay timer.
+        uint8_t         getSoundTimer() const;           // Sound timer.
         bool            isBeeping() const;               // Check if the emulator is beeping.
+        const std::array<uint8_t, 16> & getAudioPattern() const; // XO-CHIP's 128 samples of a bit, played in a loop while beeping.
+        uint8_t         getPitch() const;                // XO-CHIP's playback rate of the pattern, 64 being 4000 Hz.
+        cee::Quirks     getQuirks() const;               // Profile of the interpreter it behaves like.
+        size_t          getMemorySize() const;           // Bytes of memory, which programs fit in from PROG_OFFSET on.
+        cee::Idle       getIdle() const;                 // What the program is idling on at the program counter.
+#ifdef CEE_PROFILE
+        void            writeProfile(FILE * file, cee::ProfileFormat format) const; // Reports where the time went since the last clearProfile.
+        void            clearProfile();                  // Starts profiling afresh.
+#endif
+        uint64_t        getDrawCount() const;            // Sprites drawn since reset.
+        uint64_t        getSkipCount() const;            // Cycles of idle loops skipped over rather than run, since reset.
     private:
-        using Op   = std::function<void()>;
-        using Dist = std::uniform_int_distribution<uint8_t>;
+        // Instruction with its operands already extracted from the opcode.
+        struct Instruction
+        {
+            uint8_t  op;     // Index of the operation handling it
+            uint8_t  length; // Number of instructions cached as a block from here
+            uint8_t  x;      // Register VX
+            uint8_t  y;      // Register VY
+            uint8_t  n;      // 4-bit constant N
+            uint8_t  nn;     // 8-bit constant NN
+            uint16_t nnn;    // Address NNN
+        };
+
+        using Op = void (Chip8::*)(const Instruction &);
+
+        // Blocks decoded from memory, laid out by address.
+        struct Blocks
+        {
+            std::vector<Instruction> cache; // Decoded instructions, the first of a block holding its length
+            std::vector<uint8_t>     fused; // Operation running the instruction at an address, fused with the next ones if they're a common sequence
+        };
+
+        // Memory of an emulator, which is either its own or lent by a pool
+        // keeping the memory of all of its emulators together.
+        class Memory
+        {
+        public:
+            explicit Memory(size_t size) : mOwned(size, 0), mData(mOwned.data()), mSize(size) {}
+
+            void assign(size_t size)               // Owns a cleared memory of a new size
+            {
+                mOwned.assign(size, 0);
+                mData = mOwned.data();
+                mSize = size;
+            }
+
+            void lend(uint8_t * data)              // Moves over to memory of the same size lent by a pool
+            {
+                std::copy(begin(), end(), data);
+                mOwned = std::vector<uint8_t>();
+                mData  = data;
+            }
+
+            size_t          size() const                    { return mSize; }
+            uint8_t *       data()                          { return mData; }
+            const uint8_t * data() const                    { return mData; }
+            uint8_t *       begin()                         { return mData; }
+            uint8_t *       end()                           { return mData + mSize; }
+            const uint8_t * begin() const                   { return mData; }
+            const uint8_t * end() const                     { return mData + mSize; }
+            uint8_t &       operator[](size_t index)        { return mData[index]; }
+            const uint8_t & operator[](size_t index) const  { return mData[index]; }
+        private:
+            std::vector<uint8_t> mOwned; // Memory of its own, empty when lent
+            uint8_t *            mData;  // Memory in use
+            size_t               mSize;  // Bytes of memory
+        };
+
+        // Sequences of instructions run by a single operation, in place
+        // of the first of them, when the block they're in runs all of them.
+        enum Fusion
+        {
+            FUSE_LOAD_LOAD_DRAW, // 6XNN, 6YNN, DXYN
+            FUSE_LOAD_LOAD,      // 6XNN, 6YNN
+            FUSE_INDEX_DRAW,     // ANNN, DXYN
+            FUSE_ADD_SKIP,       // 7XNN, 3XNN
+            FUSE_DELAY_SKIP,     // FX07, 3XNN
+            FUSIONS
+        };
+
+        // Decoding tables shared by all emulators of a quirks profile.
+        // Operations are added in the same order for every profile, so
+        // that they share indices and only the handlers differ.
+        struct Ops
+        {
+            std::array<uint8_t, 4096> index;    // Operation by opcode's highest nibble and lowest byte
+            std::array<Op, 64>        handlers; // Operation handlers
+            std::array<bool, 64>      branches; // Whether an operation ends a block
+            std::array<bool, 64>      idles;    // Whether an operation can start an idle loop
+            std::array<uint8_t, 64>   sizes;    // Instructions an operation runs, more than one if fused
+            std::array<uint8_t, FUSIONS> fused; // Operations running fused sequences, by Fusion
+            std::array<const char *, 64> names; // Names of the operation handlers
+            uint8_t                   size;     // Number of operations
+            uint8_t                   unknown;  // Operation of opcodes that have none
+            cee::Quirks               quirks;   // Profile the handlers are specialised on
+            bool                      resetVf;  // Quirks translated code needs to follow too
+            bool                      shiftVy;
+            bool                      jumpVx;
+            bool                      superChip;
+            bool                      xoChip;
+        };
+
+        // Memory as it was right after loading a program, along with every
+        // block decoded from it. Emulators that loaded the same program
+        // share it, and it never changes once its blocks are decoded.
+        struct Image
+        {
+            Image(const uint8_t * memory, size_t size, const Ops * ops);
+
+            std::vector<uint8_t> memory;  // Memory image
+            uint64_t             hash;    // Hash of the memory image, to match snapshots with
+            const Ops *          ops;     // Decoding tables of the profile it was loaded with
+            Blocks               blocks;  // Blocks starting at every address, decoded on first use
+            std::vector<uint8_t> reaches; // Spans of memory past their own the blocks starting in a span go on for, once decoded
+            bool                 decoded; // Whether the blocks are decoded yet
+        };
 
         uint16_t                  mIndex;        // Index Register
         uint16_t                  mCounter;      // Program Counter (PC)
-        uint16_t                  mOpCode;       // Current OpCode
         uint16_t                  mStackPointer; // Current stack level
         uint8_t                   mDelayTimer;   // Counts down to 0
         uint8_t                   mSoundTimer;   // Counts down to 0, buzzes when 0
+        int32_t                   mTimerPhase;   // Counts down by TIMER_RATE a cycle, ticks the timers at 0
+        uint32_t                  mCycleRate;    // Instructions per second
         std::array<uint16_t, 16>  mStack;        // 16 levels of stack
-        std::array<uint8_t, 4096> mMemory;       // 4K available space
+        Memory                    mMemory;       // 4K available space, or 64K for XO-CHIP
+        std::shared_ptr<Image>    mImage;        // Memory as it was right after loading the program, and the blocks in it
+        std::array<uint64_t, 16>  mWrittenPages; // Memory pages written to since loading the program
+        std::array<uint64_t, 8>   mStaleSpans;   // Spans of 8 bytes blocks of the image no longer run from, memory they might span being written to
         std::array<uint8_t, 16>   mRegisters;    // General Purpose Registers
-        std::array<uint8_t, 2048> mGfx;          // 64 x 32 Pixel Resolution
-        std::map<uint16_t, Op>    mOps;          // Mapping of operations (Ops)
-        std::mt19937              mRandGen;      // Pseudo-Random Number Generator
+        std::array<uint8_t, 16>   mFlags;        // SUPER-CHIP's RPL user flags, kept by FX75 and FX85
+        cee::GfxPlanes            mGfx;          // 64 x 32 or 128 x 64 Pixel Resolution, a bit per pixel in each plane
+        bool                      mHires;        // Whether the display is in 128 x 64
+        uint8_t                   mPlanes;       // Planes drawn to, as a bit each
+        cee::GfxRows              mDirtyRows;    // Rows of the display changed since last seen
+        std::array<uint8_t, 16>   mPattern;      // Audio pattern, a bit per sample
+        uint8_t                   mPitch;        // Playback rate of the audio pattern
+        uint64_t                  mDrawCount;    // Sprites drawn since reset
+        uint64_t                  mSkipCount;    // Cycles of idle loops skipped since reset
+        bool                      mReported;     // Whether an unknown opcode was reported since reset
+        const Ops *               mOps;          // Decoding tables of operations (Ops)
+        std::unique_ptr<Blocks>   mCache;        // Blocks decoded from memory no longer matching the image, or to translate
+        uint64_t                  mCodePages;    // Memory pages holding blocks in mCache
+        std::unique_ptr<Jit>      mJit;          // Translated blocks, if enabled
+        std::unique_ptr<Aot>      mAot;          // Blocks translated ahead of time, if enabled
+        uint32_t                  mRandState;    // Pseudo-Random Number Generator (xorshift)
+        uint32_t                  mSeed;         // Seed given to the generator on reset
+        bool                      mSeeded;       // Whether mSeed is used, rather than a random one
         cee::Keys                 mKeys;         // Current key states
-        Dist                      mDist;         // Random Distribution between 0 - 255
-
-        // Operations based on opcode
-        void op0x0000(); // Calls RCA 1802 program at address NNN.
-        void op0x00E0(); // Clears the screen.
-        void op0x00EE(); // Returns from a subroutine.
-        void op0x1000(); // Jumps to address NNN.
-        void op0x2000(); // Calls subroutine at NNN.
-        void op0x3000(); // Skips the next instruction if VX equals NN.
-        void op0x4000(); // Skips the next instruction if VX doesn't equal NN.
-        void op0x5000(); // Skips the next instruction if VX equals VY.
-        void op0x6000(); // Sets VX to NN.
-        void op0x7000(); // Adds NN to VX.
-        void op0x8000(); // Sets VX to the value of VY.
-        void op0x8001(); // Sets VX to VX or VY.
-        void op0x8002(); // Sets VX to VX and VY.
-        void op0x8003(); // Sets VX to VX xor VY.
-        void op0x8004(); // Adds VY to VX. VF is set to 1 when carry, and to 0 when isn't.
-        void op0x8005(); // VY is subtracted from VX. VF is set to 0 when borrow, and 1 when isn't.
-        void op0x8006(); // Shifts VX right by 1. VF is set value of the least sig bit of VX before shift.
-        void op0x8007(); // Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when isn't.
-        void op0x800E(); // Shifts VX left by 1. VF is set value of the most sig bit of VX before shift.
-        void op0x9000(); // Skips the next instruction if VX doesn't equal VY.
-        void op0xA000(); // Sets I to the address NNN.
-        void op0xB000(); // Jumps to the address NNN plus V0.
-        void op0xC000(); // Sets VX to a random number, masked by NN.
+#ifdef CEE_PROFILE
+        cee::Profiler             mProfiler;     // Time spent by operation, address and call chain
+#endif
+
+        template <typename Policy>
+        static const Ops & getOps();                       // Builds the decoding tables of a profile once
+
+        static Instruction decode(const Ops & ops, const uint8_t * memory, size_t size, uint16_t address); // Decodes the opcode at address of any memory
+        Instruction decode(uint16_t address) const;        // Decodes the opcode at address
+        void        execute(const Instruction & in);       // Executes a decoded instruction
+        void        advanceTimers(uint32_t cycles);        // Ticks the timers due after a number of cycles
+        void        catchUpTimers();                       // Ticks the timers until the phase is positive again
+        void        skipCycles(size_t cycles);             // Lets cycles go by without running anything
+        cee::Idle   getLoop(const Instruction & in) const; // Loop the program might idle in, given the instruction at the program counter
+        cee::Idle   getIdle(const Instruction & in) const; // Same, if it idles in it right now
+        size_t      skipIdle(const Instruction & in, size_t count); // Skips up to count cycles of an idle loop, returns those skipped
+        uint8_t     random();                              // Next pseudo-random number between 0 - 255
+        void        restart();                             // Resets everything but the image
+        void        updateImage();                         // Makes memory as it is now the image
+        void        shareImage(const Chip8 & source);      // Shares the image of another emulator, if it's the same (while neither runs)
+        const Blocks & getImageBlocks();                   // Blocks of the image, decoding them if needed
+        static void decodeBlocks(Image & image);           // Decodes the blocks starting at every address of an image
+        bool        isStale(uint16_t address) const;       // Whether the block of the image at address might no longer be in memory
+        void        markStale(size_t start, size_t end);   // Keeps blocks of the image from running over memory written to
+        Blocks &    getCache();                            // Cache of blocks of the emulator's own, allocated on first use
+        void        cacheBlock(uint16_t address);          // Decodes a block starting at address
+        static uint8_t fuse(const Ops & ops, const Instruction * in, size_t length); // Operation running the decoded instructions in, fused with up to length of them
+        void        memoryWritten(uint16_t address, uint16_t size); // Keeps track of a write to memory
+        void        invalidate(uint16_t address, uint16_t size); // Drops blocks overwritten in memory
+        void        setHires(bool hires);                  // Switches resolution, which clears the display
+        template <typename Policy>
+        uint16_t    skip() const;                          // Bytes a skip moves the program counter by
+
+        // Operations based on opcode, the templated ones following the
+        // quirks of a profile (see cee::ModernQuirks).
+        void opUnknown(const Instruction & in); // Reports an opcode that has no operation.
+        void op0x0000(const Instruction & in); // Calls RCA 1802 program at address NNN.
+        void op0x00C0(const Instruction & in); // Scrolls the display down by N rows.
+        void op0x00D0(const Instruction & in); // Scrolls the display up by N rows.
+        void op0x00E0(const Instruction & in); // Clears the screen.
+        void op0x00EE(const Instruction & in); // Returns from a subroutine.
+        void op0x00FB(const Instruction & in); // Scrolls the display right by 4 pixels.
+        void op0x00FC(const Instruction & in); // Scrolls the display left by 4 pixels.
+        void op0x00FD(const Instruction & in); // Exits the interpreter, which stops on the spot.
+        void op0x00FE(const Instruction & in); // Switches to low resolution.
+        void op0x00FF(const Instruction & in); // Switches to high resolution.
+        void op0x1000(const Instruction & in); // Jumps to address NNN.
+        void op0x2000(const Instruction & in); // Calls subroutine at NNN.
+        template <typename Policy>
+        void op0x3000(const Instruction & in); // Skips the next instruction if VX equals NN.
+        template <typename Policy>
+        void op0x4000(const Instruction & in); // Skips the next instruction if VX doesn't equal NN.
+        template <typename Policy>
+        void op0x5000(const Instruction & in); // Skips the next instruction if VX equals VY.
+        void op0x5002(const Instruction & in); // Stores VX to VY in memory starting at address I, either way round.
+        void op0x5003(const Instruction & in); // Fills VX to VY with values from memory starting at address I, either way round.
+        void op0x6000(const Instruction & in); // Sets VX to NN.
+        void op0x7000(const Instruction & in); // Adds NN to VX.
+        void op0x8000(const Instruction & in); // Sets VX to the value of VY.
+        template <typename Policy>
+        void op0x8001(const Instruction & in); // Sets VX to VX or VY.
+        template <typename Policy>
+        void op0x8002(const Instruction & in); // Sets VX to VX and VY.
+        template <typename Policy>
+        void op0x8003(const Instruction & in); // Sets VX to VX xor VY.
+        void op0x8004(const Instruction & in); // Adds VY to VX. VF is set to 1 when carry, and to 0 when isn't.
+        void op0x8005(const Instruction & in); // VY is subtracted from VX. VF is set to 0 when borrow, and 1 when isn't.
+        template <typename Policy>
+        void op0x8006(const Instruction & in); // Shifts VX right by 1. VF is set value of the least sig bit of VX before shift.
+        void op0x8007(const Instruction & in); // Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when isn't.
+        template <typename Policy>
+        void op0x800E(const Instruction & in); // Shifts VX left by 1. VF is set value of the most sig bit of VX before shift.
+        template <typename Policy>
+        void op0x9000(const Instruction & in); // Skips the next instruction if VX doesn't equal VY.
+        void op0xA000(const Instruction & in); // Sets I to the address NNN.
+        template <typename Policy>
+        void op0xB000(const Instruction & in); // Jumps to the address NNN plus V0.
+        void op0xC000(const Instruction & in); // Sets VX to a random number, masked by NN.
 
         // Draws a sprite (which is a sequence of bytes)
         // at coordinate (VX, VY) that has a width of 8 pixels and
@@ -78,19 +343,29 @@ namespace cee
         // I value doesn’t change after the execution of this instruction.
         // As described above, VF is set to 1 if any screen pixels are flipped from set
         // to unset when the sprite is drawn, and to 0 if that doesn’t happen.
-        void op0xD000();
+        // With SUPER-CHIP, a height of 0 draws 16 x 16 pixels instead.
+        template <typename Policy>
+        void op0xD000(const Instruction & in);
 
-        void op0xE09E(); // Skips the next instruction if the key stored in VX is pressed.
-        void op0xE0A1(); // Skips the next instruction if the key stored in VX isn't pressed.
-        void op0xF007(); // Sets VX to the value of the delay timer.
-        void op0xF00A(); // A key press is awaited, and then stored in VX.
-        void op0xF015(); // Sets the delay timer to VX.
-        void op0xF018(); // Sets the sound timer to VX.
-        void op0xF01E(); // Adds VX to I.
+        template <typename Policy>
+        void op0xE09E(const Instruction & in); // Skips the next instruction if the key stored in VX is pressed.
+        template <typename Policy>
+        void op0xE0A1(const Instruction & in); // Skips the next instruction if the key stored in VX isn't pressed.
+        void op0xF000(const Instruction & in); // Sets I to the 16-bit address following the instruction.
+        void op0xF001(const Instruction & in); // Selects the planes drawn to, as a bit each in X.
+        void op0xF002(const Instruction & in); // Loads the audio pattern from the 16 bytes at address I.
+        void op0xF007(const Instruction & in); // Sets VX to the value of the delay timer.
+        void op0xF00A(const Instruction & in); // A key press is awaited, and then stored in VX.
+        void op0xF015(const Instruction & in); // Sets the delay timer to VX.
+        void op0xF018(const Instruction & in); // Sets the sound timer to VX.
+        void op0xF01E(const Instruction & in); // Adds VX to I.
 
         // Sets I to the location of the sprite for the character in VX.
         // Characters 0-F (in hexadecimal) are represented by a 4x5 font.
-        void op0xF029();
+        void op0xF029(const Instruction & in);
+
+        // Same, for the 8x10 font of SUPER-CHIP.
+        void op0xF030(const Instruction & in);
 
         // Stores the Binary-coded decimal representation of VX,
         // with the most significant of three digits at the address in I,
@@ -98,10 +373,28 @@ namespace cee
         // (In other words, take the decimal representation of VX,
         // place the hundreds digit in memory at location in I, the tens digit at location I+1,
         // and the ones digit at location I+2.).
-        void op0xF033();
+        void op0xF033(const Instruction & in);
+
+        void op0xF03A(const Instruction & in); // Sets the pitch of the audio pattern to VX.
+
+        template <typename Policy>
+        void op0xF055(const Instruction & in); // Stores V0 to VX in memory starting at address I.
+        template <typename Policy>
+        void op0xF065(const Instruction & in); // Fills V0 to VX with values from memory starting at address I.
+        void op0xF075(const Instruction & in); // Stores V0 to VX in the RPL user flags.
+        void op0xF085(const Instruction & in); // Fills V0 to VX from the RPL user flags.
 
-        void op0xF055(); // Stores V0 to VX in memory starting at address I.
-        void op0xF065(); // Fills V0 to VX with values from memory starting at address I.
+        // Fused operations, running the sequence of instructions decoded
+        // from the one given on (see Fusion).
+        template <typename Policy>
+        void fuseLoadLoadDraw(const Instruction & in);
+        void fuseLoadLoad(const Instruction & in);
+        template <typename Policy>
+        void fuseIndexDraw(const Instruction & in);
+        template <typename Policy>
+        void fuseAddSkip(const Instruction & in);
+        template <typename Policy>
+        void fuseDelaySkip(const Instruction & in);
     };
 }
 
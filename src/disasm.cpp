@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "files.hpp"
+#include "flow.hpp"
+#include "layout.hpp"
+#include "quirks.hpp"
+
+static void
+printUsage();
+
+int main(int argc, char ** argv)
+{
+    auto pathToRom = std::string();
+    auto output    = std::string();
+    auto format    = cee::GraphFormat::Text;
+    auto quirks    = cee::Quirks::Modern;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const auto arg = std::string(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if ((arg == "--output" || arg == "-o") && hasValue)
+        {
+            output = argv[++i];
+        }
+        else if (arg == "--format" && hasValue)
+        {
+            const auto name = std::string(argv[++i]);
+            if (name == "dot")
+                format = cee::GraphFormat::Dot;
+            else if (name == "json")
+                format = cee::GraphFormat::Json;
+            else if (name != "text")
+            {
+                printf("Chip8 Error: Unknown format %s\n", name.c_str());
+                return -1;
+            }
+        }
+        else if (arg == "--quirks" && hasValue)
+        {
+            if (! cee::findQuirks(argv[++i], quirks))
+            {
+                printf("Chip8 Error: Unknown quirks %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg[0] != '-' && pathToRom.empty())
+        {
+            pathToRom = arg;
+        }
+        else
+        {
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (pathToRom.empty())
+    {
+        printf("Chip8 Error: Wrong number of arguments\n");
+        printUsage();
+        return -1;
+    }
+
+    const auto program = cee::readAllBytes(pathToRom.c_str());
+    if (program.empty())
+        return -1;
+
+    // Programs are decoded in the memory they'd run in, by the same
+    // tables the emulator runs them with.
+    cee::Chip8 chip;
+    chip.setQuirks(quirks);
+    if (program.size() >= chip.getMemorySize() - cee::PROG_OFFSET)
+    {
+        printf("Chip8 Error: Program doesn't fit in the memory of %s\n", cee::getName(quirks));
+        return -1;
+    }
+
+    chip.loadProgram(program.data(), program.size());
+    const cee::FlowGraph graph(chip, program.size());
+
+    auto file = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (! file)
+    {
+        printf("Chip8 Error: Can't write to %s\n", output.c_str());
+        return -1;
+    }
+
+    graph.write(file, format);
+
+    if (file != stdout)
+        fclose(file);
+
+    return 0;
+}
+
+void
+printUsage()
+{
+    printf("Usage: cee-disasm [OPTIONS] FILE_PATH\n"
+           "  --format FMT      Output format: text (default), dot or json\n"
+           "  --output FILE     Where to write it (default: the output)\n"
+           "  --quirks NAME     Interpreter to decode for: modern (default), vip, chip48, schip or xochip\n");
+}
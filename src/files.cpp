@@ -0,0 +1,78 @@
+#include "files.hpp"
+
+#include <iostream>
+#include <fstream>
+
+std::vector<uint8_t>
+cee::readAllBytes(const char * path)
+{
+    try
+    {
+        std::ifstream file;
+        file.exceptions(std::ios::failbit);
+        file.open(path, std::ios::binary|std::ios::ate);
+        auto length = file.tellg();
+        std::vector<uint8_t> result(length);
+        file.seekg(0, std::ios::beg);
+        file.read((char*)&result[0], length);
+        file.close();
+        return result;
+    }
+    catch (std::ios_base::failure & err)
+    {
+        std::cerr << "File Error: Can't open file with path: " << path << "\n";
+    }
+    catch (std::bad_alloc & err)
+    {
+        std::cerr << "File Error: Can't open file with path: " << path << "\n";
+    }
+
+    return {};
+}
+
+std::string
+cee::readAllChars(const char * path)
+{
+    try
+    {
+        std::ifstream file;
+        file.exceptions(std::ios::failbit);
+        file.open(path, std::ios::ate);
+        auto length = file.tellg();
+        std::string result(length, ' ');
+        file.seekg(0, std::ios::beg);
+        file.read(&result[0], length);
+        file.close();
+        return result;
+    }
+    catch (std::ios_base::failure & err)
+    {
+        std::cerr << "File Error: Can't open file with path: " << path << "\n";
+    }
+    catch (std::bad_alloc & err)
+    {
+        std::cerr << "File Error: Can't open file with path: " << path << "\n";
+    }
+
+    return "";
+}
+
+bool
+cee::writeAllBytes(const char * path, const std::vector<uint8_t> & bytes)
+{
+    try
+    {
+        std::ofstream file;
+        file.exceptions(std::ios::failbit | std::ios::badbit);
+        file.open(path, std::ios::binary|std::ios::trunc);
+        file.write((const char*)bytes.data(), bytes.size());
+        file.close();
+        return true;
+    }
+    catch (std::ios_base::failure & err)
+    {
+        std::cerr << "File Error: Can't write file with path: " << path << "\n";
+    }
+
+    return false;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#ifndef CEE_FILES_HPP
+#define CEE_FILES_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+namespace cee
+{
+    std::vector<uint8_t> readAllBytes(const char * path); // Reads a binary file, empty on failure
+    std::string          readAllChars(const char * path); // Reads a text file, empty on failure
+    bool                 writeAllBytes(const char * path, const std::vector<uint8_t> & bytes); // Writes a binary file, false on failure
+}
+
+#endif // CEE_FILES_HPP
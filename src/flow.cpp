@@ -0,0 +1,622 @@
+#include "flow.hpp"
+#include "layout.hpp"
+
+#include <algorithm>
+
+// What the analysis found out about a byte of memory, as bits.
+enum Byte : uint8_t
+{
+    BYTE_START  = 1, // An instruction reached starts here
+    BYTE_CODE   = 2, // Part of an instruction reached
+    BYTE_LEADER = 4  // A block starts here
+};
+
+// Entry of mSyntax for operations without a mnemonic.
+static constexpr uint8_t NO_SYNTAX = 0xFF;
+
+// Mnemonics and flow of every operation, by the opcode it's decoded
+// from. Operands are written as $x and $y for registers, $n, $b and $a
+// for the lowest nibble, byte and address, $l for the word following
+// the opcode, and $j for the register BNNN jumps by. Groups come before
+// the operations carved out of them, so that opcodes a profile doesn't
+// carve out are named after their group.
+struct Syntax
+{
+    uint16_t     pattern;
+    const char * format;
+    cee::Flow    flow;
+};
+
+static const Syntax SYNTAX[] =
+{
+    {0x0000, "SYS $a",            cee::Flow::Next},
+    {0x1000, "JP $a",             cee::Flow::Jump},
+    {0x2000, "CALL $a",           cee::Flow::Call},
+    {0x3000, "SE V$x, $b",        cee::Flow::Skip},
+    {0x4000, "SNE V$x, $b",       cee::Flow::Skip},
+    {0x5000, "SE V$x, V$y",       cee::Flow::Skip},
+    {0x6000, "LD V$x, $b",        cee::Flow::Next},
+    {0x7000, "ADD V$x, $b",       cee::Flow::Next},
+    {0x8000, "LD V$x, V$y",       cee::Flow::Next},
+    {0x8001, "OR V$x, V$y",       cee::Flow::Next},
+    {0x8002, "AND V$x, V$y",      cee::Flow::Next},
+    {0x8003, "XOR V$x, V$y",      cee::Flow::Next},
+    {0x8004, "ADD V$x, V$y",      cee::Flow::Next},
+    {0x8005, "SUB V$x, V$y",      cee::Flow::Next},
+    {0x8006, "SHR V$x, V$y",      cee::Flow::Next},
+    {0x8007, "SUBN V$x, V$y",     cee::Flow::Next},
+    {0x800E, "SHL V$x, V$y",      cee::Flow::Next},
+    {0x9000, "SNE V$x, V$y",      cee::Flow::Skip},
+    {0xA000, "LD I, $a",          cee::Flow::Next},
+    {0xB000, "JP $j, $a",         cee::Flow::Indirect},
+    {0xC000, "RND V$x, $b",       cee::Flow::Next},
+    {0xD000, "DRW V$x, V$y, $n",  cee::Flow::Next},
+    {0x00E0, "CLS",               cee::Flow::Next},
+    {0x00EE, "RET",               cee::Flow::Return},
+    {0xE09E, "SKP V$x",           cee::Flow::Skip},
+    {0xE0A1, "SKNP V$x",          cee::Flow::Skip},
+    {0xF007, "LD V$x, DT",        cee::Flow::Next},
+    {0xF00A, "LD V$x, K",         cee::Flow::Next},
+    {0xF015, "LD DT, V$x",        cee::Flow::Next},
+    {0xF018, "LD ST, V$x",        cee::Flow::Next},
+    {0xF01E, "ADD I, V$x",        cee::Flow::Next},
+    {0xF029, "LD F, V$x",         cee::Flow::Next},
+    {0xF033, "LD B, V$x",         cee::Flow::Next},
+    {0xF055, "LD [I], V$x",       cee::Flow::Next},
+    {0xF065, "LD V$x, [I]",       cee::Flow::Next},
+    {0x00C0, "SCD $n",            cee::Flow::Next},
+    {0x00D0, "SCU $n",            cee::Flow::Next},
+    {0x00FB, "SCR",               cee::Flow::Next},
+    {0x00FC, "SCL",               cee::Flow::Next},
+    {0x00FD, "EXIT",              cee::Flow::Stop},
+    {0x00FE, "LOW",               cee::Flow::Next},
+    {0x00FF, "HIGH",              cee::Flow::Next},
+    {0x5002, "SAVE V$x - V$y",    cee::Flow::Next},
+    {0x5003, "LOAD V$x - V$y",    cee::Flow::Next},
+    {0xF000, "LD I, $l",          cee::Flow::Next},
+    {0xF001, "PLANE $x",          cee::Flow::Next},
+    {0xF002, "AUDIO",             cee::Flow::Next},
+    {0xF030, "LD HF, V$x",        cee::Flow::Next},
+    {0xF03A, "PITCH V$x",         cee::Flow::Next},
+    {0xF075, "LD R, V$x",         cee::Flow::Next},
+    {0xF085, "LD V$x, R",         cee::Flow::Next}
+};
+
+static constexpr size_t SYNTAX_SIZE = sizeof(SYNTAX) / sizeof(SYNTAX[0]);
+
+static void
+writeData(FILE * file, const uint8_t * memory, size_t address, size_t size);
+
+cee::FlowGraph::FlowGraph(const cee::Chip8 & chip, size_t size)
+    : mChip(chip)
+    , mSize(size)
+    , mBytes(chip.mMemory.size(), 0)
+    , mBlockAt(chip.mMemory.size(), -1)
+{
+    // Operations are told apart by the entries of their opcodes in the
+    // decoding table, which only the emulator's own profile fills in.
+    const auto & ops = *mChip.mOps;
+    mSyntax.fill(NO_SYNTAX);
+
+    for (size_t i = 0; i < SYNTAX_SIZE; i++)
+    {
+        const auto pattern = SYNTAX[i].pattern;
+        const auto op      = ops.index[(pattern & 0xF000) >> 4 | (pattern & 0x00FF)];
+        if (ops.handlers[op] != &Chip8::opUnknown && mSyntax[op] == NO_SYNTAX)
+            mSyntax[op] = static_cast<uint8_t>(i);
+    }
+
+    recover();
+    assignFunctions();
+}
+
+const std::vector<cee::FlowGraph::Block> & cee::FlowGraph::getBlocks() const
+{
+    return mBlocks;
+}
+
+const std::vector<cee::FlowGraph::Function> & cee::FlowGraph::getFunctions() const
+{
+    return mFunctions;
+}
+
+const cee::FlowGraph::Block * cee::FlowGraph::findBlock(uint16_t address) const
+{
+    if (address >= mBlockAt.size() || mBlockAt[address] < 0)
+        return nullptr;
+
+    return &mBlocks[mBlockAt[address]];
+}
+
+bool cee::FlowGraph::isCode(uint16_t address) const
+{
+    return address < mBytes.size() && (mBytes[address] & BYTE_CODE) != 0;
+}
+
+cee::FlowGraph::Instruction cee::FlowGraph::decode(uint16_t address) const
+{
+    const auto & memory = mChip.mMemory;
+    const size_t mask   = memory.size() - 1;
+
+    Instruction result;
+    result.address = address;
+    result.opcode  = memory[address & mask] << 8 | memory[(address + 1) & mask];
+    result.target  = 0;
+    result.size    = 2;
+    result.flow    = cee::Flow::Stop;
+
+    // Nothing runs off the end of memory.
+    if (address >= mask)
+        return result;
+
+    const auto in     = mChip.decode(address);
+    const auto syntax = mSyntax[in.op];
+    if (syntax == NO_SYNTAX)
+        return result;
+
+    result.flow = SYNTAX[syntax].flow;
+    if (SYNTAX[syntax].pattern == 0xF000)
+        result.size = 4;
+
+    if (result.flow == cee::Flow::Jump || result.flow == cee::Flow::Call)
+    {
+        result.target = in.nnn;
+    }
+    else if (result.flow == cee::Flow::Skip)
+    {
+        // XO-CHIP skips over the whole of F000 NNNN.
+        const size_t next = address + 2;
+        const auto   wide = mChip.mOps->xoChip && memory[next & mask] == 0xF0 && memory[(next + 1) & mask] == 0x00;
+        result.target = static_cast<uint16_t>(next + (wide ? 4 : 2));
+    }
+
+    return result;
+}
+
+std::string cee::FlowGraph::disassemble(uint16_t address) const
+{
+    const auto & memory = mChip.mMemory;
+    const size_t mask   = memory.size() - 1;
+    const auto   in     = mChip.decode(address < mask ? address : 0);
+    const auto   syntax = address < mask ? mSyntax[in.op] : NO_SYNTAX;
+
+    char text[32];
+    if (syntax == NO_SYNTAX)
+    {
+        snprintf(text, sizeof(text), "DW 0x%02X%02X", memory[address & mask], memory[(address + 1) & mask]);
+        return text;
+    }
+
+    std::string result;
+    for (auto c = SYNTAX[syntax].format; *c != '\0'; c++)
+    {
+        if (*c != '$')
+        {
+            result += *c;
+            continue;
+        }
+
+        switch (*++c)
+        {
+        case 'x': snprintf(text, sizeof(text), "%X", in.x); break;
+        case 'y': snprintf(text, sizeof(text), "%X", in.y); break;
+        case 'n': snprintf(text, sizeof(text), "0x%X", in.n); break;
+        case 'b': snprintf(text, sizeof(text), "0x%02X", in.nn); break;
+        case 'a': snprintf(text, sizeof(text), "0x%03X", in.nnn); break;
+        case 'l': snprintf(text, sizeof(text), "0x%02X%02X", memory[(address + 2) & mask], memory[(address + 3) & mask]); break;
+        case 'j': snprintf(text, sizeof(text), "V%X", mChip.mOps->jumpVx ? in.x : 0); break;
+        default:  text[0] = '\0'; break;
+        }
+
+        result += text;
+    }
+
+    return result;
+}
+
+void cee::FlowGraph::write(FILE * file, cee::GraphFormat format) const
+{
+    switch (format)
+    {
+    case cee::GraphFormat::Text: writeText(file); break;
+    case cee::GraphFormat::Dot:  writeDot(file);  break;
+    case cee::GraphFormat::Json: writeJson(file); break;
+    }
+}
+
+void cee::FlowGraph::recover()
+{
+    const size_t size = mBytes.size();
+    std::vector<uint16_t> pending;
+
+    // Bounds of what's reached, so that only those bytes are gone over
+    // again, however big memory is.
+    size_t lowest  = size;
+    size_t highest = 0;
+
+    // Blocks start wherever the flow lands other than by carrying on
+    // from the instruction before, and where two instructions carry on.
+    const auto reach = [&](size_t address, bool carriedOn)
+    {
+        if (address + 1 >= size)
+            return;
+
+        if (! carriedOn || (mBytes[address] & BYTE_START))
+            mBytes[address] |= BYTE_LEADER;
+
+        if (! (mBytes[address] & BYTE_START))
+        {
+            mBytes[address] |= BYTE_START;
+            pending.push_back(static_cast<uint16_t>(address));
+            lowest  = std::min(lowest, address);
+            highest = std::max(highest, address);
+        }
+    };
+
+    reach(cee::PROG_OFFSET, false);
+
+    while (! pending.empty())
+    {
+        const auto in = decode(pending.back());
+        pending.pop_back();
+
+        for (size_t i = 0; i < in.size && in.address + i < size; i++)
+            mBytes[in.address + i] |= BYTE_CODE;
+
+        const size_t next = in.address + in.size;
+        switch (in.flow)
+        {
+        case cee::Flow::Next:
+            reach(next, true);
+            break;
+        case cee::Flow::Jump:
+            reach(in.target, false);
+            break;
+        case cee::Flow::Call:
+            reach(in.target, false);
+            reach(next, false);
+            break;
+        case cee::Flow::Skip:
+            reach(next, false);
+            reach(in.target, false);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Each instruction carries on into a single one, so walking from
+    // every leader up to the next goes over each instruction once.
+    for (size_t address = lowest; address <= highest; address++)
+    {
+        if (! (mBytes[address] & BYTE_LEADER))
+            continue;
+
+        Block block;
+        block.address  = static_cast<uint16_t>(address);
+        block.function = block.address;
+
+        auto in = decode(block.address);
+        for (;;)
+        {
+            const size_t next = in.address + in.size;
+            if (in.flow != cee::Flow::Next || next + 1 >= size || (mBytes[next] & BYTE_LEADER))
+                break;
+
+            in = decode(static_cast<uint16_t>(next));
+        }
+
+        block.last = in.address;
+        block.end  = static_cast<uint32_t>(std::min<size_t>(in.address + in.size, size));
+
+        // Calls lead on to the callee, which is told apart by the
+        // subroutine it starts rather than listed as a successor.
+        const auto follow = [&block, size](size_t target)
+        {
+            if (target + 1 < size)
+                block.successors.push_back(static_cast<uint16_t>(target));
+        };
+
+        switch (in.flow)
+        {
+        case cee::Flow::Next:
+        case cee::Flow::Call:
+            follow(in.address + in.size);
+            break;
+        case cee::Flow::Jump:
+            follow(in.target);
+            break;
+        case cee::Flow::Skip:
+            follow(in.address + 2);
+            follow(in.target);
+            break;
+        default:
+            break;
+        }
+
+        mBlockAt[address] = static_cast<int32_t>(mBlocks.size());
+        mBlocks.push_back(std::move(block));
+    }
+}
+
+void cee::FlowGraph::assignFunctions()
+{
+    // Subroutines start at the program's entry and wherever it calls.
+    std::vector<uint16_t> entries = {cee::PROG_OFFSET};
+    for (const auto & block : mBlocks)
+    {
+        const auto in = decode(block.last);
+        if (in.flow == cee::Flow::Call && mBlockAt[in.target] >= 0)
+            entries.push_back(in.target);
+    }
+
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+    for (const auto entry : entries)
+    {
+        if (mBlockAt[entry] >= 0)
+            mFunctions.push_back(Function{entry, {}});
+    }
+
+    const auto findFunction = [this](uint16_t address) -> Function *
+    {
+        const auto it = std::lower_bound(mFunctions.begin(), mFunctions.end(), address,
+                                         [](const Function & function, uint16_t entry)
+        {
+            return function.address < entry;
+        });
+
+        return it != mFunctions.end() && it->address == address ? &*it : nullptr;
+    };
+
+    // Blocks shared by several subroutines go to the first one reaching
+    // them, the program itself first, so that each is only visited once.
+    std::vector<bool>     owned(mBlocks.size(), false);
+    std::vector<uint16_t> pending;
+
+    const auto claim = [&](uint16_t entry)
+    {
+        pending.push_back(entry);
+        while (! pending.empty())
+        {
+            const auto index = mBlockAt[pending.back()];
+            pending.pop_back();
+
+            if (index < 0 || owned[index])
+                continue;
+
+            auto & block = mBlocks[index];
+            owned[index]   = true;
+            block.function = entry;
+
+            for (const auto successor : block.successors)
+                pending.push_back(successor);
+        }
+    };
+
+    claim(cee::PROG_OFFSET);
+    for (const auto & function : mFunctions)
+        claim(function.address);
+
+    for (const auto & block : mBlocks)
+    {
+        const auto in     = decode(block.last);
+        const auto caller = findFunction(block.function);
+        if (in.flow == cee::Flow::Call && caller && mBlockAt[in.target] >= 0)
+            caller->callees.push_back(in.target);
+    }
+
+    for (auto & function : mFunctions)
+    {
+        auto & callees = function.callees;
+        std::sort(callees.begin(), callees.end());
+        callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+    }
+}
+
+void cee::FlowGraph::writeText(FILE * file) const
+{
+    const auto & memory = mChip.mMemory;
+    const size_t start  = cee::PROG_OFFSET;
+    const size_t end    = std::min(start + mSize, memory.size());
+
+    size_t instructions = 0;
+    for (size_t address = 0; address < mBytes.size(); address++)
+        instructions += (mBytes[address] & BYTE_START) != 0;
+
+    size_t data = 0;
+    for (size_t address = start; address < end; address++)
+        data += (mBytes[address] & BYTE_CODE) == 0;
+
+    fprintf(file, "; quirks       %s\n"
+                  "; instructions %zu\n"
+                  "; blocks       %zu\n"
+                  "; subroutines  %zu\n"
+                  "; data         %zu bytes\n",
+            cee::getName(mChip.mOps->quirks), instructions, mBlocks.size(), mFunctions.size(), data);
+
+    size_t address = 0;
+    while (address < memory.size())
+    {
+        const auto block = findBlock(static_cast<uint16_t>(address));
+        if (block)
+        {
+            fprintf(file, "\n%s_%04zX:\n", block->function == address ? "sub" : "loc", address);
+
+            for (size_t pc = address; pc <= block->last; )
+            {
+                const auto in = decode(static_cast<uint16_t>(pc));
+                fprintf(file, "    0x%03zX  %04X  %s\n", pc, in.opcode, disassemble(in.address).c_str());
+                pc += in.size;
+            }
+
+            if (decode(block->last).flow != cee::Flow::Next && ! block->successors.empty())
+            {
+                fprintf(file, "                 ;");
+                for (size_t i = 0; i < block->successors.size(); i++)
+                    fprintf(file, "%s 0x%03X", i == 0 ? " ->" : ",", block->successors[i]);
+                fprintf(file, "\n");
+            }
+
+            address = std::max<size_t>(block->end, address + 1);
+            continue;
+        }
+
+        // Data only goes as far as the program does, and up to the next
+        // byte of code.
+        if (address < start || address >= end || (mBytes[address] & BYTE_CODE))
+        {
+            address += 1;
+            continue;
+        }
+
+        auto last = address;
+        while (last < end && ! (mBytes[last] & BYTE_CODE) && mBlockAt[last] < 0)
+            last += 1;
+
+        fprintf(file, "\ndata_%04zX:\n", address);
+        writeData(file, memory.data(), address, last - address);
+        address = last;
+    }
+}
+
+void cee::FlowGraph::writeDot(FILE * file) const
+{
+    fprintf(file, "digraph program {\n"
+                  "    node [shape=box, fontname=\"monospace\"];\n");
+
+    // Each subroutine is a cluster of the blocks it owns, which are
+    // sorted by it first to go over them once.
+    std::vector<const Block *> owned;
+    for (const auto & block : mBlocks)
+        owned.push_back(&block);
+
+    std::stable_sort(owned.begin(), owned.end(), [](const Block * a, const Block * b)
+    {
+        return a->function < b->function;
+    });
+
+    for (size_t i = 0; i < owned.size(); )
+    {
+        const auto function = owned[i]->function;
+        fprintf(file, "    subgraph cluster_%04X {\n"
+                      "        label=\"sub_%04X\";\n", function, function);
+
+        for (; i < owned.size() && owned[i]->function == function; i++)
+        {
+            const auto & block = *owned[i];
+            fprintf(file, "        b%04X [label=\"", block.address);
+            for (size_t pc = block.address; pc <= block.last; )
+            {
+                const auto in = decode(static_cast<uint16_t>(pc));
+                fprintf(file, "0x%03zX  %s\\l", pc, disassemble(in.address).c_str());
+                pc += in.size;
+            }
+            fprintf(file, "\"];\n");
+        }
+
+        fprintf(file, "    }\n");
+    }
+
+    // Calls are dashed, going to the subroutine called.
+    for (const auto & block : mBlocks)
+    {
+        for (const auto successor : block.successors)
+            fprintf(file, "    b%04X -> b%04X;\n", block.address, successor);
+
+        const auto in = decode(block.last);
+        if (in.flow == cee::Flow::Call && mBlockAt[in.target] >= 0)
+            fprintf(file, "    b%04X -> b%04X [style=dashed];\n", block.address, in.target);
+    }
+
+    fprintf(file, "}\n");
+}
+
+void cee::FlowGraph::writeJson(FILE * file) const
+{
+    const auto & memory = mChip.mMemory;
+    const size_t start  = cee::PROG_OFFSET;
+    const size_t end    = std::min(start + mSize, memory.size());
+
+    fprintf(file, "{\n  \"quirks\": \"%s\",\n  \"blocks\": [", cee::getName(mChip.mOps->quirks));
+    for (size_t i = 0; i < mBlocks.size(); i++)
+    {
+        const auto & block = mBlocks[i];
+        fprintf(file, "%s\n    {\"address\": %u, \"end\": %u, \"function\": %u, \"successors\": [",
+                i == 0 ? "" : ",", block.address, block.end, block.function);
+        for (size_t j = 0; j < block.successors.size(); j++)
+            fprintf(file, "%s%u", j == 0 ? "" : ", ", block.successors[j]);
+
+        fprintf(file, "], \"instructions\": [");
+        for (size_t pc = block.address; pc <= block.last; )
+        {
+            const auto in = decode(static_cast<uint16_t>(pc));
+            fprintf(file, "%s\n      {\"address\": %zu, \"opcode\": %u, \"text\": \"%s\"}",
+                    pc == block.address ? "" : ",", pc, in.opcode, disassemble(in.address).c_str());
+            pc += in.size;
+        }
+        fprintf(file, "\n    ]}");
+    }
+
+    fprintf(file, "\n  ],\n  \"functions\": [");
+    for (size_t i = 0; i < mFunctions.size(); i++)
+    {
+        const auto & function = mFunctions[i];
+        fprintf(file, "%s\n    {\"address\": %u, \"callees\": [", i == 0 ? "" : ",", function.address);
+        for (size_t j = 0; j < function.callees.size(); j++)
+            fprintf(file, "%s%u", j == 0 ? "" : ", ", function.callees[j]);
+        fprintf(file, "]}");
+    }
+
+    // Data is every run of bytes of the program no instruction covers.
+    fprintf(file, "\n  ],\n  \"data\": [");
+    auto first = true;
+    for (size_t address = start; address < end; )
+    {
+        if (mBytes[address] & BYTE_CODE)
+        {
+            address += 1;
+            continue;
+        }
+
+        auto last = address;
+        while (last < end && ! (mBytes[last] & BYTE_CODE))
+            last += 1;
+
+        fprintf(file, "%s\n    {\"address\": %zu, \"size\": %zu}", first ? "" : ",", address, last - address);
+        first   = false;
+        address = last;
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
+
+void
+writeData(FILE * file, const uint8_t * memory, size_t address, size_t size)
+{
+    // Eight bytes a line, along with how they'd look as sprite rows.
+    for (size_t line = 0; line < size; line += 8)
+    {
+        fprintf(file, "    0x%03zX ", address + line);
+
+        const auto count = std::min<size_t>(8, size - line);
+        for (size_t i = 0; i < 8; i++)
+        {
+            if (i < count)
+                fprintf(file, " %02X", memory[address + line + i]);
+            else
+                fprintf(file, "   ");
+        }
+
+        fprintf(file, "  ;");
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto byte = memory[address + line + i];
+            fprintf(file, " ");
+            for (size_t bit = 0; bit < 8; bit++)
+                fputc(byte & (0x80 >> bit) ? '#' : '.', file);
+        }
+        fprintf(file, "\n");
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#ifndef CEE_FLOW_HPP
+#define CEE_FLOW_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+
+namespace cee
+{
+    // Ways of writing out a flow graph.
+    enum class GraphFormat
+    {
+        Text,  // Disassembly, block by block, with the data in between
+        Dot,   // Blocks and the edges between them, for Graphviz
+        Json   // Everything, for tools to pick apart
+    };
+
+    // Where an instruction leads.
+    enum class Flow : uint8_t
+    {
+        Next,     // On to the instruction following it
+        Jump,     // To its target
+        Call,     // To its target, and on to the next one once that returns
+        Skip,     // On to the next instruction, or to its target past that one
+        Return,   // Back to wherever it was called from
+        Indirect, // Wherever a register says (BNNN)
+        Stop      // Nowhere (00FD, and opcodes no interpreter knows)
+    };
+
+    // Disassembles a program loaded in an emulator, without running it,
+    // and recovers its control flow graph. Instructions are decoded the
+    // same way the emulator decodes them, following its quirks profile,
+    // and found by following the flow of the program from where it
+    // starts, through jumps, skips and calls. Whatever's never reached
+    // that way is taken for data. Every instruction is decoded a bounded
+    // number of times, and only the bytes between the first and last
+    // reached are gone over, so the analysis takes time linear in the
+    // size of the program, cheap enough to run as programs are loaded.
+    // The emulator has to outlive the graph, and hold the same program
+    // for as long as it's used.
+    class FlowGraph
+    {
+    public:
+        // Instruction, as far as the flow of the program is concerned.
+        struct Instruction
+        {
+            uint16_t address; // Where it starts
+            uint16_t opcode;  // First two bytes of it
+            uint16_t target;  // Where it jumps, calls or skips to, if it does
+            uint8_t  size;    // Bytes it takes up, 4 for XO-CHIP's F000 NNNN
+            cee::Flow flow;   // Where it leads
+        };
+
+        // Instructions only ever run one after the other, from the first.
+        struct Block
+        {
+            uint16_t              address;    // First instruction
+            uint16_t              last;       // Last instruction
+            uint32_t              end;        // Past the last byte of the last instruction
+            uint16_t              function;   // Entry of the subroutine it belongs to
+            std::vector<uint16_t> successors; // Blocks it leads to, leaving out the ones it calls
+        };
+
+        // Subroutine, entered by calls, or the program itself.
+        struct Function
+        {
+            uint16_t              address;    // Entry
+            std::vector<uint16_t> callees;    // Subroutines it calls, in order
+        };
+
+        FlowGraph(const cee::Chip8 & chip, size_t size);
+
+        const std::vector<Block> &    getBlocks() const;    // Blocks in order of address
+        const std::vector<Function> & getFunctions() const; // Subroutines in order of address
+        const Block * findBlock(uint16_t address) const;     // Block starting at address, if any
+        bool isCode(uint16_t address) const;                 // Whether the byte at address is part of an instruction reached
+
+        Instruction decode(uint16_t address) const;          // Instruction at address, reached or not
+        std::string disassemble(uint16_t address) const;     // Mnemonic of the instruction at address
+
+        void write(FILE * file, cee::GraphFormat format) const; // Writes out the disassembly or graph
+    private:
+        const cee::Chip8 &          mChip;       // Emulator holding the program, and decoding it
+        size_t                      mSize;       // Bytes of the program, from PROG_OFFSET
+        std::array<uint8_t, 64>     mSyntax;     // Entry of the mnemonic table by operation
+        std::vector<uint8_t>        mBytes;      // What each byte of memory is, as Byte
+        std::vector<int32_t>        mBlockAt;    // Index of the block starting at an address, -1 if none
+        std::vector<Block>          mBlocks;     // Blocks in order of address
+        std::vector<Function>       mFunctions;  // Subroutines in order of address
+
+        void recover();                                      // Finds the instructions and the blocks they start
+        void assignFunctions();                              // Sorts blocks into subroutines, and finds their calls
+
+        void writeText(FILE * file) const;
+        void writeDot(FILE * file) const;
+        void writeJson(FILE * file) const;
+    };
+}
+
+#endif // CEE_FLOW_HPP
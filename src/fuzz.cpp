@@ -0,0 +1,212 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "batch.hpp"
+#include "chip8.hpp"
+#include "keys.hpp"
+#include "layout.hpp"
+#include "quirks.hpp"
+
+// Fuzzing target for libFuzzer, running arbitrary programs with arbitrary
+// key changes. An input is laid out as:
+//
+//   settings  1 byte   Quirks profile in the lowest 3 bits, then whether
+//                      to run on the JIT, whether to also step a second
+//                      emulator a cycle at a time to compare with, and
+//                      whether to run a batch too
+//   changes   1 byte   Number of key changes following
+//   change    4 bytes  Cycles to run before it, and the keys then held,
+//                      as little endian words, for each of the changes
+//   program   rest     Copied to PROG_OFFSET, cut short to fit
+//
+// Besides whatever the sanitizers catch, emulators running cached blocks
+// have to end up just as ones stepped a cycle at a time, lanes of a batch
+// just as emulators on their own, and snapshots have to load back into
+// the same state.
+
+// Most cycles run for an input, to keep every run short.
+static constexpr size_t MAX_CYCLES = 1 << 16;
+
+// Bytes taken by each key change.
+static constexpr size_t CHANGE_SIZE = 4;
+
+// Keys told apart between the lanes of a batch, so that they branch
+// apart. Each lane gets the keys of a change turned by one of them.
+static constexpr size_t VARIANTS = 4;
+
+static cee::Keys
+getKeys(const uint8_t * change, size_t variant);
+
+static void
+checkBatch(const uint8_t * data, size_t changes, const uint8_t * program, size_t size);
+
+static void
+expectSame(const cee::Chip8 & a, const cee::Chip8 & b);
+
+static void
+expectSame(const cee::Chip8Batch & batch, size_t lane, const cee::Chip8 & chip);
+
+// The emulators report errors of the programs they run on the output,
+// which would only slow the fuzzer down, as all it goes by is whether
+// they crash. libFuzzer itself writes to the error output.
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+    if (! std::freopen("/dev/null", "w", stdout))
+        abort();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+    if (size < 2)
+        return 0;
+
+    const auto settings = data[0];
+    const auto changes  = data[1];
+    const auto header   = 2 + changes * CHANGE_SIZE;
+    if (size < header)
+        return 0;
+
+    const auto quirks  = static_cast<cee::Quirks>((settings & 0x7) % 5);
+    const auto backend = (settings & 0x8) ? cee::Backend::Jit : cee::Backend::Interpreter;
+    const auto stepped = (settings & 0x10) != 0;
+    const auto batched = (settings & 0x20) != 0;
+
+    // Timers go by cycles rather than the wall clock, so that every run
+    // of an input is the same.
+    cee::Chip8 chip(backend);
+    cee::Chip8 reference;
+    for (auto emulator : {&chip, &reference})
+    {
+        emulator->setQuirks(quirks);
+        emulator->setSeed(1);
+        emulator->setCycleRate(cee::DEFAULT_CYCLE_RATE);
+    }
+
+    const auto program = data + header;
+    const auto length  = std::min(size - header, chip.getMemorySize() - cee::PROG_OFFSET - 1);
+    chip.loadProgram(program, length);
+    if (stepped)
+        reference.loadProgram(program, length);
+
+    size_t budget = MAX_CYCLES;
+    for (size_t i = 0; i < changes && budget > 0; i++)
+    {
+        const auto change = data + 2 + i * CHANGE_SIZE;
+        const auto cycles = std::min<size_t>(change[0] | change[1] << 8, budget);
+        const auto keys   = getKeys(change, 0);
+        budget -= cycles;
+
+        chip.updateKeys(keys);
+        chip.updateCycles(cycles);
+
+        if (stepped)
+        {
+            reference.updateKeys(keys);
+            for (size_t j = 0; j < cycles; j++)
+                reference.updateCycle();
+
+            expectSame(chip, reference);
+        }
+    }
+
+    if (batched)
+        checkBatch(data, changes, program, size - header);
+
+    // A snapshot loads into an emulator of the same program, and leaves
+    // it in the very same state.
+    cee::Chip8 restored;
+    restored.setQuirks(quirks);
+    restored.setCycleRate(cee::DEFAULT_CYCLE_RATE);
+    restored.loadProgram(program, length);
+    if (! restored.loadState(chip.saveState()))
+        abort();
+
+    expectSame(chip, restored);
+    return 0;
+}
+
+cee::Keys
+getKeys(const uint8_t * change, size_t variant)
+{
+    const auto pressed = static_cast<uint16_t>(change[2] | change[3] << 8);
+    const auto turned  = static_cast<uint16_t>(pressed << variant | pressed >> (16 - variant));
+    return cee::Keys{turned, static_cast<uint16_t>((change[2] + variant) & 0xF)};
+}
+
+// Runs the program on a batch, which always follows the modern quirks,
+// with the same key changes, and on an emulator stepped a cycle at a
+// time for each variant of the keys and seed lanes get.
+void
+checkBatch(const uint8_t * data, size_t changes, const uint8_t * program, size_t size)
+{
+    const auto length = std::min(size, cee::Chip8Batch::MEMORY_SIZE - cee::PROG_OFFSET - 1);
+
+    cee::Chip8Batch batch;
+    for (size_t lane = 0; lane < cee::Chip8Batch::LANES; lane++)
+        batch.setSeed(lane, 1 + lane % VARIANTS);
+    batch.setCycleRate(cee::DEFAULT_CYCLE_RATE);
+    batch.loadProgram(program, length);
+
+    std::array<cee::Chip8, VARIANTS> chips;
+    for (size_t variant = 0; variant < VARIANTS; variant++)
+    {
+        chips[variant].setSeed(1 + variant);
+        chips[variant].setCycleRate(cee::DEFAULT_CYCLE_RATE);
+        chips[variant].loadProgram(program, length);
+    }
+
+    size_t budget = MAX_CYCLES;
+    for (size_t i = 0; i < changes && budget > 0; i++)
+    {
+        const auto change = data + 2 + i * CHANGE_SIZE;
+        const auto cycles = std::min<size_t>(change[0] | change[1] << 8, budget);
+        budget -= cycles;
+
+        for (size_t lane = 0; lane < cee::Chip8Batch::LANES; lane++)
+            batch.updateKeys(lane, getKeys(change, lane % VARIANTS));
+        batch.updateCycles(cycles);
+
+        for (size_t variant = 0; variant < VARIANTS; variant++)
+        {
+            chips[variant].updateKeys(getKeys(change, variant));
+            for (size_t j = 0; j < cycles; j++)
+                chips[variant].updateCycle();
+        }
+
+        for (size_t lane = 0; lane < cee::Chip8Batch::LANES; lane++)
+            expectSame(batch, lane, chips[lane % VARIANTS]);
+    }
+}
+
+void
+expectSame(const cee::Chip8 & a, const cee::Chip8 & b)
+{
+    if (a.saveState() != b.saveState())
+        abort();
+}
+
+// Lanes don't snapshot, so what they show of their state is compared.
+// Both wrap the program counter around memory only as they fetch from
+// it, each at their own time.
+void
+expectSame(const cee::Chip8Batch & batch, size_t lane, const cee::Chip8 & chip)
+{
+    for (size_t x = 0; x < 16; x++)
+        if (batch.getRegister(lane, x) != chip.getRegisters()[x])
+            abort();
+
+    if (batch.getIndex(lane) != chip.getIndex()
+        || (batch.getCounter(lane) ^ chip.getCounter()) & (cee::Chip8Batch::MEMORY_SIZE - 1)
+        || batch.getDelayTimer(lane) != chip.getDelayTimer()
+        || batch.getSoundTimer(lane) != chip.getSoundTimer()
+        || batch.getGfx(lane) != chip.getGfx()
+        || batch.getDirtyRows(lane) != chip.getDirtyRows())
+        abort();
+}
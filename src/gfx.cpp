@@ -0,0 +1,114 @@
+#include "gfx.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <initializer_list>
+
+// Rows are scrolled sideways four at a time, as compiler vector
+// extensions lowered to whatever SIMD the target has. They never cross
+// the boundary of this file, so ABI notes about them don't concern us.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef uint64_t U64 __attribute__((vector_size(32)));
+
+static constexpr size_t ROWS_PER_VECTOR = sizeof(U64) / sizeof(uint64_t);
+
+static_assert(cee::LORES_HEIGHT % ROWS_PER_VECTOR == 0, "Rows are scrolled a whole vector at a time");
+
+static cee::GfxRows
+getUsedRows(const cee::Gfx & gfx, size_t height);
+
+void cee::scrollGfxDown(cee::Gfx & gfx, size_t rows, bool hires, cee::GfxRows & dirty)
+{
+    const size_t height = hires ? GFX_HEIGHT : LORES_HEIGHT;
+    rows = std::min(rows, height);
+
+    const auto before = getUsedRows(gfx, height);
+
+    // Each half is a column of words, which moves as a single block.
+    for (auto half : {&gfx[0], &gfx[GFX_HEIGHT]})
+    {
+        std::memmove(half + rows, half, (height - rows) * sizeof(uint64_t));
+        std::memset(half, 0, rows * sizeof(uint64_t));
+    }
+
+    dirty |= before | getUsedRows(gfx, height);
+}
+
+void cee::scrollGfxUp(cee::Gfx & gfx, size_t rows, bool hires, cee::GfxRows & dirty)
+{
+    const size_t height = hires ? GFX_HEIGHT : LORES_HEIGHT;
+    rows = std::min(rows, height);
+
+    const auto before = getUsedRows(gfx, height);
+
+    for (auto half : {&gfx[0], &gfx[GFX_HEIGHT]})
+    {
+        std::memmove(half, half + rows, (height - rows) * sizeof(uint64_t));
+        std::memset(half + height - rows, 0, rows * sizeof(uint64_t));
+    }
+
+    dirty |= before | getUsedRows(gfx, height);
+}
+
+void cee::scrollGfxLeft(cee::Gfx & gfx, size_t pixels, bool hires, cee::GfxRows & dirty)
+{
+    const size_t height = hires ? GFX_HEIGHT : LORES_HEIGHT;
+    if (pixels == 0 || pixels >= 64)
+        return;
+
+    const auto before = getUsedRows(gfx, height);
+
+    for (size_t y = 0; y < height; y += ROWS_PER_VECTOR)
+    {
+        U64 left, right;
+        std::memcpy(&left, &gfx[y], sizeof(left));
+        std::memcpy(&right, &gfx[GFX_HEIGHT + y], sizeof(right));
+
+        // The right half is blank in low resolution, so nothing comes in.
+        left  = (left << pixels) | (right >> (64 - pixels));
+        right = right << pixels;
+
+        std::memcpy(&gfx[y], &left, sizeof(left));
+        std::memcpy(&gfx[GFX_HEIGHT + y], &right, sizeof(right));
+    }
+
+    dirty |= before | getUsedRows(gfx, height);
+}
+
+void cee::scrollGfxRight(cee::Gfx & gfx, size_t pixels, bool hires, cee::GfxRows & dirty)
+{
+    const size_t height = hires ? GFX_HEIGHT : LORES_HEIGHT;
+    if (pixels == 0 || pixels >= 64)
+        return;
+
+    const auto before = getUsedRows(gfx, height);
+
+    for (size_t y = 0; y < height; y += ROWS_PER_VECTOR)
+    {
+        U64 left, right;
+        std::memcpy(&left, &gfx[y], sizeof(left));
+        std::memcpy(&right, &gfx[GFX_HEIGHT + y], sizeof(right));
+
+        // In low resolution, pixels going past the left half are dropped
+        // rather than moved into the right one.
+        right = hires ? (right >> pixels) | (left << (64 - pixels)) : right;
+        left  = left >> pixels;
+
+        std::memcpy(&gfx[y], &left, sizeof(left));
+        std::memcpy(&gfx[GFX_HEIGHT + y], &right, sizeof(right));
+    }
+
+    dirty |= before | getUsedRows(gfx, height);
+}
+
+// Rows of the display with any pixel set.
+cee::GfxRows
+getUsedRows(const cee::Gfx & gfx, size_t height)
+{
+    cee::GfxRows rows = 0;
+    for (size_t y = 0; y < height; y++)
+        rows |= cee::GfxRows((gfx[y] | gfx[cee::GFX_HEIGHT + y]) != 0) << y;
+    return rows;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef CEE_GFX_HPP
+#define CEE_GFX_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+
+namespace cee
+{
+    static constexpr size_t GFX_WIDTH    = 128; // Pixels per row, in high resolution
+    static constexpr size_t GFX_HEIGHT   = 64;  // Rows per display, in high resolution
+    static constexpr size_t LORES_WIDTH  = 64;  // Pixels per row, in low resolution
+    static constexpr size_t LORES_HEIGHT = 32;  // Rows per display, in low resolution
+    static constexpr size_t GFX_PLANES   = 2;   // Bit-planes making up the colour of a pixel
+
+    // Display packed as a bit per pixel, with each row held by two words:
+    // its left half at [y] and its right half at [GFX_HEIGHT + y]. The
+    // leftmost pixel of a half is its most significant bit. In low
+    // resolution, only the left half of the first LORES_HEIGHT rows is
+    // used, the same as a display that small would be laid out alone.
+    using Gfx = std::array<uint64_t, GFX_HEIGHT * 2>;
+
+    // Planes of a display, each giving a bit of the colour of a pixel.
+    using GfxPlanes = std::array<cee::Gfx, GFX_PLANES>;
+
+    // Set of rows of the display, as a bit per row with row 0 lowest.
+    using GfxRows = uint64_t;
+
+    static_assert(GFX_HEIGHT <= sizeof(GfxRows) * 8, "Every row needs a bit of its own");
+
+    // XORs a row of 16 sprite pixels onto row y of the display, starting
+    // at column x, with the leftmost pixel as the most significant bit.
+    // Sprites 8 pixels wide leave the lowest byte clear. Pixels past the
+    // right edge wrap around to the left one when asked to, and are
+    // dropped otherwise.
+    // Returns whether any pixel was flipped from set to unset, and adds
+    // the row to dirty if it changed.
+    inline bool drawSpriteRow(cee::Gfx & gfx, size_t x, size_t y, uint16_t pixels, bool hires, bool wrap, cee::GfxRows & dirty)
+    {
+        // Low resolution only ever touches the left half.
+        if (! hires)
+        {
+            assert(x < LORES_WIDTH && y < LORES_HEIGHT);
+
+            auto row = (uint64_t(pixels) << 48) >> x;
+            if (wrap && x > 48)
+                row |= uint64_t(pixels) << (112 - x);
+
+            const bool collision = (gfx[y] & row) != 0;
+            gfx[y] ^= row;
+            dirty |= cee::GfxRows(row != 0) << y;
+            return collision;
+        }
+
+        uint64_t left  = 0;
+        uint64_t right = 0;
+
+        if (x < 64)
+        {
+            assert(y < GFX_HEIGHT);
+
+            left = (uint64_t(pixels) << 48) >> x;
+            if (x > 48)
+                right = uint64_t(pixels) << (112 - x);
+        }
+        else
+        {
+            assert(x < GFX_WIDTH && y < GFX_HEIGHT);
+
+            right = (uint64_t(pixels) << 48) >> (x - 64);
+            if (wrap && x > 112)
+                left = uint64_t(pixels) << (176 - x);
+        }
+
+        auto & leftHalf  = gfx[y];
+        auto & rightHalf = gfx[GFX_HEIGHT + y];
+
+        const bool collision = ((leftHalf & left) | (rightHalf & right)) != 0;
+        leftHalf  ^= left;
+        rightHalf ^= right;
+        dirty |= cee::GfxRows((left | right) != 0) << y;
+        return collision;
+    }
+
+    // Clears the display, adding the rows which weren't blank to dirty.
+    inline void clearGfx(cee::Gfx & gfx, cee::GfxRows & dirty)
+    {
+        for (size_t y = 0; y < GFX_HEIGHT; y++)
+        {
+            dirty |= cee::GfxRows((gfx[y] | gfx[GFX_HEIGHT + y]) != 0) << y;
+            gfx[y] = 0;
+            gfx[GFX_HEIGHT + y] = 0;
+        }
+    }
+
+    // Scrolls the display by a number of rows or pixels, in the current
+    // resolution. Pixels scrolled off the edges are lost, and those
+    // scrolled in are blank. Rows which changed are added to dirty.
+    void scrollGfxDown(cee::Gfx & gfx, size_t rows, bool hires, cee::GfxRows & dirty);
+    void scrollGfxUp(cee::Gfx & gfx, size_t rows, bool hires, cee::GfxRows & dirty);
+    void scrollGfxLeft(cee::Gfx & gfx, size_t pixels, bool hires, cee::GfxRows & dirty);
+    void scrollGfxRight(cee::Gfx & gfx, size_t pixels, bool hires, cee::GfxRows & dirty);
+
+    // Checks whether the pixel at column x of row y is set.
+    inline bool getPixel(const cee::Gfx & gfx, size_t x, size_t y)
+    {
+        return (gfx[x < 64 ? y : GFX_HEIGHT + y] >> (63 - x % 64)) & 1;
+    }
+
+    // Unpacks the display into a byte per pixel, which is its colour:
+    // the bits of the pixel in every plane, plane 0 lowest. Pixels are
+    // laid out row by row, LORES_WIDTH * LORES_HEIGHT of them in low
+    // resolution and GFX_WIDTH * GFX_HEIGHT in high resolution.
+    inline void unpackGfx(const cee::GfxPlanes & planes, bool hires, uint8_t * pixels)
+    {
+        const size_t width  = hires ? GFX_WIDTH : LORES_WIDTH;
+        const size_t height = hires ? GFX_HEIGHT : LORES_HEIGHT;
+
+        for (size_t y = 0; y < height; y++)
+        {
+            for (size_t x = 0; x < width; x++)
+            {
+                uint8_t colour = 0;
+                for (size_t plane = 0; plane < GFX_PLANES; plane++)
+                    colour |= getPixel(planes[plane], x, y) << plane;
+                *pixels++ = colour;
+            }
+        }
+    }
+}
+
+#endif // CEE_GFX_HPP
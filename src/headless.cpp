@@ -0,0 +1,391 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytes.hpp"
+#include "chip8.hpp"
+#include "gfx.hpp"
+#include "keys.hpp"
+#include "layout.hpp"
+#include "library.hpp"
+#include "pool.hpp"
+#include "replay.hpp"
+
+static void
+printUsage();
+
+static void
+printState(const cee::Chip8 & chip, uint64_t cycles, bool showGfx);
+
+int main(int argc, char ** argv)
+{
+    auto pathToRom = std::string();
+    auto cycles    = uint64_t(1000000);
+    auto untilPc   = -1;
+    auto untilBeep = false;
+    auto showGfx   = true;
+    auto backend   = cee::Backend::Interpreter;
+    auto events    = std::vector<cee::InputEvent>();
+    auto machines  = size_t(1);
+    auto threads   = size_t(0);
+    auto pin       = false;
+    auto cycleRate = cee::DEFAULT_CYCLE_RATE;
+    auto seed      = uint32_t(0);
+    auto seeded    = false;
+    auto quirks    = cee::Quirks::Modern;
+    auto replay    = std::string();
+    auto endless   = true;
+    auto profile   = std::string();
+    auto format    = std::string("text");
+
+    for (int i = 1; i < argc; i++)
+    {
+        const auto arg = std::string(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--cycles" && hasValue)
+        {
+            cycles  = std::strtoull(argv[++i], nullptr, 10);
+            endless = false;
+        }
+        else if (arg == "--until-pc" && hasValue)
+        {
+            untilPc = std::strtol(argv[++i], nullptr, 16);
+        }
+        else if (arg == "--until-beep")
+        {
+            untilBeep = true;
+        }
+        else if (arg == "--input" && hasValue)
+        {
+            if (! cee::loadInputScript(argv[++i], events))
+                return -1;
+        }
+        else if (arg == "--backend" && hasValue)
+        {
+            const auto name = std::string(argv[++i]);
+            if (name == "jit")
+                backend = cee::Backend::Jit;
+            else if (name == "aot")
+                backend = cee::Backend::Aot;
+            else if (name != "interpreter")
+            {
+                printf("Chip8 Error: Unknown backend %s\n", name.c_str());
+                return -1;
+            }
+        }
+        else if (arg == "--machines" && hasValue)
+        {
+            machines = std::max(1ull, std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--threads" && hasValue)
+        {
+            threads = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--pin")
+        {
+            pin = true;
+        }
+        else if (arg == "--cpu-hz" && hasValue)
+        {
+            char * end = nullptr;
+            const auto rate = std::strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || rate > cee::MAX_CYCLE_RATE)
+            {
+                printf("Chip8 Error: --cpu-hz takes from 0 to %u instructions per second\n", cee::MAX_CYCLE_RATE);
+                return -1;
+            }
+
+            cycleRate = static_cast<uint32_t>(rate);
+        }
+        else if (arg == "--seed" && hasValue)
+        {
+            seed   = std::strtoul(argv[++i], nullptr, 10);
+            seeded = true;
+        }
+        else if (arg == "--quirks" && hasValue)
+        {
+            if (! cee::findQuirks(argv[++i], quirks))
+            {
+                printf("Chip8 Error: Unknown quirks %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg == "--replay" && hasValue)
+        {
+            replay = argv[++i];
+        }
+        else if (arg == "--profile" && hasValue)
+        {
+            profile = argv[++i];
+        }
+        else if (arg == "--profile-as" && hasValue)
+        {
+            format = argv[++i];
+        }
+        else if (arg == "--quiet")
+        {
+            showGfx = false;
+        }
+        else if (arg[0] != '-' && pathToRom.empty())
+        {
+            pathToRom = arg;
+        }
+        else
+        {
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (pathToRom.empty())
+    {
+        printf("Chip8 Error: Wrong number of arguments\n");
+        printUsage();
+        return -1;
+    }
+
+#ifdef CEE_PROFILE
+    auto profileFormat = cee::ProfileFormat::Text;
+    if (format == "json")
+        profileFormat = cee::ProfileFormat::Json;
+    else if (format == "folded")
+        profileFormat = cee::ProfileFormat::Folded;
+    else if (format != "text")
+    {
+        printf("Chip8 Error: Unknown profile format %s\n", format.c_str());
+        return -1;
+    }
+#else
+    if (! profile.empty())
+    {
+        printf("Chip8 Error: Profiling needs a build with CEE_PROFILE defined\n");
+        return -1;
+    }
+#endif
+
+    // A replayed session brings its own seed, rate and input, and runs
+    // for as long as it was recorded unless told otherwise.
+    if (! replay.empty())
+    {
+        cee::InputLog log;
+        if (! cee::loadInputLog(replay.c_str(), log))
+            return -1;
+
+        seed      = log.seed;
+        seeded    = true;
+        cycleRate = log.cycleRate;
+        quirks    = log.quirks;
+        events.insert(events.end(), log.events.begin(), log.events.end());
+        if (endless)
+            cycles = log.cycles;
+    }
+
+    // The program is mapped rather than read, and copied into the
+    // emulators straight from the mapping.
+    cee::RomLibrary library;
+    if (! library.addFile(pathToRom.c_str()))
+        return -1;
+
+    const auto & program = library[0];
+
+    // Every emulator of the pool runs the same program and input,
+    // and the first one stands for all of them in the output. A single
+    // one is stepped right here, without any worker thread.
+    std::unique_ptr<cee::Chip8Pool> pool;
+    std::unique_ptr<cee::Chip8>     single;
+    if (machines > 1)
+        pool.reset(new cee::Chip8Pool(machines, threads, backend, pin));
+    else
+        single.reset(new cee::Chip8(backend));
+
+    auto & chip = pool ? (*pool)[0] : *single;
+    if (pool)
+    {
+        pool->setCycleRate(cycleRate);
+        pool->setQuirks(quirks);
+        if (seeded)
+            pool->setSeed(seed);
+    }
+    else
+    {
+        chip.setCycleRate(cycleRate);
+        chip.setQuirks(quirks);
+        if (seeded)
+            chip.setSeed(seed);
+    }
+
+    if (program.size >= chip.getMemorySize() - cee::PROG_OFFSET)
+    {
+        printf("Chip8 Error: Program doesn't fit in the memory of %s\n", cee::getName(quirks));
+        return -1;
+    }
+
+    if (pool)
+        pool->loadProgram(program.data, program.size);
+    else
+        chip.loadProgram(program.data, program.size);
+
+    const auto watching = untilPc >= 0 || untilBeep;
+    if (watching && machines > 1)
+    {
+        printf("Chip8 Error: Conditions can't be used with more than one machine\n");
+        return -1;
+    }
+
+    // Conditions are checked after every cycle, which only stepping the
+    // interpreter stops at, so the other backends would go unmeasured.
+    if (watching && backend != cee::Backend::Interpreter)
+    {
+        printf("Chip8 Error: Conditions can only be used with the interpreter backend\n");
+        return -1;
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const cee::InputEvent & a, const cee::InputEvent & b)
+    {
+        return a.cycle < b.cycle;
+    });
+
+    // Run up to each input change in one go, unless we're looking
+    // out for a condition which has to be checked every cycle.
+    auto next = events.begin();
+    auto done = uint64_t(0);
+
+    while (done < cycles)
+    {
+        while (next != events.end() && next->cycle <= done)
+        {
+            const auto keys = (next++)->keys;
+            if (pool)
+                pool->updateKeys(keys);
+            else
+                chip.updateKeys(keys);
+        }
+
+        auto until = cycles;
+        if (next != events.end())
+            until = std::min(until, next->cycle);
+
+        if (! watching)
+        {
+            if (pool)
+                pool->updateCycles(until - done);
+            else
+                chip.updateCycles(until - done);
+            done = until;
+            continue;
+        }
+
+        auto stop = false;
+        for (; done < until && ! stop; done++)
+        {
+            // Idling on a key or for good, the program counter stays
+            // put and no beep can start, so it's skipped to the next
+            // input change.
+            const auto idle = chip.getIdle();
+            if (idle == cee::Idle::Key || idle == cee::Idle::Halt)
+            {
+                chip.updateCycles(until - done);
+                done = until;
+                break;
+            }
+
+            chip.updateCycle();
+            stop = chip.getCounter() == untilPc || (untilBeep && chip.isBeeping());
+        }
+
+        if (stop)
+            break;
+    }
+
+    printState(chip, done, showGfx);
+
+#ifdef CEE_PROFILE
+    if (! profile.empty())
+    {
+        auto file = profile == "-" ? stdout : std::fopen(profile.c_str(), "w");
+        if (! file)
+        {
+            printf("Chip8 Error: Can't write the profile to %s\n", profile.c_str());
+            return -1;
+        }
+
+        chip.writeProfile(file, profileFormat);
+        if (file != stdout)
+            std::fclose(file);
+    }
+#endif
+
+    return 0;
+}
+
+void
+printUsage()
+{
+    printf("Usage: cee-headless [OPTIONS] FILE_PATH\n"
+           "  --cycles N        Number of cycles to run (default: 1000000)\n"
+           "  --until-pc ADDR   Stop once the program counter reaches ADDR (hex)\n"
+           "  --until-beep      Stop once the emulator starts beeping\n"
+           "                    (conditions step the interpreter, and can't be used with other backends)\n"
+           "  --input FILE      Scripted input, one \"CYCLE KEYS\" line per change\n"
+           "  --backend NAME    Execution backend: interpreter (default), jit or aot\n"
+           "  --machines N      Number of emulators run in parallel (default: 1)\n"
+           "  --threads N       Number of worker threads (default: one per core, at most one per machine)\n"
+           "  --pin             Pin each worker thread to a core of its own\n"
+           "  --cpu-hz N        Instructions per second, pacing the 60 Hz timers (default: 600)\n"
+           "  --seed N          Seed of the random generator (default: a random one)\n"
+           "  --quirks NAME     Interpreter to behave like: modern (default), vip, chip48, schip or xochip\n"
+           "  --replay FILE     Session recorded by cee --record, replacing seed, rate, quirks and input\n"
+           "  --profile FILE    Where to write the profile of the first emulator, - for the output\n"
+           "                    (only in builds made with --profile)\n"
+           "  --profile-as FMT  Profile format: text (default), json or folded\n"
+           "  --quiet           Don't print the display\n");
+}
+
+void
+printState(const cee::Chip8 & chip, uint64_t cycles, bool showGfx)
+{
+    const auto registers = chip.getRegisters();
+
+    // Low resolution comes out the same as it always did, while high
+    // resolution has twice the columns and rows.
+    const size_t width  = chip.isHires() ? cee::GFX_WIDTH : cee::LORES_WIDTH;
+    const size_t height = chip.isHires() ? cee::GFX_HEIGHT : cee::LORES_HEIGHT;
+
+    uint8_t gfx[cee::GFX_WIDTH * cee::GFX_HEIGHT];
+    cee::unpackGfx(chip.getPlanes(), chip.isHires(), gfx);
+
+    printf("cycles %llu\n", static_cast<unsigned long long>(cycles));
+    printf("pc     0x%03X\n", chip.getCounter());
+    printf("i      0x%03X\n", chip.getIndex());
+    printf("sp     %u\n", chip.getStackPointer());
+    printf("dt     %u\n", chip.getDelayTimer());
+    printf("st     %u\n", chip.getSoundTimer());
+    printf("v     ");
+    for (int i = 0; i < 16; i++)
+        printf(" %02X", registers[i]);
+    printf("\n");
+    // Hashed, the display is handy for comparing runs.
+    printf("gfx    %016llx\n", static_cast<unsigned long long>(cee::hashBytes(gfx, width * height)));
+
+    if (! showGfx)
+        return;
+
+    // Pixels of the first plane are '#', and the other colours of
+    // XO-CHIP's planes follow on.
+    static const char COLOURS[] = {'.', '#', '+', '%'};
+    static_assert(sizeof(COLOURS) == 1 << cee::GFX_PLANES, "Every colour needs a character");
+
+    for (size_t y = 0; y < height; y++)
+    {
+        char row[cee::GFX_WIDTH + 1] = {};
+        for (size_t x = 0; x < width; x++)
+            row[x] = COLOURS[gfx[y * width + x]];
+        printf("%s\n", row);
+    }
+}
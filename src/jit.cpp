@@ -0,0 +1,503 @@
+#include "jit.hpp"
+#include "chip8.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define CEE_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Size of the executable buffer, flushed whenever it runs out.
+static constexpr size_t CODE_SIZE = 1 << 20;
+
+// Encoding of the registers used by the translated code.
+static constexpr uint8_t EAX = 0;
+static constexpr uint8_t ECX = 1;
+static constexpr uint8_t EDX = 2;
+static constexpr uint8_t RBX = 3;
+static constexpr uint8_t RBP = 5;
+static constexpr uint8_t R12 = 12;
+static constexpr uint8_t R13 = 13;
+static constexpr uint8_t R14 = 14;
+static constexpr uint8_t R15 = 15;
+
+// Callee-saved registers caching the guest registers a block uses most,
+// and I. Calls to tick the timers keep them as they are, so they only
+// need writing back for the interpreter, and reading again after it.
+static constexpr uint8_t V_HOSTS[] = {RBP, R12, R13, R14};
+static constexpr uint8_t I_HOST    = R15;
+
+// Guest registers used only once or twice are quicker left in the
+// emulator, than loaded and written back.
+static constexpr uint16_t MIN_CACHED_USES = 3;
+
+// How an instruction accesses a guest register, and how far a cached
+// one is from the emulator.
+static constexpr uint8_t READ  = 1; // Read by the instruction, or loaded in the host register
+static constexpr uint8_t WRITE = 2; // Written by it, or not yet written back
+
+template <typename T>
+static int32_t offsetIn(const cee::Chip8 & chip, const T & member)
+{
+    auto base = reinterpret_cast<const uint8_t *>(&chip);
+    return static_cast<int32_t>(reinterpret_cast<const uint8_t *>(&member) - base);
+}
+
+cee::Jit::Jit(const Chip8 & chip, size_t memorySize)
+    : mCode(nullptr)
+    , mCodeSize(0)
+    , mCodeUsed(0)
+    , mBlocks(memorySize, nullptr)
+    , mRegisters(offsetIn(chip, chip.mRegisters))
+    , mIndex(offsetIn(chip, chip.mIndex))
+    , mCounter(offsetIn(chip, chip.mCounter))
+    , mPhase(offsetIn(chip, chip.mTimerPhase))
+    , mPageSize(4096)
+{
+#ifdef CEE_JIT_X64
+    mPageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+    auto code = mmap(nullptr, CODE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return;
+
+    // Hosts that forbid making pages executable once they've been written
+    // (SELinux execmem, PaX) are found out right away, and left to the
+    // interpreter, just like when the buffer can't be mapped.
+    if (mprotect(code, mPageSize, PROT_READ | PROT_WRITE) != 0 ||
+        mprotect(code, mPageSize, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, CODE_SIZE);
+        return;
+    }
+
+    mCode     = static_cast<uint8_t *>(code);
+    mCodeSize = CODE_SIZE;
+#endif
+}
+
+cee::Jit::~Jit()
+{
+#ifdef CEE_JIT_X64
+    if (mCode) munmap(mCode, mCodeSize);
+#endif
+}
+
+bool cee::Jit::isSupported()
+{
+#ifdef CEE_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+cee::Jit::Block cee::Jit::find(uint16_t address) const
+{
+    return mBlocks[address];
+}
+
+void cee::Jit::drop(uint16_t address)
+{
+    mBlocks[address] = nullptr;
+}
+
+void cee::Jit::flush()
+{
+    std::fill(mBlocks.begin(), mBlocks.end(), nullptr);
+    mCodeUsed = 0;
+}
+
+void cee::Jit::interpret(Chip8 * chip, uint64_t instruction)
+{
+    Chip8::Instruction in;
+    std::memcpy(&in, &instruction, sizeof(in));
+    chip->execute(in);
+}
+
+void cee::Jit::catchUpTimers(Chip8 * chip)
+{
+    chip->catchUpTimers();
+}
+
+cee::Jit::Block cee::Jit::compile(const Chip8 & chip, uint16_t address)
+{
+    if (! mCode)
+        return nullptr;
+
+    // The block is translated once with every guest register left in
+    // the emulator, to count how often each is used, then again with
+    // the ones used most cached in callee-saved host registers.
+    mHosts.fill(-1);
+    mUses.fill(0);
+    mStates.fill(0);
+    mBuffer.clear();
+    emitBlock(chip, address);
+
+    std::array<uint8_t, 16> order;
+    for (uint8_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](uint8_t a, uint8_t b)
+    {
+        return mUses[a] > mUses[b];
+    });
+
+    std::vector<uint8_t> saved = {RBX};
+    for (size_t i = 0; i < sizeof(V_HOSTS) && mUses[order[i]] >= MIN_CACHED_USES; i++)
+    {
+        mHosts[order[i]] = V_HOSTS[i];
+        saved.push_back(V_HOSTS[i]);
+    }
+
+    if (mUses[GUEST_I] >= MIN_CACHED_USES)
+    {
+        mHosts[GUEST_I] = I_HOST;
+        saved.push_back(I_HOST);
+    }
+
+    // The emulator is kept in RBX for the whole block. Calls into the
+    // interpreter need the stack aligned, which the pushes alone only
+    // leave it when there's an odd number of them.
+    const auto padded = saved.size() % 2 == 0;
+
+    mBuffer.clear();
+    for (const auto host : saved)
+        emitHost(0x50, host);                         // push host
+    if (padded)
+        emit({0x48, 0x83, 0xEC, 0x08});               // sub rsp, 8
+    emit({0x48, 0x89, 0xFB});                         // mov rbx, rdi
+
+    emitBlock(chip, address);
+
+    emitSpill();
+    if (padded)
+        emit({0x48, 0x83, 0xC4, 0x08});               // add rsp, 8
+    for (auto host = saved.rbegin(); host != saved.rend(); host++)
+        emitHost(0x58, *host);                        // pop host
+    emit({0xC3});                                     // ret
+
+#ifdef CEE_JIT_X64
+    if (mCodeUsed + mBuffer.size() > mCodeSize)
+        flush();
+
+    // Pages are never writable and executable at the same time. Only
+    // the ones the block lands on are made writable while it's copied.
+    const auto page  = reinterpret_cast<uintptr_t>(mCode + mCodeUsed) & ~(mPageSize - 1);
+    const auto bytes = reinterpret_cast<uintptr_t>(mCode + mCodeUsed + mBuffer.size()) - page;
+    // Blocks that can't be written are interpreted. Once pages can't be
+    // made executable again, the blocks already on them can't run either,
+    // so every block is forgotten along with the buffer, and everything
+    // is interpreted from then on.
+    if (mprotect(reinterpret_cast<void *>(page), bytes, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    std::memcpy(mCode + mCodeUsed, mBuffer.data(), mBuffer.size());
+    if (mprotect(reinterpret_cast<void *>(page), bytes, PROT_READ | PROT_EXEC) != 0)
+    {
+        flush();
+        munmap(mCode, mCodeSize);
+        mCode     = nullptr;
+        mCodeSize = 0;
+        return nullptr;
+    }
+
+    auto block = reinterpret_cast<Block>(mCode + mCodeUsed);
+    mCodeUsed += mBuffer.size();
+    mBlocks[address] = block;
+    return block;
+#else
+    return nullptr;
+#endif
+}
+
+void cee::Jit::emitBlock(const Chip8 & chip, uint16_t address)
+{
+    const auto & cache  = chip.mCache->cache;
+    const auto & ops    = *chip.mOps;
+    const auto length   = cache[address].length;
+    const uint8_t vf    = 0xF;
+    const uint8_t i16   = GUEST_I;
+    size_t     ticked   = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const uint16_t pc = address + i * 2;
+        const auto & in   = cache[pc];
+        const auto vx     = in.x;
+        const auto vy     = in.y;
+
+        // Operations are told apart by index, which every profile shares,
+        // as their handlers differ from one profile to the next.
+        const auto is = [&](uint16_t opcode)
+        {
+            return in.op == ops.index[(opcode & 0xF000) >> 4 | (opcode & 0x00FF)];
+        };
+
+        // XO-CHIP skips by however long the next instruction is, which
+        // memory past the block decides, so its skips are interpreted.
+        const auto skips = ! ops.xoChip;
+
+        if (is(0x1000))
+        {
+            emitCounter(in.nnn);
+        }
+        else if (skips && (is(0x3000) || is(0x4000)))
+        {
+            emitGuest({0x80}, 7, vx, READ);           // cmp byte [vx], nn
+            emit({in.nn});
+            emit({0xB8}); emit32(pc + 2);             // mov eax, pc + 2
+            emit({0xB9}); emit32(pc + 4);             // mov ecx, pc + 4
+            if (is(0x3000))
+                emit({0x0F, 0x44, 0xC1});             // cmove eax, ecx
+            else
+                emit({0x0F, 0x45, 0xC1});             // cmovne eax, ecx
+            emitMemory({0x66, 0x89}, EAX, mCounter);  // mov [pc], ax
+        }
+        else if (skips && (is(0x5000) || is(0x9000)))
+        {
+            emitGuest({0x8A}, EAX, vx, READ);         // mov al, [vx]
+            emitGuest({0x3A}, EAX, vy, READ);         // cmp al, [vy]
+            emit({0xB8}); emit32(pc + 2);             // mov eax, pc + 2
+            emit({0xB9}); emit32(pc + 4);             // mov ecx, pc + 4
+            if (is(0x5000))
+                emit({0x0F, 0x44, 0xC1});             // cmove eax, ecx
+            else
+                emit({0x0F, 0x45, 0xC1});             // cmovne eax, ecx
+            emitMemory({0x66, 0x89}, EAX, mCounter);  // mov [pc], ax
+        }
+        else if (is(0x6000))
+        {
+            emitGuest({0xC6}, 0, vx, WRITE);          // mov byte [vx], nn
+            emit({in.nn});
+        }
+        else if (is(0x7000))
+        {
+            emitGuest({0x80}, 0, vx, READ | WRITE);   // add byte [vx], nn
+            emit({in.nn});
+        }
+        else if (is(0x8000))
+        {
+            emitGuest({0x8A}, EAX, vy, READ);         // mov al, [vy]
+            emitGuest({0x88}, EAX, vx, WRITE);        // mov [vx], al
+        }
+        else if (is(0x8001) || is(0x8002) || is(0x8003))
+        {
+            emitGuest({0x8A}, EAX, vx, READ);         // mov al, [vx]
+            if (is(0x8001))
+                emitGuest({0x0A}, EAX, vy, READ);     // or al, [vy]
+            else if (is(0x8002))
+                emitGuest({0x22}, EAX, vy, READ);     // and al, [vy]
+            else
+                emitGuest({0x32}, EAX, vy, READ);     // xor al, [vy]
+            emitGuest({0x88}, EAX, vx, WRITE);        // mov [vx], al
+            if (ops.resetVf)
+            {
+                emitGuest({0xC6}, 0, vf, WRITE);      // mov byte [vf], 0
+                emit({0x00});
+            }
+        }
+        else if (is(0x8004) || is(0x8005) || is(0x8007))
+        {
+            // VX is written before VF, so that VF wins when X is F.
+            const auto lhs = is(0x8007) ? vy : vx;
+            const auto rhs = is(0x8007) ? vx : vy;
+            emitGuest({0x8A}, EAX, lhs, READ);        // mov al, [lhs]
+            emitGuest({0x8A}, ECX, rhs, READ);        // mov cl, [rhs]
+            if (is(0x8004))
+                emit({0x00, 0xC8, 0x0F, 0x92, 0xC2}); // add al, cl; setc dl
+            else
+                emit({0x28, 0xC8, 0x0F, 0x93, 0xC2}); // sub al, cl; setnc dl
+            emitGuest({0x88}, EAX, vx, WRITE);        // mov [vx], al
+            emitGuest({0x88}, EDX, vf, WRITE);        // mov [vf], dl
+        }
+        else if (is(0x8006) || is(0x800E))
+        {
+            // VF is set first, and the source is read again in case it's VF.
+            const auto source = ops.shiftVy ? vy : vx;
+            emitGuest({0x8A}, EAX, source, READ);     // mov al, [source]
+            if (is(0x8006))
+                emit({0x24, 0x01});                   // and al, 1
+            else
+                emit({0xC0, 0xE8, 0x07});             // shr al, 7
+            emitGuest({0x88}, EAX, vf, WRITE);        // mov [vf], al
+            emitGuest({0x8A}, EAX, source, READ);     // mov al, [source]
+            if (is(0x8006))
+                emit({0xD0, 0xE8});                   // shr al, 1
+            else
+                emit({0xD0, 0xE0});                   // shl al, 1
+            emitGuest({0x88}, EAX, vx, WRITE);        // mov [vx], al
+        }
+        else if (is(0xA000))
+        {
+            emitGuest({0x66, 0xC7}, 0, i16, WRITE);   // mov word [i], nnn
+            emit({uint8_t(in.nnn), uint8_t(in.nnn >> 8)});
+        }
+        else if (is(0xF01E))
+        {
+            // VX is read again after VF is set, same as the interpreter.
+            emitGuest({0x0F, 0xB6}, EAX, vx, READ);   // movzx eax, byte [vx]
+            emitGuest({0x0F, 0xB7}, ECX, i16, READ);  // movzx ecx, word [i]
+            emit({0x01, 0xC1});                       // add ecx, eax
+            emit({0x81, 0xF9}); emit32(0xFFF);        // cmp ecx, 0xFFF
+            emit({0x0F, 0x97, 0xC2});                 // seta dl
+            emitGuest({0x88}, EDX, vf, WRITE);        // mov [vf], dl
+            emitGuest({0x0F, 0xB6}, EAX, vx, READ);   // movzx eax, byte [vx]
+            emitGuest({0x66, 0x01}, EAX, i16, READ | WRITE); // add [i], ax
+        }
+        else if (is(0xF029))
+        {
+            emitGuest({0x0F, 0xB6}, EAX, vx, READ);   // movzx eax, byte [vx]
+            emit({0x8D, 0x04, 0x80});                 // lea eax, [rax + rax * 4]
+            emitGuest({0x66, 0x89}, EAX, i16, WRITE); // mov [i], ax
+        }
+        else
+        {
+            // Everything else goes through the interpreter, which expects
+            // the timers, the program counter and the guest registers to
+            // be up to date, and may change any of the registers.
+            uint64_t instruction;
+            std::memcpy(&instruction, &in, sizeof(in));
+
+            emitTimers(i - ticked);
+            ticked = i;
+
+            emitCounter(pc);
+            emitSpill();
+            emit({0x48, 0x89, 0xDF});                 // mov rdi, rbx
+            emit({0x48, 0xBE}); emit64(instruction);  // mov rsi, instruction
+            emit({0x48, 0xB8});                       // mov rax, interpret
+            emit64(reinterpret_cast<uint64_t>(&Jit::interpret));
+            emit({0xFF, 0xD0});                       // call rax
+
+            // Cached registers are read again as they're next used.
+            mStates.fill(0);
+            continue;
+        }
+
+        // Blocks cut short by their length don't end with a branch.
+        if (i + 1 == length && ! ops.branches[in.op])
+            emitCounter(pc + 2);
+    }
+
+    emitTimers(length - ticked);
+}
+
+void cee::Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+    mBuffer.insert(mBuffer.end(), bytes);
+}
+
+void cee::Jit::emit32(uint32_t value)
+{
+    for (size_t i = 0; i < 4; i++)
+        mBuffer.push_back(value >> (i * 8));
+}
+
+void cee::Jit::emit64(uint64_t value)
+{
+    for (size_t i = 0; i < 8; i++)
+        mBuffer.push_back(value >> (i * 8));
+}
+
+// Emits an instruction whose operand is a guest register, V0 - VF or I,
+// wherever the block keeps it. Blocks run straight through, so cached
+// registers are only loaded as they're first read.
+void cee::Jit::emitGuest(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t guest, uint8_t access)
+{
+    mUses[guest] += 1;
+
+    const auto host = mHosts[guest];
+    if (host < 0)
+    {
+        emitMemory(opcode, reg, guest == GUEST_I ? mIndex : mRegisters + guest);
+        return;
+    }
+
+    if ((access & READ) && ! (mStates[guest] & READ))
+        emitLoad(guest);                              // movzx host, [guest]
+    mStates[guest] |= READ | (access & WRITE);
+
+    // The operand size prefix goes ahead of REX, which reaches R8 - R15,
+    // and BPL rather than CH.
+    auto byte = opcode.begin();
+    if (*byte == 0x66)
+        mBuffer.push_back(*byte++);
+    mBuffer.push_back(0x40 | host >> 3);
+    mBuffer.insert(mBuffer.end(), byte, opcode.end());
+    emit({uint8_t(0xC0 | reg << 3 | (host & 7))});
+}
+
+// Emits a push or pop of a host register.
+void cee::Jit::emitHost(uint8_t opcode, uint8_t host)
+{
+    if (host >= 8)
+        emit({0x41});                                 // REX.B
+    emit({uint8_t(opcode | (host & 7))});
+}
+
+// Writes the cached guest registers changed since they were loaded back
+// to the emulator.
+void cee::Jit::emitSpill()
+{
+    for (uint8_t guest = 0; guest < mHosts.size(); guest++)
+    {
+        if (mStates[guest] & WRITE)
+            emitStore(guest);                         // mov [guest], host
+        mStates[guest] &= ~WRITE;
+    }
+}
+
+// Loads a cached guest register, zero extended so that the whole host
+// register is written. REX.R reaches the host register from the reg field.
+void cee::Jit::emitLoad(uint8_t guest)
+{
+    const auto host = mHosts[guest];
+    const auto wide = guest == GUEST_I;
+    emit({uint8_t(0x40 | (host >> 3) << 2)});
+    emitMemory({0x0F, uint8_t(wide ? 0xB7 : 0xB6)}, host & 7, wide ? mIndex : mRegisters + guest);
+}
+
+// Writes a cached guest register back to the emulator, I taking a word
+// with the operand size prefix.
+void cee::Jit::emitStore(uint8_t guest)
+{
+    const auto host = mHosts[guest];
+    const auto wide = guest == GUEST_I;
+    if (wide)
+        emit({0x66});
+    emit({uint8_t(0x40 | (host >> 3) << 2)});
+    emitMemory({uint8_t(wide ? 0x89 : 0x88)}, host & 7, wide ? mIndex : mRegisters + guest);
+}
+
+// Emits an instruction whose memory operand is [rbx + offset].
+void cee::Jit::emitMemory(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t offset)
+{
+    emit(opcode);
+    emit({uint8_t(0x83 | reg << 3)});
+    emit32(offset);
+}
+
+// Advances the timer phase by the number of instructions executed,
+// only calling out to tick the timers once it runs out.
+void cee::Jit::emitTimers(uint8_t cycles)
+{
+    if (cycles == 0)
+        return;
+
+    emitMemory({0x81}, 5, mPhase);                    // sub dword [phase], TIMER_RATE * cycles
+    emit32(TIMER_RATE * cycles);
+    emit({0x7F, 15});                                 // jg past the call
+    emit({0x48, 0x89, 0xDF});                         // mov rdi, rbx
+    emit({0x48, 0xB8});                               // mov rax, catchUpTimers
+    emit64(reinterpret_cast<uint64_t>(&Jit::catchUpTimers));
+    emit({0xFF, 0xD0});                               // call rax
+}
+
+void cee::Jit::emitCounter(uint16_t address)
+{
+    emitMemory({0x66, 0xC7}, 0, mCounter);            // mov word [pc], address
+    emit({uint8_t(address), uint8_t(address >> 8)});
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef CEE_JIT_HPP
+#define CEE_JIT_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <vector>
+#include <initializer_list>
+
+namespace cee
+{
+    class Chip8;
+
+    // Translates cached blocks of a Chip8 emulator into native x86-64 code.
+    // Operations without a translation (e.g. drawing, waiting for a key)
+    // are called through the interpreter from within the translated block.
+    // The guest registers a block uses most, and I, are kept in host
+    // registers for its length, and only written back around those calls.
+    class Jit
+    {
+    public:
+        using Block = void (*)(Chip8 *);
+
+        explicit Jit(const Chip8 & chip, size_t memorySize);
+        ~Jit();
+
+        Jit(const Jit &) = delete;
+        Jit & operator=(const Jit &) = delete;
+
+        static bool isSupported();                      // Whether the host can run translated code
+
+        Block find(uint16_t address) const;             // Translated block starting at address
+        Block compile(const Chip8 & chip, uint16_t address); // Translates the block cached at address
+        void  drop(uint16_t address);                   // Forgets the block starting at address
+        void  flush();                                  // Forgets every translated block
+    private:
+        uint8_t *            mCode;      // Executable buffer
+        size_t               mCodeSize;  // Capacity of the executable buffer
+        size_t               mCodeUsed;  // Bytes already holding translated blocks
+        std::vector<Block>   mBlocks;    // Translated blocks by start address
+        std::vector<uint8_t> mBuffer;    // Scratch buffer for emitting a block
+
+        int32_t              mRegisters; // Offset of V0 within the emulator
+        int32_t              mIndex;     // Offset of I within the emulator
+        int32_t              mCounter;   // Offset of PC within the emulator
+        int32_t              mPhase;     // Offset of the timer phase within the emulator
+        uintptr_t            mPageSize;  // Granularity of the protection of the buffer
+
+        // Guest registers are numbered as V0 - VF, then I.
+        static constexpr uint8_t GUEST_I = 16;
+
+        std::array<int8_t, 17>   mHosts; // Host register caching each guest register in the block being compiled, -1 if none
+        std::array<uint16_t, 17> mUses;  // Times the block being compiled uses each guest register
+        std::array<uint8_t, 17>  mStates; // Whether each cached guest register is loaded and written to, so far into the block
+
+        // Executes an instruction the block has no translation for.
+        static void interpret(Chip8 * chip, uint64_t instruction);
+
+        // Ticks the timers once the phase runs out.
+        static void catchUpTimers(Chip8 * chip);
+
+        void emit(std::initializer_list<uint8_t> bytes);
+        void emit32(uint32_t value);
+        void emit64(uint64_t value);
+        void emitBlock(const Chip8 & chip, uint16_t address);
+        void emitMemory(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t offset);
+        void emitGuest(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t guest, uint8_t access);
+        void emitHost(uint8_t opcode, uint8_t host);
+        void emitSpill();
+        void emitLoad(uint8_t guest);
+        void emitStore(uint8_t guest);
+        void emitTimers(uint8_t cycles);
+        void emitCounter(uint16_t address);
+    };
+}
+
+#endif // CEE_JIT_HPP
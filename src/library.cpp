@@ -0,0 +1,262 @@
+#include "library.hpp"
+#include "bytes.hpp"
+#include "files.hpp"
+#include "chip8.hpp"
+#include "layout.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Programs have to fit in memory after the interpreter's area, which
+// for XO-CHIP's is 64K.
+static constexpr size_t MAX_PROGRAM_SIZE = cee::MAX_MEMORY_SIZE - cee::PROG_OFFSET;
+
+// Archives start with this header, then an entry per program giving
+// the offset and size of its bytes, and its name, one after the other.
+// The programs follow. Numbers are stored little-endian.
+static constexpr char     ARCHIVE_MAGIC[4]    = {'C', 'E', 'E', 'A'};
+static constexpr uint32_t ARCHIVE_VERSION     = 1;
+static constexpr size_t   ARCHIVE_HEADER_SIZE = 12;
+static constexpr size_t   ARCHIVE_ENTRY_SIZE  = 10; // Not counting the name
+
+static std::string
+getFileName(const std::string & path);
+
+cee::RomLibrary::RomLibrary()
+{
+}
+
+cee::RomLibrary::~RomLibrary()
+{
+    for (const auto & mapping : mMappings)
+        munmap(mapping.address, mapping.size);
+}
+
+bool cee::RomLibrary::add(const char * path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        printf("Chip8 Error: Can't find %s\n", path);
+        return false;
+    }
+
+    if (S_ISDIR(info.st_mode))
+        return addDirectory(path);
+
+    // Archives are told apart from programs by their magic number.
+    char magic[sizeof(ARCHIVE_MAGIC)] = {};
+    if (auto file = std::fopen(path, "rb"))
+    {
+        const auto read = std::fread(magic, 1, sizeof(magic), file);
+        std::fclose(file);
+
+        if (read == sizeof(magic) && std::memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) == 0)
+            return addArchive(path);
+    }
+
+    return addFile(path);
+}
+
+bool cee::RomLibrary::addFile(const char * path)
+{
+    size_t size = 0;
+    const auto data = map(path, size);
+    if (! data)
+        return false;
+
+    if (size >= MAX_PROGRAM_SIZE)
+    {
+        printf("Chip8 Error: %s is too big to be a program\n", path);
+        return false;
+    }
+
+    insert(data, size, getFileName(path));
+    return true;
+}
+
+bool cee::RomLibrary::addDirectory(const char * path)
+{
+    auto directory = opendir(path);
+    if (! directory)
+    {
+        printf("Chip8 Error: Can't open directory %s\n", path);
+        return false;
+    }
+
+    // Entries come in no particular order, so they're sorted to keep
+    // the order of the programs the same from one run to the next.
+    auto paths = std::vector<std::string>();
+    while (auto entry = readdir(directory))
+    {
+        const auto file = std::string(path) + "/" + entry->d_name;
+
+        struct stat info;
+        if (entry->d_name[0] != '.' && stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+            paths.push_back(file);
+    }
+
+    closedir(directory);
+    std::sort(paths.begin(), paths.end());
+
+    // A file that isn't a program doesn't spoil the rest.
+    for (const auto & file : paths)
+        add(file.c_str());
+
+    return true;
+}
+
+bool cee::RomLibrary::addArchive(const char * path)
+{
+    size_t size = 0;
+    const auto data = map(path, size);
+    if (! data)
+        return false;
+
+    if (size < ARCHIVE_HEADER_SIZE
+        || std::memcmp(data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+        || cee::getNumber(data + 4, 4) != ARCHIVE_VERSION)
+    {
+        printf("Chip8 Error: %s isn't a supported archive\n", path);
+        return false;
+    }
+
+    const auto count = cee::getNumber(data + 8, 4);
+    auto entry = ARCHIVE_HEADER_SIZE;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entry + ARCHIVE_ENTRY_SIZE > size)
+        {
+            printf("Chip8 Error: Archive %s is truncated\n", path);
+            return false;
+        }
+
+        const auto offset     = cee::getNumber(data + entry, 4);
+        const auto length     = cee::getNumber(data + entry + 4, 4);
+        const auto nameLength = cee::getNumber(data + entry + 8, 2);
+        const auto name       = entry + ARCHIVE_ENTRY_SIZE;
+        entry = name + nameLength;
+
+        if (entry > size || offset + length > size || length >= MAX_PROGRAM_SIZE)
+        {
+            printf("Chip8 Error: Archive %s is corrupt\n", path);
+            return false;
+        }
+
+        insert(data + offset, length, std::string(reinterpret_cast<const char *>(data + name), nameLength));
+    }
+
+    return true;
+}
+
+bool cee::RomLibrary::saveArchive(const char * path) const
+{
+    auto out = std::vector<uint8_t>(ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof(ARCHIVE_MAGIC));
+    cee::putNumber(out, ARCHIVE_VERSION, 4);
+    cee::putNumber(out, mRoms.size(), 4);
+
+    auto offset = ARCHIVE_HEADER_SIZE;
+    for (const auto & rom : mRoms)
+        offset += ARCHIVE_ENTRY_SIZE + std::min<size_t>(rom.name.size(), UINT16_MAX);
+
+    for (const auto & rom : mRoms)
+    {
+        const auto nameLength = std::min<size_t>(rom.name.size(), UINT16_MAX);
+        cee::putNumber(out, offset, 4);
+        cee::putNumber(out, rom.size, 4);
+        cee::putNumber(out, nameLength, 2);
+        out.insert(out.end(), rom.name.begin(), rom.name.begin() + nameLength);
+        offset += rom.size;
+    }
+
+    for (const auto & rom : mRoms)
+        out.insert(out.end(), rom.data, rom.data + rom.size);
+
+    return cee::writeAllBytes(path, out);
+}
+
+size_t cee::RomLibrary::size() const
+{
+    return mRoms.size();
+}
+
+const cee::Rom & cee::RomLibrary::operator[](size_t index) const
+{
+    assert(index < mRoms.size());
+    return mRoms[index];
+}
+
+const cee::Rom * cee::RomLibrary::find(uint64_t hash) const
+{
+    const auto found = mByHash.find(hash);
+    return found == mByHash.end() ? nullptr : &mRoms[found->second];
+}
+
+const uint8_t * cee::RomLibrary::map(const char * path, size_t & size)
+{
+    const auto file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        printf("Chip8 Error: Can't open %s\n", path);
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        printf("Chip8 Error: %s is empty\n", path);
+        close(file);
+        return nullptr;
+    }
+
+    size = static_cast<size_t>(info.st_size);
+    const auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    if (address == MAP_FAILED)
+    {
+        printf("Chip8 Error: Can't map %s\n", path);
+        return nullptr;
+    }
+
+    mMappings.push_back({address, size});
+    return static_cast<const uint8_t *>(address);
+}
+
+bool cee::RomLibrary::insert(const uint8_t * data, size_t size, const std::string & name)
+{
+    const auto digest = cee::hashBytes(data, size);
+
+    // Hashes only stand for the contents as long as they don't collide.
+    const auto found = mByHash.find(digest);
+    if (found != mByHash.end())
+    {
+        const auto & rom = mRoms[found->second];
+        if (rom.size == size && std::memcmp(rom.data, data, size) == 0)
+            return false;
+    }
+    else
+    {
+        mByHash.emplace(digest, mRoms.size());
+    }
+
+    mRoms.push_back({data, size, digest, name});
+    return true;
+}
+
+std::string
+getFileName(const std::string & path)
+{
+    const auto slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef CEE_LIBRARY_HPP
+#define CEE_LIBRARY_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cee
+{
+    // Program held by a library, straight from the file it's mapped from.
+    struct Rom
+    {
+        const uint8_t * data; // Bytes of the program, read-only
+        size_t          size; // Number of bytes
+        uint64_t        hash; // Hash of the bytes
+        std::string     name; // File name it was first found under
+    };
+
+    // Collection of programs, memory mapped from files, directories or
+    // archives rather than read in. Programs found more than once are
+    // only kept the first time, going by their content. Loading one
+    // into an emulator then copies it straight from the mapping.
+    // Mappings stay until the library is gone, along with the Roms.
+    class RomLibrary
+    {
+    public:
+        explicit RomLibrary();
+        ~RomLibrary();
+
+        RomLibrary(const RomLibrary &) = delete;
+        RomLibrary & operator=(const RomLibrary &) = delete;
+
+        bool add(const char * path);                     // Adds a file, archive or directory, whichever path is
+        bool addFile(const char * path);                 // Adds a single program
+        bool addDirectory(const char * path);            // Adds every program of a directory, not looking further down
+        bool addArchive(const char * path);              // Adds every program of an archive
+        bool saveArchive(const char * path) const;       // Packs every program into an archive
+
+        size_t           size() const;                   // Number of programs
+        const cee::Rom & operator[](size_t index) const; // Program at index, in the order they were added
+        const cee::Rom * find(uint64_t hash) const;      // Program with the given hash, null if there's none
+    private:
+        // Region of a file mapped into memory.
+        struct Mapping
+        {
+            void * address;
+            size_t size;
+        };
+
+        std::vector<cee::Rom>                mRoms;     // Programs, without duplicates
+        std::unordered_map<uint64_t, size_t> mByHash;   // Index of the programs by hash
+        std::vector<Mapping>                 mMappings; // Files mapped
+
+        const uint8_t * map(const char * path, size_t & size); // Maps a whole file, null on failure
+        bool            insert(const uint8_t * data, size_t size, const std::string & name); // Adds a program unless it's a duplicate
+    };
+}
+
+#endif // CEE_LIBRARY_HPP
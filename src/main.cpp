@@ -3,70 +3,75 @@
 
 #include <SFML/Audio.hpp>
 
-#include <glm/mat4x4.hpp>
-#include <glm/vec3.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
+#include <cctype>
+#include <cmath>
 #include <cstdlib>
 #include <cassert>
 
-#include <map>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>
+#include <vector>
 #include <iostream>
-#include <fstream>
 
 #include "chip8.hpp"
+#include "files.hpp"
 #include "keys.hpp"
+#include "layout.hpp"
+#include "renderer.hpp"
+#include "replay.hpp"
+#include "rewind.hpp"
+#include "runner.hpp"
+
+// Keyboard keys standing for the CHIP-8 keys 0 - F, by layout.
+struct Keymap
+{
+    const char * name;
+    int          keys[16];
+};
 
-static GLFWwindow *
-setupWindow(int width, int height, const char * title);
-
-static std::vector<uint8_t>
-readAllBytes(const char * path);
+// Key states of a window, kept up to date by its key callback, which
+// passes every change on to the emulator as it happens.
+struct Input
+{
+    std::array<int8_t, GLFW_KEY_LAST + 1> layout; // CHIP-8 key of every keyboard key, -1 for none
+    cee::Keys                             keys;   // Current key states
+    cee::Runner *                         runner; // Emulator the keys go to, if running
+};
 
-static std::string
-readAllChars(const char * path);
+static GLFWwindow *
+setupWindow(int width, int height, const char * title, Input * input);
 
-static cee::Keys
-getKeyStates(GLFWwindow * window);
+static bool
+setKeymap(const std::string & name, Input & input);
 
-static GLuint
-makeShader(GLenum type, const std::string & src);
+static bool
+loadPattern(sf::SoundBuffer & buffer, const std::array<uint8_t, 16> & pattern, uint8_t pitch);
 
-static GLuint
-makeProgram(std::vector<GLuint> shaders);
+static void
+printLatency(std::vector<double> & latencies);
 
-static std::map<int, uint8_t>
-keyboardLayout
+// GLFW names keys after where they are on a US keyboard, so keymaps
+// stand for the same keys whatever the layout. The keypad takes the
+// place of the COSMAC VIP's 4 x 4 one, on the left of the keyboard,
+// and the numpad has the digits on its own and A - F around them.
+static constexpr Keymap
+KEYMAPS[] =
 {
-    {GLFW_KEY_X, 0},
-    {GLFW_KEY_1, 1},
-    {GLFW_KEY_2, 2},
-    {GLFW_KEY_3, 3},
-    {GLFW_KEY_Q, 4},
-    {GLFW_KEY_W, 5},
-    {GLFW_KEY_E, 6},
-    {GLFW_KEY_A, 7},
-    {GLFW_KEY_S, 8},
-    {GLFW_KEY_D, 9},
-    {GLFW_KEY_Z, 0xA},
-    {GLFW_KEY_C, 0xB},
-    {GLFW_KEY_4, 0xC},
-    {GLFW_KEY_R, 0xD},
-    {GLFW_KEY_F, 0xE},
-    {GLFW_KEY_V, 0xF}
+    {"keypad", {GLFW_KEY_X, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3,
+                GLFW_KEY_Q, GLFW_KEY_W, GLFW_KEY_E, GLFW_KEY_A,
+                GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_Z, GLFW_KEY_C,
+                GLFW_KEY_4, GLFW_KEY_R, GLFW_KEY_F, GLFW_KEY_V}},
+    {"numpad", {GLFW_KEY_KP_0, GLFW_KEY_KP_1, GLFW_KEY_KP_2, GLFW_KEY_KP_3,
+                GLFW_KEY_KP_4, GLFW_KEY_KP_5, GLFW_KEY_KP_6, GLFW_KEY_KP_7,
+                GLFW_KEY_KP_8, GLFW_KEY_KP_9, GLFW_KEY_KP_DIVIDE, GLFW_KEY_KP_MULTIPLY,
+                GLFW_KEY_KP_SUBTRACT, GLFW_KEY_KP_ADD, GLFW_KEY_KP_ENTER, GLFW_KEY_KP_DECIMAL}}
 };
 
-static inline float
-mapRangeWidth(float index);
-
-static inline float
-mapRangeHeight(float index);
-
-static std::map<GLFWwindow *, uint8_t>
-lastKeyPressed;
-
 static constexpr int
 WIDTH = 800;
 
@@ -76,23 +81,102 @@ HEIGHT = 400;
 static constexpr const char *
 TITLE = "Chip8 Emulator";
 
-static constexpr float
-PX_WIDTH = (1.0f / WIDTH) * (WIDTH / 64.0f);
+static constexpr double
+FRAME_TIME = 1.0 / 60.0;
 
-static constexpr float
-PX_HEIGHT = (1.0f / HEIGHT) * (HEIGHT / 32.0f);
+// Longest sleep while the program waits on a key, short of the lag the
+// scheduler drops, so that its timers still keep up.
+static constexpr double
+IDLE_WAIT = 0.2;
 
 int main(int argc, char ** argv)
 {
     auto pathToRom = std::string();
-
-    if (argc == 2)
+    auto cycleRate = cee::DEFAULT_CYCLE_RATE;
+    auto seed      = std::random_device()();
+    auto record    = std::string();
+    auto rewindFor = 60.0;
+    auto keymap    = std::string("keypad");
+    auto quirks    = cee::Quirks::Modern;
+    auto serial    = false;
+    auto latency   = false;
+
+    for (int i = 1; i < argc; i++)
     {
-        pathToRom = argv[1];
+        const auto arg = std::string(argv[i]);
+
+        if (arg == "--cpu-hz" && i + 1 < argc)
+        {
+            char * end = nullptr;
+            const auto rate = std::strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || rate > cee::MAX_CYCLE_RATE)
+            {
+                printf("Chip8 Error: --cpu-hz takes from 0 to %u instructions per second\n", cee::MAX_CYCLE_RATE);
+                return -1;
+            }
+
+            cycleRate = static_cast<uint32_t>(rate);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            record = argv[++i];
+        }
+        else if (arg == "--rewind" && i + 1 < argc)
+        {
+            rewindFor = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--keymap" && i + 1 < argc)
+        {
+            keymap = argv[++i];
+        }
+        else if (arg == "--quirks" && i + 1 < argc)
+        {
+            if (! cee::findQuirks(argv[++i], quirks))
+            {
+                printf("Chip8 Error: Unknown quirks %s\n", argv[i]);
+                constexpr auto PROFILES = sizeof(cee::QUIRKS_NAMES) / sizeof(cee::QUIRKS_NAMES[0]);
+                printf("Quirks are");
+                for (size_t q = 0; q < PROFILES; q++)
+                    printf("%s%s", q == 0 ? " " : q + 1 == PROFILES ? " or " : ", ", cee::QUIRKS_NAMES[q]);
+                printf("\n");
+                return -1;
+            }
+        }
+        else if (arg == "--serial")
+        {
+            serial = true;
+        }
+        else if (arg == "--latency")
+        {
+            latency = true;
+        }
+        else if (arg[0] != '-' && pathToRom.empty())
+        {
+            pathToRom = arg;
+        }
+        else
+        {
+            pathToRom.clear();
+            break;
+        }
     }
-    else
+
+    if (pathToRom.empty())
     {
         printf("Chip8 Error: Wrong number of arguments\n");
+        printf("Usage: cee [--cpu-hz N] [--seed N] [--record FILE] [--rewind SECONDS] [--keymap LAYOUT] [--quirks NAME] [--serial] [--latency] FILE_PATH\n");
+        return -1;
+    }
+
+    Input input;
+    if (! setKeymap(keymap, input))
+    {
+        printf("Chip8 Error: Unknown keymap %s\n", keymap.c_str());
+        printf("Keymaps are keypad, numpad, or the 16 keys standing for 0 - F\n");
         return -1;
     }
 
@@ -107,115 +191,156 @@ int main(int argc, char ** argv)
     sndSrc.setBuffer(beepSnd);
     sndSrc.setLoop(false);
 
-    auto window = setupWindow(WIDTH, HEIGHT, TITLE);
+    auto window = setupWindow(WIDTH, HEIGHT, TITLE, &input);
 
+    // The seed is always set, so that a recorded session can be replayed.
     cee::Chip8 chip;
-    chip.loadProgram(readAllBytes(pathToRom.c_str()));
+    chip.setSeed(seed);
+    chip.setQuirks(quirks);
 
-    constexpr GLfloat pxVerts[] =
+    const auto program = cee::readAllBytes(pathToRom.c_str());
+    if (program.size() >= chip.getMemorySize() - cee::PROG_OFFSET)
     {
-        -1.0f,  1.0f, 0.0f, // Top Left
-         1.0f,  1.0f, 0.0f, // Top Right
-        -1.0f, -1.0f, 0.0f, // Bottom Left
-         1.0f, -1.0f, 0.0f  // Bottom Right
-    };
+        printf("Chip8 Error: Program doesn't fit in the memory of %s\n", cee::getName(quirks));
+        return -1;
+    }
 
-    constexpr GLuint pxIndices[] =
-    {
-        0, 1, 2,
-        2, 1, 3
-    };
+    chip.loadProgram(program);
 
-    // Initialize the VAO and other buffers associated
-    // with drawing an emulated pixel.
-    GLuint vao, vbo, ibo;
-    glGenVertexArrays(1, &vao);
+    // XO-CHIP programs play a pattern of their own for as long as the
+    // sound timer runs, rather than the beep.
+    const auto playsPattern = quirks == cee::Quirks::XoChip;
+    sf::SoundBuffer patternSnd;
+    auto pattern = std::array<uint8_t, 16>();
+    auto pitch   = -1;
 
-    glBindVertexArray(vao);
+    // Kept in a scope of its own, so that it's gone before GL is.
     {
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ibo);
+        cee::Renderer renderer;
+        if (! renderer.isValid())
+        {
+            printf("Chip8 Error: Can't set up the renderer.\n");
+            return -1;
+        }
 
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(pxVerts), &pxVerts, GL_STATIC_DRAW);
+        using Clock = std::chrono::steady_clock;
 
-        // IBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pxIndices), &pxIndices, GL_STATIC_DRAW);
+        // Key changes are logged against the cycle they take effect at.
+        cee::InputRecorder recorder(seed, cycleRate, quirks);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
-        glEnableVertexAttribArray(0);
-    }
-    glBindVertexArray(0);
+        // Frames are kept for rewinding while Backspace is held, unless
+        // the session is being recorded, as replays only go forwards.
+        std::unique_ptr<cee::Rewind> timeline;
+        if (rewindFor * 60.0 >= 1.0 && record.empty())
+            timeline.reset(new cee::Rewind(static_cast<size_t>(rewindFor * 60.0)));
 
-    // Current Vertex Shader
-    const auto pxVertexSrc = readAllChars("data/shaders/px_vertex.glsl");
-    const auto pxVertex = makeShader(GL_VERTEX_SHADER, pxVertexSrc);
+        // The CPU runs at its own rate, however often frames are drawn,
+        // on a thread of its own unless asked to share this one. Each
+        // frame it publishes wakes this thread up to present it.
+        cee::Runner runner(chip, cycleRate, &recorder, timeline.get());
+        input.runner = &runner;
 
-    // Current Fragment Shader
-    const auto pxFragmentSrc = readAllChars("data/shaders/px_fragment.glsl");
-    const auto pxFragment = makeShader(GL_FRAGMENT_SHADER, pxFragmentSrc);
+        if (! serial)
+            runner.start([] { glfwPostEmptyEvent(); });
 
-    // Current Shader Program
-    const auto pxProgram = makeProgram({pxVertex, pxFragment});
-    glUseProgram(pxProgram);
+        // Time from a key change to the swap of the first frame it
+        // changed, in milliseconds.
+        auto latencies  = std::vector<double>();
+        auto shown      = uint64_t(0);
+        auto shownInput = int64_t(0);
 
-    glfwShowWindow(window);
-    while (! glfwWindowShouldClose(window))
-    {
-        chip.updateKeys(getKeyStates(window));
-        chip.updateCycle();
+        // Unthrottled, frames already take as long as they can.
+        glfwSwapInterval(cycleRate > 0 ? 1 : 0);
+
+        glfwShowWindow(window);
+        while (! glfwWindowShouldClose(window))
+        {
+            const auto frameStart = Clock::now();
 
-        if (chip.isBeeping() && sndSrc.getStatus() != sf::SoundSource::Playing)
-            sndSrc.play();
+            if (serial)
+                runner.step();
 
-        // Clear back buffer and background color.
-        glClear(GL_COLOR_BUFFER_BIT);
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            const auto fresh   = runner.updateFrame();
+            const auto & frame = runner.getFrame();
 
-        glBindVertexArray(vao);
-        const auto gfx = chip.getGfx();
-        for (int i = 0; i < 32; ++i)
-        {
-            // Maps the width resolution [0-HEIGHT] to [-1.0-1.0]
-            auto y = - mapRangeHeight(i);
-            auto l = i * 64;
+            if (fresh && playsPattern)
+            {
+                // Changing the buffer stops the sound, which carries on
+                // with the new one below if still beeping.
+                if (frame.pattern != pattern || frame.pitch != pitch)
+                {
+                    pattern = frame.pattern;
+                    pitch   = frame.pitch;
+                    if (loadPattern(patternSnd, pattern, pitch))
+                    {
+                        sndSrc.setBuffer(patternSnd);
+                        sndSrc.setLoop(true);
+                    }
+                }
 
-            for (int j = 0; j < 64; ++j)
+                const auto playing = sndSrc.getStatus() == sf::SoundSource::Playing;
+                if (frame.beeping && ! playing)
+                    sndSrc.play();
+                else if (! frame.beeping && playing)
+                    sndSrc.stop();
+            }
+            else if (fresh && frame.beeping && sndSrc.getStatus() != sf::SoundSource::Playing)
             {
-                if (gfx[l + j] == 1)
+                sndSrc.play();
+            }
+
+            // Only draw and swap when the program changed the display,
+            // which includes the first frame after loading it.
+            if (frame.display != shown)
+            {
+                shown = frame.display;
+
+                // Clear back buffer and background color.
+                glClear(GL_COLOR_BUFFER_BIT);
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+                renderer.draw(frame.planes, frame.hires);
+                glfwSwapBuffers(window);
+
+                if (frame.inputTime != 0 && frame.inputTime != shownInput)
                 {
-                    // Maps the width resolution [0-WIDTH] to [-1.0-1.0]
-                    auto x = mapRangeWidth(j);
-                    auto ident = glGetUniformLocation(pxProgram, "PxModel");
-                    auto model = glm::mat4(1.0f);
-                    model = glm::translate(model, glm::vec3(x, y, 0.0f));
-                    model = glm::scale(model, glm::vec3(PX_WIDTH, PX_HEIGHT, 1.0f));
-                    glUniformMatrix4fv(ident, 1, GL_FALSE, glm::value_ptr(model));
-                    glDrawElements(GL_TRIANGLES, sizeof(pxIndices), GL_UNSIGNED_INT, nullptr);
+                    shownInput = frame.inputTime;
+                    latencies.push_back((cee::Runner::getTime() - frame.inputTime) / 1e6);
                 }
             }
+            else if (! serial || ((frame.idle == cee::Idle::Key || frame.idle == cee::Idle::Halt) && ! frame.beeping))
+            {
+                // Nothing changes until there's a new frame or a key
+                // does, so sleep until there's an event.
+                glfwWaitEventsTimeout(IDLE_WAIT);
+                continue;
+            }
+            else if (cycleRate > 0 || frame.idle != cee::Idle::None)
+            {
+                // Nothing to draw, so there's no vsync to wait on either.
+                std::this_thread::sleep_until(frameStart + std::chrono::duration<double>(FRAME_TIME));
+            }
+
+            glfwPollEvents();
         }
-        glBindVertexArray(0);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        runner.stop();
+        input.runner = nullptr;
+
+        if (! record.empty() && ! cee::saveInputLog(record.c_str(), recorder.finish(runner.getCycles())))
+            printf("Chip8 Error: Can't save the session to %s\n", record.c_str());
+
+        if (latency)
+            printLatency(latencies);
     }
 
     // Cleanup resources
-    glDeleteProgram(pxProgram);
-    glDeleteShader(pxVertex);
-    glDeleteShader(pxFragment);
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &ibo);
-    glDeleteBuffers(1, &vbo);
     glfwTerminate();
     return 0;
 }
 
 GLFWwindow *
-setupWindow(int width, int height, const char * title)
+setupWindow(int width, int height, const char * title, Input * input)
 {
     glfwSetErrorCallback([](int err, const char * desc)
     {
@@ -239,8 +364,8 @@ setupWindow(int width, int height, const char * title)
 
     glfwMakeContextCurrent(window);
 
-    // Register window to its own last key press state.
-    lastKeyPressed.emplace(window, GLFW_KEY_UNKNOWN);
+    // Key states are kept with the window they come from.
+    glfwSetWindowUserPointer(window, input);
 
     // Callback Parameters.
     // k: Key
@@ -254,10 +379,34 @@ setupWindow(int width, int height, const char * title)
             glfwSetWindowShouldClose(w, GL_TRUE);
         }
 
-        if (keyboardLayout.count(k) && a == GLFW_PRESS)
+        const auto input = static_cast<Input *>(glfwGetWindowUserPointer(w));
+        if (k == GLFW_KEY_BACKSPACE && a != GLFW_REPEAT && input->runner)
         {
-            lastKeyPressed[w] = keyboardLayout[k];
+            input->runner->setRewinding(a == GLFW_PRESS);
         }
+
+        if (k < 0 || k > GLFW_KEY_LAST || input->layout[k] < 0)
+        {
+            return;
+        }
+
+        const auto key = input->layout[k];
+        if (a == GLFW_PRESS)
+        {
+            input->keys.keysPressed   |= 1 << key;
+            input->keys.lastKeyPressed = key;
+        }
+        else if (a == GLFW_RELEASE)
+        {
+            input->keys.keysPressed &= ~(1 << key);
+        }
+        else
+        {
+            return;
+        }
+
+        if (input->runner)
+            input->runner->setKeys(input->keys);
     });
 
 
@@ -279,117 +428,72 @@ setupWindow(int width, int height, const char * title)
     return window;
 }
 
-cee::Keys
-getKeyStates(GLFWwindow * window)
+// Keymaps are either one of the known ones, or the 16 keys standing for
+// 0 - F, as typed on a US keyboard.
+bool
+setKeymap(const std::string & name, Input & input)
 {
-    cee::Keys keys;
+    input.layout.fill(-1);
+    input.keys   = {};
+    input.runner = nullptr;
 
-    for (auto & pair : keyboardLayout)
+    for (const auto & keymap : KEYMAPS)
     {
-        auto state = pair.first;
-        auto index = pair.second;
-        auto offset = (1 << index);
-        auto result = (glfwGetKey(window, state) == GLFW_PRESS ? offset : 0);
-        keys.keysPressed |= result;
+        if (name == keymap.name)
+        {
+            for (int i = 0; i < 16; i++)
+                input.layout[keymap.keys[i]] = i;
+            return true;
+        }
     }
 
-    keys.lastKeyPressed = lastKeyPressed[window];
-
-    return keys;
-}
+    if (name.size() != 16)
+        return false;
 
-std::vector<uint8_t>
-readAllBytes(const char * path)
-{
-    try
-    {
-        std::ifstream file;
-        file.exceptions(std::ios::failbit);
-        file.open(path, std::ios::binary|std::ios::ate);
-        auto length = file.tellg();
-        std::vector<uint8_t> result(length);
-        file.seekg(0, std::ios::beg);
-        file.read((char*)&result[0], length);
-        file.close();
-        return result;
-    }
-    catch (std::ios_base::failure & err)
+    // Printable keys have the code of their uppercase character.
+    for (int i = 0; i < 16; i++)
     {
-        std::cerr << "File Error: Can't open file with path: " << path << "\n";
-    }
-    catch (std::bad_alloc & err)
-    {
-        std::cerr << "File Error: Can't open file with path: " << path << "\n";
+        const auto key = std::toupper(static_cast<unsigned char>(name[i]));
+        if (key < GLFW_KEY_SPACE || key > GLFW_KEY_GRAVE_ACCENT)
+            return false;
+        input.layout[key] = i;
     }
 
-    return {};
+    return true;
 }
 
-std::string
-readAllChars(const char * path)
+// Turns XO-CHIP's pattern of 128 bits into samples, played at 4000 Hz
+// for a pitch of 64, and an octave higher or lower every 48 from there.
+bool
+loadPattern(sf::SoundBuffer & buffer, const std::array<uint8_t, 16> & pattern, uint8_t pitch)
 {
-    try
-    {
-        std::ifstream file;
-        file.exceptions(std::ios::failbit);
-        file.open(path, std::ios::ate);
-        auto length = file.tellg();
-        std::string result(length, ' ');
-        file.seekg(0, std::ios::beg);
-        file.read(&result[0], length);
-        file.close();
-        return result;
-    }
-    catch (std::ios_base::failure & err)
-    {
-        std::cerr << "File Error: Can't open file with path: " << path << "\n";
-    }
-    catch (std::bad_alloc & err)
-    {
-        std::cerr << "File Error: Can't open file with path: " << path << "\n";
-    }
-
-    return "";
-}
+    std::array<sf::Int16, 128> samples;
+    for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = (pattern[i / 8] >> (7 - i % 8)) & 1 ? 8000 : -8000;
 
-GLuint
-makeShader(GLenum type, const std::string & src)
-{
-    const auto id = glCreateShader(type);
-    const auto cp = src.c_str();
-    glShaderSource(id, 1, &cp, nullptr);
-    glCompileShader(id);
-    return id;
+    const auto rate = 4000.0 * std::pow(2.0, (pitch - 64) / 48.0);
+    return buffer.loadFromSamples(samples.data(), samples.size(), 1, static_cast<unsigned int>(rate));
 }
 
-GLuint
-makeProgram(std::vector<GLuint> shaders)
+// Sums up the times from key changes to the frames showing them.
+void
+printLatency(std::vector<double> & latencies)
 {
-    const auto id = glCreateProgram();
-
-    for (const auto s : shaders)
-        glAttachShader(id, s);
-
-    glLinkProgram(id);
-    return id;
-}
+    if (latencies.empty())
+    {
+        printf("Input to photon: no key change changed the display\n");
+        return;
+    }
 
+    std::sort(latencies.begin(), latencies.end());
 
-float
-mapRangeWidth(float index)
-{
-    constexpr auto h = static_cast<float>(WIDTH);
-    constexpr auto x = 2.0f / h;
-    constexpr auto s = h / 64.0f;
-    return (x * index * s) - 0.98f;
-}
+    auto total = 0.0;
+    for (const auto latency : latencies)
+        total += latency;
 
-float
-mapRangeHeight(float index)
-{
-    constexpr auto h = static_cast<float>(HEIGHT);
-    constexpr auto x = 2.0f / h;
-    constexpr auto s = h / 32.0f;
-    return (x * index * s) - 0.96f;
+    printf("Input to photon: %zu changes, mean %.1f ms, median %.1f ms, 95th percentile %.1f ms, max %.1f ms\n",
+           latencies.size(), total / latencies.size(),
+           latencies[latencies.size() / 2],
+           latencies[latencies.size() * 95 / 100],
+           latencies.back());
 }
-
@@ -0,0 +1,286 @@
+#include "pool.hpp"
+
+#include <cstdio>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Tasks handed to each worker per round, so that there's something
+// left to steal when the emulators don't all run at the same speed.
+static constexpr size_t TASKS_PER_WORKER = 8;
+
+static uint64_t packRange(uint64_t begin, uint64_t end)
+{
+    return begin << 32 | end;
+}
+
+cee::Chip8Pool::Chip8Pool(size_t machines, size_t threads, cee::Backend backend, bool pin)
+    : mTaskSize(1)
+    , mCycles(0)
+    , mRound(0)
+    , mBusy(0)
+    , mStopping(false)
+{
+    // Emulators are lent their memory as they're made, so that the
+    // memory they had of their own is reused by the next one.
+    mMachines.reserve(machines);
+    for (size_t i = 0; i < machines; i++)
+    {
+        mMachines.emplace_back(backend);
+
+        const auto size = mMachines[i].getMemorySize();
+        if (i == 0)
+            mArena.resize(machines * size);
+
+        mMachines[i].mMemory.lend(&mArena[i * size]);
+    }
+
+    // There's no use for more workers than emulators.
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, machines));
+
+    mTaskSize = std::max<size_t>(1, machines / (threads * TASKS_PER_WORKER));
+    mQueues.reset(new std::atomic<uint64_t>[threads]);
+    mWorkers.reserve(threads);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        mQueues[i] = packRange(0, 0);
+        mWorkers.emplace_back(&Chip8Pool::work, this, i);
+    }
+
+    if (pin)
+        pinWorkers();
+}
+
+void cee::Chip8Pool::pinWorkers()
+{
+#ifdef __linux__
+    // Keep each worker on its own core, so the emulators it steps stay
+    // in that core's cache, going through the cores the process may
+    // run on rather than all of them.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+
+    std::vector<int> cores;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+            cores.push_back(cpu);
+    }
+
+    if (cores.empty())
+        return;
+
+    for (size_t i = 0; i < mWorkers.size(); i++)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cores[i % cores.size()], &set);
+
+        // Workers left where they are still run, just not pinned.
+        if (pthread_setaffinity_np(mWorkers[i].native_handle(), sizeof(set), &set) != 0)
+            return;
+    }
+#endif
+}
+
+cee::Chip8Pool::~Chip8Pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+
+    mStart.notify_all();
+    for (auto & worker : mWorkers)
+        worker.join();
+}
+
+size_t cee::Chip8Pool::size() const
+{
+    return mMachines.size();
+}
+
+size_t cee::Chip8Pool::threads() const
+{
+    return mWorkers.size();
+}
+
+cee::Chip8 & cee::Chip8Pool::operator[](size_t index)
+{
+    return mMachines[index];
+}
+
+const cee::Chip8 & cee::Chip8Pool::operator[](size_t index) const
+{
+    return mMachines[index];
+}
+
+void cee::Chip8Pool::loadProgram(const std::vector<uint8_t> & program)
+{
+    loadProgram(program.data(), program.size());
+}
+
+void cee::Chip8Pool::loadProgram(const uint8_t * program, size_t size)
+{
+    if (mMachines.empty())
+        return;
+
+    // The program is decoded once, by the first emulator, the others
+    // sharing its image.
+    mMachines[0].loadProgram(program, size);
+    for (size_t i = 1; i < mMachines.size(); i++)
+        mMachines[i].loadProgram(mMachines[0]);
+}
+
+void cee::Chip8Pool::updateKeys(cee::Keys keys)
+{
+    for (auto & machine : mMachines)
+        machine.updateKeys(keys);
+}
+
+bool cee::Chip8Pool::setCycleRate(uint32_t rate)
+{
+    if (rate > cee::MAX_CYCLE_RATE)
+    {
+        printf("Chip8 Error: %u instructions per second is too many\n", rate);
+        return false;
+    }
+
+    for (auto & machine : mMachines)
+        machine.setCycleRate(rate);
+    return true;
+}
+
+void cee::Chip8Pool::setSeed(uint32_t seed)
+{
+    for (auto & machine : mMachines)
+        machine.setSeed(seed);
+}
+
+void cee::Chip8Pool::setQuirks(cee::Quirks quirks)
+{
+    for (auto & machine : mMachines)
+        machine.setQuirks(quirks);
+
+    // Emulators make their images over again for the profile, which they
+    // go on sharing if they had the same ones.
+    for (size_t i = 1; i < mMachines.size(); i++)
+        mMachines[i].shareImage(mMachines[0]);
+
+    // XO-CHIP has more memory than the others.
+    arrange();
+}
+
+void cee::Chip8Pool::arrange()
+{
+    size_t size = 0;
+    for (const auto & machine : mMachines)
+        size += machine.getMemorySize();
+
+    // Emulators copy their memory over as they're lent the new arena,
+    // so the old one is let go of only after that.
+    std::vector<uint8_t> arena(size);
+    size_t offset = 0;
+    for (auto & machine : mMachines)
+    {
+        machine.mMemory.lend(&arena[offset]);
+        offset += machine.getMemorySize();
+    }
+
+    mArena.swap(arena);
+}
+
+void cee::Chip8Pool::updateCycles(size_t count)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // Give every worker an even share of neighbouring tasks.
+    const size_t tasks   = (mMachines.size() + mTaskSize - 1) / mTaskSize;
+    const size_t workers = mWorkers.size();
+    for (size_t i = 0; i < workers; i++)
+        mQueues[i] = packRange(tasks * i / workers, tasks * (i + 1) / workers);
+
+    mCycles = count;
+    mBusy   = workers;
+    mRound += 1;
+
+    mStart.notify_all();
+    mDone.wait(lock, [this] { return mBusy == 0; });
+}
+
+void cee::Chip8Pool::work(size_t worker)
+{
+    uint64_t round = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStart.wait(lock, [&] { return mStopping || mRound != round; });
+
+            if (mStopping)
+                return;
+
+            round = mRound;
+        }
+
+        size_t task;
+        while (claim(worker, task))
+            run(task);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mBusy == 0)
+            mDone.notify_one();
+    }
+}
+
+bool cee::Chip8Pool::claim(size_t worker, size_t & task)
+{
+    // Workers take their own tasks from the front of their queue.
+    auto & own = mQueues[worker];
+    auto range = own.load();
+    while ((range >> 32) < (range & 0xFFFFFFFF))
+    {
+        if (own.compare_exchange_weak(range, range + (uint64_t(1) << 32)))
+        {
+            task = range >> 32;
+            return true;
+        }
+    }
+
+    // Others are stolen from the back, away from where their owner works.
+    const auto workers = mWorkers.size();
+    for (size_t i = 1; i < workers; i++)
+    {
+        auto & other = mQueues[(worker + i) % workers];
+        range = other.load();
+        while ((range >> 32) < (range & 0xFFFFFFFF))
+        {
+            if (other.compare_exchange_weak(range, range - 1))
+            {
+                task = (range & 0xFFFFFFFF) - 1;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void cee::Chip8Pool::run(size_t task)
+{
+    const auto begin = task * mTaskSize;
+    const auto end   = std::min(begin + mTaskSize, mMachines.size());
+
+    for (auto i = begin; i < end; i++)
+        mMachines[i].updateCycles(mCycles);
+}
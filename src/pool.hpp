@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef CEE_POOL_HPP
+#define CEE_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+
+namespace cee
+{
+    // Steps many emulators in parallel. Emulators are stored next to each
+    // other, and so is their memory, and they're split into tasks of
+    // neighbouring emulators, which are handed out to worker threads,
+    // one per core unless told otherwise and never more than there are
+    // emulators. Workers can be pinned to their own core, which only
+    // pays off when nothing else runs on it. Workers that run out of
+    // tasks steal the remaining ones from the others. Emulators share the image of the
+    // program they load, along with the blocks decoded from it.
+    class Chip8Pool
+    {
+    public:
+        explicit Chip8Pool(size_t machines, size_t threads = 0,
+                           cee::Backend backend = cee::Backend::Interpreter,
+                           bool pin = false);
+        ~Chip8Pool();
+
+        Chip8Pool(const Chip8Pool &) = delete;
+        Chip8Pool & operator=(const Chip8Pool &) = delete;
+
+        size_t             size() const;                 // Number of emulators
+        size_t             threads() const;              // Number of worker threads
+        cee::Chip8 &       operator[](size_t index);     // Emulator at index
+        const cee::Chip8 & operator[](size_t index) const;
+
+        void loadProgram(const std::vector<uint8_t> & program); // Loads program into every emulator
+        void loadProgram(const uint8_t * program, size_t size); // Same, from any buffer
+        void updateKeys(cee::Keys keys);                 // Updates key states of every emulator
+        bool setCycleRate(uint32_t rate);                // Sets the instructions per second of every emulator, false above MAX_CYCLE_RATE
+        void setSeed(uint32_t seed);                     // Seeds the random generator of every emulator
+        void setQuirks(cee::Quirks quirks);              // Sets the quirks profile of every emulator
+        void updateCycles(size_t count);                 // Emulates a number of cycles on every emulator
+    private:
+        std::vector<cee::Chip8>                  mMachines;   // Emulators, stored contiguously
+        std::vector<uint8_t>                     mArena;      // Memory of the emulators, one after the other
+        std::vector<std::thread>                 mWorkers;    // Worker threads
+        std::unique_ptr<std::atomic<uint64_t>[]> mQueues;     // Unclaimed tasks per worker, as [begin, end)
+        size_t                                   mTaskSize;   // Emulators stepped by a single task
+        size_t                                   mCycles;     // Cycles each emulator runs this round
+        uint64_t                                 mRound;      // Round of tasks handed out
+        size_t                                   mBusy;       // Workers still running this round
+        bool                                     mStopping;   // Workers are asked to exit
+        std::mutex                               mMutex;
+        std::condition_variable                  mStart;      // Signals a new round
+        std::condition_variable                  mDone;       // Signals the round is over
+
+        void pinWorkers();                               // Pins each worker to a core the process may use
+        void arrange();                                  // Lends the emulators their memory from the arena
+        void work(size_t worker);                        // Worker thread loop
+        bool claim(size_t worker, size_t & task);        // Takes a task, stealing if needed
+        void run(size_t task);                           // Steps the emulators of a task
+    };
+}
+
+#endif // CEE_POOL_HPP
@@ -0,0 +1,214 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <string>
+
+// Addresses listed by the text report, the hottest first.
+static constexpr size_t HOT_PCS = 20;
+
+// Calls deeper than the emulator's stack are cut short.
+static constexpr size_t MAX_DEPTH = 16;
+
+static std::string
+getFrameName(uint16_t entry, bool root);
+
+cee::Profiler::Profiler(size_t memory)
+    : mPcs(memory)
+{
+    clear();
+}
+
+void cee::Profiler::clear()
+{
+    mOps.fill({});
+    std::fill(mPcs.begin(), mPcs.end(), Stat());
+    mCalls.clear();
+    mFrames.assign(1, Frame());
+    mFrames[0].parent = 0;
+    mFrames[0].entry  = 0x200;
+    mFrames[0].ops.fill({});
+    mFrame = 0;
+}
+
+void cee::Profiler::enter(const uint16_t * stack, size_t depth, const uint8_t * memory)
+{
+    // The stack holds the addresses of the calls, which are read back
+    // to find the subroutines called.
+    const size_t mask = mPcs.size() - 1;
+    mFrame = 0;
+    for (size_t i = 0; i < std::min(depth, MAX_DEPTH); i++)
+    {
+        const auto site  = stack[i] & mask;
+        const auto entry = static_cast<uint16_t>((memory[site] << 8 | memory[(site + 1) & mask]) & 0x0FFF);
+        const auto key   = std::make_pair(mFrame, entry);
+
+        auto call = mCalls.find(key);
+        if (call == mCalls.end())
+        {
+            Frame frame;
+            frame.parent = mFrame;
+            frame.entry  = entry;
+            frame.ops.fill({});
+
+            mFrames.push_back(frame);
+            call = mCalls.emplace(key, static_cast<uint32_t>(mFrames.size() - 1)).first;
+        }
+
+        mFrame = call->second;
+    }
+}
+
+void cee::Profiler::write(FILE * file, cee::ProfileFormat format, const char * const * names) const
+{
+    switch (format)
+    {
+    case cee::ProfileFormat::Text:   writeText(file, names);   break;
+    case cee::ProfileFormat::Json:   writeJson(file, names);   break;
+    case cee::ProfileFormat::Folded: writeFolded(file, names); break;
+    }
+}
+
+void cee::Profiler::writeText(FILE * file, const char * const * names) const
+{
+    uint64_t total = 0;
+    for (const auto & op : mOps)
+        total += op.ticks;
+    total = std::max<uint64_t>(total, 1);
+
+    auto ops = std::vector<size_t>();
+    for (size_t i = 0; i < MAX_OPS; i++)
+        if (mOps[i].count > 0)
+            ops.push_back(i);
+
+    std::sort(ops.begin(), ops.end(), [this](size_t a, size_t b)
+    {
+        return mOps[a].ticks > mOps[b].ticks;
+    });
+
+    fprintf(file, "%-12s %14s %16s %8s %10s\n", "operation", "count", "ticks", "ticks%", "ticks/op");
+    for (const auto i : ops)
+    {
+        const auto & op = mOps[i];
+        fprintf(file, "%-12s %14llu %16llu %7.2f%% %10.1f\n", names[i],
+                static_cast<unsigned long long>(op.count),
+                static_cast<unsigned long long>(op.ticks),
+                100.0 * op.ticks / total,
+                static_cast<double>(op.ticks) / op.count);
+    }
+
+    auto pcs = std::vector<size_t>();
+    for (size_t i = 0; i < mPcs.size(); i++)
+        if (mPcs[i].count > 0)
+            pcs.push_back(i);
+
+    const auto hot = std::min(pcs.size(), HOT_PCS);
+    std::partial_sort(pcs.begin(), pcs.begin() + hot, pcs.end(), [this](size_t a, size_t b)
+    {
+        return mPcs[a].ticks > mPcs[b].ticks;
+    });
+
+    fprintf(file, "\n%-12s %14s %16s %8s\n", "address", "count", "ticks", "ticks%");
+    for (size_t i = 0; i < hot; i++)
+    {
+        const auto & pc = mPcs[pcs[i]];
+        fprintf(file, "0x%03zX        %14llu %16llu %7.2f%%\n", pcs[i],
+                static_cast<unsigned long long>(pc.count),
+                static_cast<unsigned long long>(pc.ticks),
+                100.0 * pc.ticks / total);
+    }
+}
+
+void cee::Profiler::writeJson(FILE * file, const char * const * names) const
+{
+    const auto writeStat = [file](const Stat & stat)
+    {
+        fprintf(file, "\"count\": %llu, \"ticks\": %llu",
+                static_cast<unsigned long long>(stat.count),
+                static_cast<unsigned long long>(stat.ticks));
+    };
+
+    fprintf(file, "{\n  \"ops\": [");
+    auto first = true;
+    for (size_t i = 0; i < MAX_OPS; i++)
+    {
+        if (mOps[i].count == 0)
+            continue;
+
+        fprintf(file, "%s\n    {\"name\": \"%s\", ", first ? "" : ",", names[i]);
+        writeStat(mOps[i]);
+        fprintf(file, "}");
+        first = false;
+    }
+
+    fprintf(file, "\n  ],\n  \"pcs\": [");
+    first = true;
+    for (size_t i = 0; i < mPcs.size(); i++)
+    {
+        if (mPcs[i].count == 0)
+            continue;
+
+        fprintf(file, "%s\n    {\"pc\": %zu, ", first ? "" : ",", i);
+        writeStat(mPcs[i]);
+        fprintf(file, "}");
+        first = false;
+    }
+
+    fprintf(file, "\n  ],\n  \"frames\": [");
+    for (size_t i = 0; i < mFrames.size(); i++)
+    {
+        const auto & frame = mFrames[i];
+        fprintf(file, "%s\n    {\"entry\": %u, \"parent\": %u, \"ops\": {",
+                i == 0 ? "" : ",", frame.entry, frame.parent);
+
+        first = true;
+        for (size_t op = 0; op < MAX_OPS; op++)
+        {
+            if (frame.ops[op].count == 0)
+                continue;
+
+            fprintf(file, "%s\"%s\": {", first ? "" : ", ", names[op]);
+            writeStat(frame.ops[op]);
+            fprintf(file, "}");
+            first = false;
+        }
+
+        fprintf(file, "}}");
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
+
+void cee::Profiler::writeFolded(FILE * file, const char * const * names) const
+{
+    for (size_t i = 0; i < mFrames.size(); i++)
+    {
+        // Frames only know their caller, so the chain is built backwards.
+        auto stack = std::string();
+        for (auto frame = i; ; frame = mFrames[frame].parent)
+        {
+            const auto name = getFrameName(mFrames[frame].entry, frame == 0);
+            stack = stack.empty() ? name : name + ";" + stack;
+            if (frame == 0)
+                break;
+        }
+
+        for (size_t op = 0; op < MAX_OPS; op++)
+        {
+            const auto & stat = mFrames[i].ops[op];
+            if (stat.count > 0)
+                fprintf(file, "%s;%s %llu\n", stack.c_str(), names[op],
+                        static_cast<unsigned long long>(stat.ticks));
+        }
+    }
+}
+
+std::string
+getFrameName(uint16_t entry, bool root)
+{
+    if (root)
+        return "main";
+
+    char name[16];
+    snprintf(name, sizeof(name), "sub_%03X", entry);
+    return name;
+}
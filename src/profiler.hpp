@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef CEE_PROFILER_HPP
+#define CEE_PROFILER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <array>
+#include <map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace cee
+{
+    // Ways of writing out a profile.
+    enum class ProfileFormat
+    {
+        Text,   // Tables of the hottest operations and addresses
+        Json,   // Everything, for tools to pick apart
+        Folded  // One line per call chain and operation, for flame graphs
+    };
+
+    // Reads a cheap, steadily increasing count of host time. It's the
+    // time stamp counter on x86, and nanoseconds anywhere else.
+    inline uint64_t readTicks()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        using Clock = std::chrono::steady_clock;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    #endif
+    }
+
+    // Counts executions and host time of an emulator's instructions, by
+    // operation, by address and by the chain of calls leading to them.
+    // Only emulators built with CEE_PROFILE defined keep one.
+    class Profiler
+    {
+    public:
+        static constexpr size_t MAX_OPS = 64;            // Operations told apart, same as the decoding tables
+
+        explicit Profiler(size_t memory);                // Tells apart every address of memory bytes, a power of two
+
+        void clear();                                    // Forgets everything counted so far
+        void record(uint8_t op, uint16_t pc, uint64_t ticks); // Counts an instruction at pc, which took ticks
+        void enter(const uint16_t * stack, size_t depth, const uint8_t * memory); // Follows the call chain to the one on the stack
+
+        void write(FILE * file, cee::ProfileFormat format, const char * const * names) const; // Writes a report, with names of operations
+    private:
+        // Executions and time spent.
+        struct Stat
+        {
+            uint64_t count;
+            uint64_t ticks;
+        };
+
+        // Subroutine called along a call chain.
+        struct Frame
+        {
+            uint32_t                     parent; // Frame calling it, itself for the root
+            uint16_t                     entry;  // Address called
+            std::array<Stat, MAX_OPS>    ops;    // Instructions run by it, not by its callees
+        };
+
+        std::array<Stat, MAX_OPS>                        mOps;    // Totals by operation
+        std::vector<Stat>                                mPcs;    // Totals by address, one for each byte of memory
+        std::vector<Frame>                               mFrames; // Call tree, the root first
+        std::map<std::pair<uint32_t, uint16_t>, uint32_t> mCalls;  // Frame by caller and address called
+        uint32_t                                         mFrame;  // Frame currently running
+
+        void writeText(FILE * file, const char * const * names) const;
+        void writeJson(FILE * file, const char * const * names) const;
+        void writeFolded(FILE * file, const char * const * names) const;
+    };
+
+    inline void Profiler::record(uint8_t op, uint16_t pc, uint64_t ticks)
+    {
+        auto & total = mOps[op];
+        total.count += 1;
+        total.ticks += ticks;
+
+        auto & address = mPcs[pc & (mPcs.size() - 1)];
+        address.count += 1;
+        address.ticks += ticks;
+
+        auto & frame = mFrames[mFrame].ops[op];
+        frame.count += 1;
+        frame.ticks += ticks;
+    }
+}
+
+#endif // CEE_PROFILER_HPP
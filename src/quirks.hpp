@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef CEE_QUIRKS_HPP
+#define CEE_QUIRKS_HPP
+
+#include <cstddef>
+#include <cstring>
+
+namespace cee
+{
+    // Behaviours which differ between the interpreters programs were
+    // written for. Modern comes first, being the default.
+    enum class Quirks
+    {
+        Modern,    // What most programs are tested against nowadays
+        CosmacVip, // The original interpreter, on the COSMAC VIP
+        Chip48,    // CHIP-48, on the HP-48 calculators
+        SuperChip, // SUPER-CHIP 1.1, on the HP-48 calculators
+        XoChip     // XO-CHIP, as made for Octo
+    };
+
+    // Each profile is a policy of constants, which the emulator's
+    // handlers are specialised on. Profiles are told apart by the
+    // decoding tables instead of by testing them in every handler.
+    struct ModernQuirks
+    {
+        static constexpr cee::Quirks profile = cee::Quirks::Modern;
+
+        static constexpr bool resetVf        = false; // 8XY1, 8XY2 and 8XY3 clear VF
+        static constexpr bool shiftVy        = false; // 8XY6 and 8XYE shift VY into VX, rather than VX itself
+        static constexpr bool incrementIndex = true;  // FX55 and FX65 leave I past the last register
+        static constexpr bool indexOneShort  = false; // ... or rather on the last register
+        static constexpr bool jumpVx         = false; // BXNN jumps to XNN plus VX, rather than to NNN plus V0
+        static constexpr bool wrapSprites    = true;  // Sprites wrap around the edges, rather than being clipped
+        static constexpr bool superChip      = false; // High resolution, scrolling, 16 x 16 sprites, big font and flags
+        static constexpr bool xoChip         = false; // SUPER-CHIP's and two planes, 64K of memory and audio patterns
+    };
+
+    struct CosmacVipQuirks
+    {
+        static constexpr cee::Quirks profile = cee::Quirks::CosmacVip;
+
+        static constexpr bool resetVf        = true;
+        static constexpr bool shiftVy        = true;
+        static constexpr bool incrementIndex = true;
+        static constexpr bool indexOneShort  = false;
+        static constexpr bool jumpVx         = false;
+        static constexpr bool wrapSprites    = false;
+        static constexpr bool superChip      = false;
+        static constexpr bool xoChip         = false;
+    };
+
+    struct Chip48Quirks
+    {
+        static constexpr cee::Quirks profile = cee::Quirks::Chip48;
+
+        static constexpr bool resetVf        = false;
+        static constexpr bool shiftVy        = false;
+        static constexpr bool incrementIndex = true;
+        static constexpr bool indexOneShort  = true;
+        static constexpr bool jumpVx         = true;
+        static constexpr bool wrapSprites    = false;
+        static constexpr bool superChip      = false;
+        static constexpr bool xoChip         = false;
+    };
+
+    struct SuperChipQuirks
+    {
+        static constexpr cee::Quirks profile = cee::Quirks::SuperChip;
+
+        static constexpr bool resetVf        = false;
+        static constexpr bool shiftVy        = false;
+        static constexpr bool incrementIndex = false;
+        static constexpr bool indexOneShort  = false;
+        static constexpr bool jumpVx         = true;
+        static constexpr bool wrapSprites    = false;
+        static constexpr bool superChip      = true;
+        static constexpr bool xoChip         = false;
+    };
+
+    struct XoChipQuirks
+    {
+        static constexpr cee::Quirks profile = cee::Quirks::XoChip;
+
+        static constexpr bool resetVf        = false;
+        static constexpr bool shiftVy        = true;
+        static constexpr bool incrementIndex = true;
+        static constexpr bool indexOneShort  = false;
+        static constexpr bool jumpVx         = false;
+        static constexpr bool wrapSprites    = true;
+        static constexpr bool superChip      = true;
+        static constexpr bool xoChip         = true;
+    };
+
+    // Names of the profiles, as given on the command line.
+    static constexpr const char * QUIRKS_NAMES[] = {"modern", "vip", "chip48", "schip", "xochip"};
+
+    inline const char * getName(cee::Quirks quirks)
+    {
+        return QUIRKS_NAMES[static_cast<size_t>(quirks)];
+    }
+
+    // Finds the profile with the given name, false if there's none.
+    inline bool findQuirks(const char * name, cee::Quirks & quirks)
+    {
+        for (size_t i = 0; i < sizeof(QUIRKS_NAMES) / sizeof(QUIRKS_NAMES[0]); i++)
+        {
+            if (std::strcmp(name, QUIRKS_NAMES[i]) == 0)
+            {
+                quirks = static_cast<cee::Quirks>(i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+#endif // CEE_QUIRKS_HPP
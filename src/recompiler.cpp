@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "files.hpp"
+#include "layout.hpp"
+#include "quirks.hpp"
+#include "translator.hpp"
+
+static void
+printUsage();
+
+static std::string
+getBaseName(const std::string & path);
+
+int main(int argc, char ** argv)
+{
+    auto pathToRom = std::string();
+    auto output    = std::string();
+    auto name      = std::string();
+    auto quirks    = cee::Quirks::Modern;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const auto arg = std::string(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if ((arg == "--output" || arg == "-o") && hasValue)
+        {
+            output = argv[++i];
+        }
+        else if (arg == "--name" && hasValue)
+        {
+            name = argv[++i];
+        }
+        else if (arg == "--quirks" && hasValue)
+        {
+            if (! cee::findQuirks(argv[++i], quirks))
+            {
+                printf("Chip8 Error: Unknown quirks %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg[0] != '-' && pathToRom.empty())
+        {
+            pathToRom = arg;
+        }
+        else
+        {
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (pathToRom.empty())
+    {
+        printf("Chip8 Error: Wrong number of arguments\n");
+        printUsage();
+        return -1;
+    }
+
+    const auto program = cee::readAllBytes(pathToRom.c_str());
+    if (program.empty())
+        return -1;
+
+    // Programs are translated in the memory they'll run in.
+    cee::Chip8 chip;
+    chip.setQuirks(quirks);
+    if (program.size() >= chip.getMemorySize() - cee::PROG_OFFSET)
+    {
+        printf("Chip8 Error: Program doesn't fit in the memory of %s\n", cee::getName(quirks));
+        return -1;
+    }
+
+    if (name.empty())
+        name = getBaseName(pathToRom);
+
+    const cee::Translator translator(program.data(), program.size(), quirks);
+
+    auto file = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (! file)
+    {
+        printf("Chip8 Error: Can't write to %s\n", output.c_str());
+        return -1;
+    }
+
+    translator.write(file, name.c_str());
+
+    if (file != stdout)
+    {
+        fclose(file);
+        printf("Translated %zu blocks of %s, %zu instructions of which %zu go through the interpreter\n",
+               translator.getBlocks(), name.c_str(), translator.getInstructions(), translator.getInterpreted());
+    }
+
+    return 0;
+}
+
+void
+printUsage()
+{
+    printf("Usage: cee-aot [OPTIONS] FILE_PATH\n"
+           "  --output FILE     Where to write the C++ translation (default: the output)\n"
+           "  --name NAME       Name of the program in the translation (default: the file's)\n"
+           "  --quirks NAME     Interpreter to translate for: modern (default), vip, chip48, schip or xochip\n");
+}
+
+std::string
+getBaseName(const std::string & path)
+{
+    const auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
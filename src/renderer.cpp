@@ -0,0 +1,176 @@
+#include "renderer.hpp"
+#include "files.hpp"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static GLuint
+makeShader(GLenum type, const std::string & src);
+
+static GLuint
+makeProgram(std::vector<GLuint> shaders);
+
+cee::Renderer::Renderer()
+{
+    constexpr GLfloat pxVerts[] =
+    {
+        -1.0f,  1.0f, 0.0f, // Top Left
+         1.0f,  1.0f, 0.0f, // Top Right
+        -1.0f, -1.0f, 0.0f, // Bottom Left
+         1.0f, -1.0f, 0.0f  // Bottom Right
+    };
+
+    constexpr GLuint pxIndices[] =
+    {
+        0, 1, 2,
+        2, 1, 3
+    };
+
+    // Initialize the VAO and other buffers associated
+    // with drawing an emulated pixel.
+    glGenVertexArrays(1, &mVao);
+
+    glBindVertexArray(mVao);
+    {
+        glGenBuffers(1, &mVbo);
+        glGenBuffers(1, &mIbo);
+
+        // VBO
+        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(pxVerts), &pxVerts, GL_STATIC_DRAW);
+
+        // IBO
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pxIndices), &pxIndices, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+        glEnableVertexAttribArray(0);
+
+        // Pixel numbers, advancing once per instance
+        glGenBuffers(1, &mPixels);
+        glBindBuffer(GL_ARRAY_BUFFER, mPixels);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(mLit), nullptr, GL_STREAM_DRAW);
+
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(uint16_t), nullptr);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(1);
+    }
+    glBindVertexArray(0);
+
+    // Current Vertex Shader
+    const auto pxVertexSrc = cee::readAllChars("data/shaders/px_vertex.glsl");
+    mVertex = makeShader(GL_VERTEX_SHADER, pxVertexSrc);
+
+    // Current Fragment Shader
+    const auto pxFragmentSrc = cee::readAllChars("data/shaders/px_fragment.glsl");
+    mFragment = makeShader(GL_FRAGMENT_SHADER, pxFragmentSrc);
+
+    // Current Shader Program
+    mProgram = makeProgram({mVertex, mFragment});
+    mSize    = glGetUniformLocation(mProgram, "size");
+}
+
+cee::Renderer::~Renderer()
+{
+    glDeleteProgram(mProgram);
+    glDeleteShader(mVertex);
+    glDeleteShader(mFragment);
+    glDeleteBuffers(1, &mPixels);
+    glDeleteVertexArrays(1, &mVao);
+    glDeleteBuffers(1, &mIbo);
+    glDeleteBuffers(1, &mVbo);
+}
+
+bool cee::Renderer::isValid() const
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+void cee::Renderer::draw(const cee::GfxPlanes & planes, bool hires)
+{
+    // Pixel numbers take the lowest 13 bits, leaving room for a colour.
+    static_assert(cee::GFX_WIDTH * cee::GFX_HEIGHT <= 1 << 13, "Pixel numbers need 13 bits at most");
+    static_assert(cee::GFX_PLANES <= 3, "Colours need 3 bits at most");
+
+    const size_t width  = hires ? cee::GFX_WIDTH : cee::LORES_WIDTH;
+    const size_t height = hires ? cee::GFX_HEIGHT : cee::LORES_HEIGHT;
+    const size_t halves = hires ? 2 : 1;
+
+    // The second plane is only looked at when something is drawn on
+    // it, which keeps programs without colours as fast as they were.
+    const auto & first  = planes[0];
+    const auto & second = planes[1];
+    const bool   colours = std::any_of(second.begin(), second.end(), [](uint64_t word) { return word != 0; });
+
+    // Lit pixels are picked off each half of a row, one set bit at a time.
+    size_t count = 0;
+    for (size_t y = 0; y < height; y++)
+    {
+        for (size_t half = 0; half < halves; half++)
+        {
+            const auto word  = half * cee::GFX_HEIGHT + y;
+            const auto lower = first[word];
+            const auto upper = colours ? second[word] : 0;
+
+            for (auto row = lower | upper; row != 0; row &= row - 1)
+            {
+                const auto bit    = __builtin_ctzll(row);
+                const auto x      = half * 64 + 63 - bit;
+                const auto colour = ((lower >> bit) & 1) | ((upper >> bit) & 1) << 1;
+                mLit[count++] = uint16_t(y * width + x) | uint16_t(colour << 13);
+            }
+        }
+    }
+
+    if (count == 0)
+        return;
+
+    // The buffer is orphaned first, so that the driver needn't wait
+    // for the previous frame to be done with it.
+    glBindBuffer(GL_ARRAY_BUFFER, mPixels);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mLit), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(uint16_t), mLit.data());
+
+    glUseProgram(mProgram);
+    glUniform2ui(mSize, GLuint(width), GLuint(height));
+    glBindVertexArray(mVao);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, count);
+    glBindVertexArray(0);
+}
+
+GLuint
+makeShader(GLenum type, const std::string & src)
+{
+    const auto id = glCreateShader(type);
+    const auto cp = src.c_str();
+    glShaderSource(id, 1, &cp, nullptr);
+    glCompileShader(id);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
+    if (compiled != GL_TRUE)
+    {
+        char log[1024] = {};
+        glGetShaderInfoLog(id, sizeof(log), nullptr, log);
+        printf("Chip8 Error: Can't compile shader: %s\n", log);
+    }
+
+    return id;
+}
+
+GLuint
+makeProgram(std::vector<GLuint> shaders)
+{
+    const auto id = glCreateProgram();
+
+    for (const auto s : shaders)
+        glAttachShader(id, s);
+
+    glLinkProgram(id);
+    return id;
+}
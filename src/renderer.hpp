@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef CEE_RENDERER_HPP
+#define CEE_RENDERER_HPP
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+#include <array>
+
+#include "gfx.hpp"
+
+namespace cee
+{
+    // Draws the display in a single call, by instancing a quad for every
+    // lit pixel. The lit pixels are found a row at a time from the packed
+    // display, and uploaded as one buffer of pixel numbers per frame,
+    // each with its colour from the planes in the highest bits.
+    // Needs a current OpenGL 3.3 context for its whole lifetime.
+    class Renderer
+    {
+    public:
+        explicit Renderer();
+        ~Renderer();
+
+        Renderer(const Renderer &) = delete;
+        Renderer & operator=(const Renderer &) = delete;
+
+        bool isValid() const;                            // Whether the shaders compiled and linked
+        void draw(const cee::GfxPlanes & planes, bool hires); // Uploads and draws the display, in either resolution
+    private:
+        GLuint mVao;      // Vertex array of the quad
+        GLuint mVbo;      // Vertices of the quad
+        GLuint mIbo;      // Indices of the quad
+        GLuint mPixels;   // Numbers of the lit pixels, an instance each
+        GLuint mVertex;   // Vertex shader
+        GLuint mFragment; // Fragment shader
+        GLuint mProgram;  // Shader program
+        GLint  mSize;     // Location of the uniform giving the resolution
+
+        std::array<uint16_t, cee::GFX_WIDTH * cee::GFX_HEIGHT> mLit; // Lit pixels of the current frame
+    };
+}
+
+#endif // CEE_RENDERER_HPP
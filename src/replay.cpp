@@ -0,0 +1,208 @@
+#include "replay.hpp"
+#include "bytes.hpp"
+#include "chip8.hpp"
+#include "files.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Logs start with this header, followed by an entry per event until the
+// end of the file. An entry is the number of cycles since the previous
+// event as a LEB128 varint, then the keys pressed and the last key
+// pressed, as 16 bits each. Numbers are stored little-endian.
+static constexpr char     LOG_MAGIC[4]    = {'C', 'E', 'E', 'I'};
+static constexpr uint16_t LOG_VERSION     = 1;
+static constexpr size_t   LOG_HEADER_SIZE = 24;
+
+static bool
+parseKeys(const std::string & text, cee::Keys & keys);
+
+bool cee::saveInputLog(const char * path, const cee::InputLog & log)
+{
+    std::vector<uint8_t> out(LOG_MAGIC, LOG_MAGIC + sizeof(LOG_MAGIC));
+    cee::putNumber(out, LOG_VERSION, 2);
+    cee::putNumber(out, static_cast<uint16_t>(log.quirks), 2);
+    cee::putNumber(out, log.seed, 4);
+    cee::putNumber(out, log.cycleRate, 4);
+    cee::putNumber(out, log.cycles, 8);
+
+    // Key changes are usually frames apart, so most deltas fit in two
+    // bytes and a whole event in six.
+    auto last = uint64_t(0);
+    for (const auto & event : log.events)
+    {
+        assert(event.cycle >= last);
+        auto delta = event.cycle - last;
+        last = event.cycle;
+
+        for (; delta >= 0x80; delta >>= 7)
+            out.push_back(uint8_t(delta) | 0x80);
+        out.push_back(uint8_t(delta));
+
+        cee::putNumber(out, event.keys.keysPressed, 2);
+        cee::putNumber(out, event.keys.lastKeyPressed, 2);
+    }
+
+    return cee::writeAllBytes(path, out);
+}
+
+bool cee::loadInputLog(const char * path, cee::InputLog & log)
+{
+    const auto in = cee::readAllBytes(path);
+    if (in.size() < LOG_HEADER_SIZE
+        || std::memcmp(in.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0
+        || cee::getNumber(&in[4], 2) != LOG_VERSION)
+    {
+        printf("Chip8 Error: %s isn't a supported input log\n", path);
+        return false;
+    }
+
+    const auto quirks = cee::getNumber(&in[6], 2);
+    if (quirks > static_cast<uint16_t>(cee::Quirks::XoChip))
+    {
+        printf("Chip8 Error: Input log %s has unknown quirks\n", path);
+        return false;
+    }
+
+    const auto cycleRate = cee::getNumber(&in[12], 4);
+    if (cycleRate > cee::MAX_CYCLE_RATE)
+    {
+        printf("Chip8 Error: Input log %s has an unsupported rate\n", path);
+        return false;
+    }
+
+    log.quirks    = static_cast<cee::Quirks>(quirks);
+    log.seed      = cee::getNumber(&in[8], 4);
+    log.cycleRate = static_cast<uint32_t>(cycleRate);
+    log.cycles    = cee::getNumber(&in[16], 8);
+    log.events.clear();
+
+    auto cycle = uint64_t(0);
+    for (size_t i = LOG_HEADER_SIZE; i < in.size();)
+    {
+        auto delta = uint64_t(0);
+        for (size_t shift = 0; i < in.size() && shift < 64; shift += 7)
+        {
+            const auto byte = in[i++];
+            delta |= uint64_t(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+
+        if (i + 4 > in.size())
+        {
+            printf("Chip8 Error: Input log %s is truncated\n", path);
+            return false;
+        }
+
+        cycle += delta;
+        cee::InputEvent event;
+        event.cycle               = cycle;
+        event.keys.keysPressed    = cee::getNumber(&in[i], 2);
+        event.keys.lastKeyPressed = cee::getNumber(&in[i + 2], 2);
+        log.events.push_back(event);
+        i += 4;
+    }
+
+    return true;
+}
+
+bool cee::loadInputScript(const char * path, std::vector<cee::InputEvent> & events)
+{
+    std::ifstream file(path);
+    if (! file)
+    {
+        printf("Chip8 Error: Can't open input script %s\n", path);
+        return false;
+    }
+
+    auto line   = std::string();
+    auto number = 0;
+
+    while (std::getline(file, line))
+    {
+        number += 1;
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream stream(line);
+        cee::InputEvent event;
+        std::string keys;
+
+        if (! (stream >> event.cycle >> keys) || ! parseKeys(keys, event.keys))
+        {
+            printf("Chip8 Error: Invalid input at %s:%d\n", path, number);
+            return false;
+        }
+
+        events.push_back(event);
+    }
+
+    return true;
+}
+
+cee::InputRecorder::InputRecorder(uint32_t seed, uint32_t cycleRate, cee::Quirks quirks)
+{
+    mLog.seed      = seed;
+    mLog.cycleRate = cycleRate;
+    mLog.quirks    = quirks;
+    mLog.cycles    = 0;
+}
+
+void cee::InputRecorder::record(uint64_t cycle, cee::Keys keys)
+{
+    // Emulators start out with no keys held.
+    auto previous = cee::Keys{};
+    if (! mLog.events.empty())
+        previous = mLog.events.back().keys;
+
+    if (keys.keysPressed == previous.keysPressed && keys.lastKeyPressed == previous.lastKeyPressed)
+        return;
+
+    // Changes within the same cycle only leave the last one in effect.
+    if (! mLog.events.empty() && mLog.events.back().cycle == cycle)
+    {
+        mLog.events.back().keys = keys;
+        return;
+    }
+
+    assert(mLog.events.empty() || cycle > mLog.events.back().cycle);
+    mLog.events.push_back({cycle, keys});
+}
+
+const cee::InputLog & cee::InputRecorder::finish(uint64_t cycles)
+{
+    mLog.cycles = cycles;
+    return mLog;
+}
+
+bool
+parseKeys(const std::string & text, cee::Keys & keys)
+{
+    keys = {};
+
+    if (text == "-")
+        return true;
+
+    for (const auto c : text)
+    {
+        char digit[] = {c, '\0'};
+        char * end   = nullptr;
+        auto key     = std::strtol(digit, &end, 16);
+
+        if (*end != '\0')
+            return false;
+
+        keys.keysPressed   |= 1 << key;
+        keys.lastKeyPressed = key;
+    }
+
+    return true;
+}
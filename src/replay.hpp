@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef CEE_REPLAY_HPP
+#define CEE_REPLAY_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+
+#include "keys.hpp"
+#include "quirks.hpp"
+
+namespace cee
+{
+    // Key states taking effect from a given cycle onwards.
+    struct InputEvent
+    {
+        uint64_t  cycle;
+        cee::Keys keys;
+    };
+
+    // Everything needed to replay a session exactly: with the same seed,
+    // rate, quirks and program, the same key changes at the same cycles
+    // always lead to the same state.
+    struct InputLog
+    {
+        uint32_t                     seed;      // Seed of the random generator
+        uint32_t                     cycleRate; // Instructions per second
+        cee::Quirks                  quirks;    // Profile the emulator behaved like
+        uint64_t                     cycles;    // Cycles run by the whole session
+        std::vector<cee::InputEvent> events;    // Key changes, by ascending cycle
+    };
+
+    bool saveInputLog(const char * path, const cee::InputLog & log); // Writes a log, false on failure
+    bool loadInputLog(const char * path, cee::InputLog & log);       // Reads a log, false on failure
+
+    // Reads a hand written input script, with one "CYCLE KEYS" line per
+    // change, and adds its events. KEYS are the hex digits of the keys
+    // held from then on, the last being the last key pressed, or '-'
+    // for none of them. Lines starting with '#' are left out.
+    bool loadInputScript(const char * path, std::vector<cee::InputEvent> & events);
+
+    // Builds up the log of a session, keeping only the key states which
+    // differ from the previous ones.
+    class InputRecorder
+    {
+    public:
+        explicit InputRecorder(uint32_t seed, uint32_t cycleRate, cee::Quirks quirks);
+
+        void record(uint64_t cycle, cee::Keys keys);     // Logs the key states taking effect at cycle
+        const cee::InputLog & finish(uint64_t cycles);   // Ends the session after cycles, returns its log
+    private:
+        cee::InputLog mLog;                              // Session recorded so far
+    };
+}
+
+#endif // CEE_REPLAY_HPP
@@ -0,0 +1,248 @@
+#include "rewind.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+
+// Frames are packed as a series of runs, each made of the number of
+// unchanged bytes to skip and the number of changed bytes following,
+// both as 16 bits, then the changed bytes XORed with their old values.
+// A changed run only ends once MIN_SKIP bytes in a row are unchanged,
+// as a shorter skip would cost more than it saves. Snapshots can be
+// longer than 16 bits go, so longer runs are split up, which costs a
+// run header for every MAX_RUN bytes at most.
+static constexpr size_t MIN_SKIP   = 4;
+static constexpr size_t MAX_RUN    = UINT16_MAX;
+static constexpr size_t MAX_PACKED = cee::MAX_STATE_SIZE + 2 * MIN_SKIP
+                                   + 4 * (cee::MAX_STATE_SIZE / MAX_RUN + 1);
+
+static const std::array<uint8_t, cee::MAX_STATE_SIZE> ZEROS = {};
+
+static size_t
+pack(const uint8_t * state, const uint8_t * previous, uint8_t * out);
+
+static void
+unpack(const uint8_t * packed, size_t size, uint8_t * state);
+
+cee::Rewind::Rewind(size_t frames, size_t bytes, size_t interval)
+    : mEntries(frames)
+    , mFirst(0)
+    , mCount(0)
+    , mArena(bytes)
+    , mEnd(0)
+    , mInterval(std::max<size_t>(interval, 1))
+    , mSinceKey(0)
+    , mHead(cee::MAX_STATE_SIZE)
+    , mLength(0)
+    , mPacked(MAX_PACKED)
+{
+    assert(frames > 0);
+    assert(bytes >= MAX_PACKED);
+
+    // Snapshots are made in place from now on.
+    mState.reserve(cee::MAX_STATE_SIZE);
+}
+
+void cee::Rewind::push(const cee::Chip8 & chip)
+{
+    chip.saveState(mState);
+    const auto length = static_cast<uint32_t>(mState.size());
+    mState.resize(cee::MAX_STATE_SIZE);
+
+    if (mCount == mEntries.size())
+        dropOldest();
+
+    auto keyframe = mCount == 0 || mSinceKey >= mInterval;
+    auto size     = pack(mState.data(), keyframe ? ZEROS.data() : mHead.data(), mPacked.data());
+    auto offset   = reserve(size);
+
+    // Making room may have dropped the frame this one relies on.
+    if (! keyframe && mCount == 0)
+    {
+        keyframe = true;
+        size     = pack(mState.data(), ZEROS.data(), mPacked.data());
+        offset   = reserve(size);
+    }
+
+    std::memcpy(&mArena[offset], mPacked.data(), size);
+
+    auto & entry   = at(mCount++);
+    entry.offset   = offset;
+    entry.size     = size;
+    entry.length   = length;
+    entry.keyframe = keyframe;
+
+    mEnd      = offset + size;
+    mSinceKey = keyframe ? 1 : mSinceKey + 1;
+    mLength   = length;
+    std::swap(mHead, mState);
+}
+
+size_t cee::Rewind::rewind(cee::Chip8 & chip, size_t frames)
+{
+    if (mCount == 0)
+        return 0;
+
+    frames = std::min(frames, mCount - 1);
+    const auto target = mCount - 1 - frames;
+
+    auto key = target;
+    while (! at(key).keyframe)
+        key--;
+
+    // Going back from the newest frame only works without a keyframe
+    // in the way, and is only worth it when it's closer.
+    const auto newestKey = mCount - mSinceKey;
+    if (newestKey <= target && frames <= target - key)
+    {
+        for (auto i = mCount - 1; i > target; i--)
+            unpack(&mArena[at(i).offset], at(i).size, mHead.data());
+    }
+    else
+    {
+        std::fill(mHead.begin(), mHead.end(), 0);
+        for (auto i = key; i <= target; i++)
+            unpack(&mArena[at(i).offset], at(i).size, mHead.data());
+    }
+
+    const auto & entry = at(target);
+    mCount    = target + 1;
+    mEnd      = entry.offset + entry.size;
+    mSinceKey = target - key + 1;
+    mLength   = entry.length;
+
+    const auto loaded = chip.loadState(mHead.data(), mLength);
+    assert(loaded && "Frames can only be loaded into an emulator running the same program");
+    (void) loaded;
+
+    return frames;
+}
+
+void cee::Rewind::clear()
+{
+    mFirst    = 0;
+    mCount    = 0;
+    mEnd      = 0;
+    mSinceKey = 0;
+}
+
+size_t cee::Rewind::size() const
+{
+    return mCount;
+}
+
+size_t cee::Rewind::getUsedBytes() const
+{
+    if (mCount == 0)
+        return 0;
+
+    const auto start = mEntries[mFirst].offset;
+    return mEnd > start ? mEnd - start : mArena.size() - start + mEnd;
+}
+
+cee::Rewind::Entry & cee::Rewind::at(size_t index)
+{
+    return mEntries[(mFirst + index) % mEntries.size()];
+}
+
+size_t cee::Rewind::reserve(size_t size)
+{
+    if (mCount == 0)
+        return 0;
+
+    // Frames are written one after the other, so the ones in the way
+    // are always the oldest. Once the end of the arena is reached, the
+    // frames left past the newest one go, and writing starts over.
+    auto offset = mEnd;
+    if (offset + size > mArena.size())
+    {
+        while (mCount > 0 && at(0).offset >= mEnd)
+            dropOldest();
+        offset = 0;
+    }
+
+    while (mCount > 0 && at(0).offset < offset + size && at(0).offset + at(0).size > offset)
+        dropOldest();
+
+    return offset;
+}
+
+void cee::Rewind::dropOldest()
+{
+    do
+    {
+        mFirst = (mFirst + 1) % mEntries.size();
+        mCount--;
+    }
+    while (mCount > 0 && ! at(0).keyframe);
+}
+
+size_t
+pack(const uint8_t * state, const uint8_t * previous, uint8_t * out)
+{
+    const auto put = [&out](size_t value)
+    {
+        *out++ = uint8_t(value);
+        *out++ = uint8_t(value >> 8);
+    };
+
+    const auto start = out;
+    size_t i = 0;
+
+    while (i < cee::MAX_STATE_SIZE)
+    {
+        // Unchanged bytes are mostly skipped a word at a time.
+        const auto from = i;
+        for (; i + 8 <= cee::MAX_STATE_SIZE; i += 8)
+        {
+            uint64_t a, b;
+            std::memcpy(&a, state + i, 8);
+            std::memcpy(&b, previous + i, 8);
+            if (a != b)
+                break;
+        }
+
+        while (i < cee::MAX_STATE_SIZE && state[i] == previous[i])
+            i++;
+
+        if (i == cee::MAX_STATE_SIZE)
+            break;
+
+        auto end = i + 1;
+        for (auto j = end; j < cee::MAX_STATE_SIZE && j - end < MIN_SKIP && j - i < MAX_RUN; j++)
+            if (state[j] != previous[j])
+                end = j + 1;
+
+        auto skip = i - from;
+        for (; skip > MAX_RUN; skip -= MAX_RUN)
+        {
+            put(MAX_RUN);
+            put(0);
+        }
+
+        put(skip);
+        put(end - i);
+        for (; i < end; i++)
+            *out++ = state[i] ^ previous[i];
+    }
+
+    return out - start;
+}
+
+void
+unpack(const uint8_t * packed, size_t size, uint8_t * state)
+{
+    const auto end = packed + size;
+    while (packed < end)
+    {
+        const size_t skip    = packed[0] | packed[1] << 8;
+        const size_t changed = packed[2] | packed[3] << 8;
+        packed += 4;
+        state  += skip;
+
+        for (size_t i = 0; i < changed; i++)
+            *state++ ^= *packed++;
+    }
+}
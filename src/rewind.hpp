@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef CEE_REWIND_HPP
+#define CEE_REWIND_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+
+#include "chip8.hpp"
+
+namespace cee
+{
+    static constexpr size_t DEFAULT_REWIND_BYTES    = 4 << 20; // Arena size, enough for minutes of most programs
+    static constexpr size_t DEFAULT_REWIND_INTERVAL = 60;      // Frames between keyframes
+
+    // History of an emulator's state, a frame at a time, for stepping
+    // back through. Frames are snapshots XORed against the frame before,
+    // with runs of zeros packed away, so each only costs as much as what
+    // changed. Every so often a keyframe is stored whole, so that far
+    // away frames needn't go through every frame in between.
+    // Frames live in an arena allocated up front, which drops the oldest
+    // ones to make room, a keyframe and what follows it at a time.
+    class Rewind
+    {
+    public:
+        explicit Rewind(size_t frames, size_t bytes = DEFAULT_REWIND_BYTES,
+                        size_t interval = DEFAULT_REWIND_INTERVAL);
+
+        void   push(const cee::Chip8 & chip);            // Records the state of chip as the newest frame
+        size_t rewind(cee::Chip8 & chip, size_t frames); // Steps chip back to an older frame, dropping newer ones, returns frames stepped back
+        void   clear();                                  // Drops every frame
+
+        size_t size() const;                             // Number of frames held
+        size_t getUsedBytes() const;                     // Bytes of the arena holding frames
+    private:
+        // Frame stored in the arena.
+        struct Entry
+        {
+            uint32_t offset;   // Start of its packed bytes in the arena
+            uint32_t size;     // Number of packed bytes
+            uint32_t length;   // Size of the snapshot itself
+            bool     keyframe; // Packed against zeros rather than the previous frame
+        };
+
+        std::vector<Entry>   mEntries;  // Ring of frames, oldest first
+        size_t               mFirst;    // Index of the oldest frame
+        size_t               mCount;    // Number of frames held
+        std::vector<uint8_t> mArena;    // Packed frames, written as a ring
+        size_t               mEnd;      // End of the newest frame's bytes
+        size_t               mInterval; // Frames between keyframes
+        size_t               mSinceKey; // Frames since the newest keyframe
+        std::vector<uint8_t> mHead;     // Newest frame, unpacked and padded to MAX_STATE_SIZE
+        uint32_t             mLength;   // Size of the newest frame's snapshot
+        std::vector<uint8_t> mState;    // Scratch snapshot
+        std::vector<uint8_t> mPacked;   // Scratch packed frame
+
+        Entry & at(size_t index);                        // Frame at index, counting from the oldest
+        size_t  reserve(size_t size);                    // Makes room for size bytes in the arena, returns their offset
+        void    dropOldest();                            // Drops the oldest keyframe and the frames relying on it
+    };
+}
+
+#endif // CEE_REWIND_HPP
@@ -0,0 +1,198 @@
+#include "runner.hpp"
+
+#include <algorithm>
+
+// Time between steps, a few to every frame shown, so that what the
+// program does is published without waiting for the next frame.
+static constexpr double STEP_TIME = 1.0 / 240.0;
+
+// Time between the frames kept for rewinding, and stepped back through.
+static constexpr double FRAME_TIME = 1.0 / 60.0;
+
+// Longest sleep while the program waits on a key, short of the lag the
+// scheduler drops, so that its timers still keep up.
+static constexpr double IDLE_WAIT = 0.2;
+
+cee::Runner::Runner(cee::Chip8 & chip, uint32_t rate, cee::InputRecorder * recorder, cee::Rewind * timeline)
+    : mChip(chip)
+    , mScheduler(chip, rate)
+    , mRecorder(recorder)
+    , mTimeline(timeline)
+    , mKeys(0)
+    , mKeyTime(0)
+    , mRewinding(false)
+    , mLastKeys(0)
+    , mInputTime(0)
+    , mShownTime(0)
+    , mDisplay(0)
+    , mCycles(0)
+    , mFrameDebt(0.0)
+    , mLastRun(Clock::now())
+    , mStopping(false)
+    , mWoken(false)
+{
+}
+
+cee::Runner::~Runner()
+{
+    stop();
+}
+
+void cee::Runner::start(std::function<void()> published)
+{
+    mPublished = std::move(published);
+    mLastRun   = Clock::now();
+    mThread    = std::thread(&Runner::run, this);
+}
+
+void cee::Runner::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+
+    mWake.notify_one();
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void cee::Runner::step()
+{
+    const auto now     = Clock::now();
+    const auto seconds = std::chrono::duration<double>(now - mLastRun).count();
+
+    // The timeline goes a frame at a time either way, however often the
+    // steps are, without making up for more than a frame missed.
+    mFrameDebt = std::min(mFrameDebt + seconds / FRAME_TIME, 2.0);
+    const auto frameDue = mFrameDebt >= 1.0;
+    if (frameDue)
+        mFrameDebt -= 1.0;
+
+    if (mTimeline && mRewinding.load(std::memory_order_relaxed))
+    {
+        // Whatever the display does now, it isn't down to the keys.
+        if (frameDue)
+            mTimeline->rewind(mChip, 1);
+        mInputTime = 0;
+    }
+    else
+    {
+        // The time of a change is stored before the keys are, so it's
+        // never older than the keys read here.
+        const auto packed = mKeys.load(std::memory_order_acquire);
+        if (packed != mLastKeys)
+        {
+            mLastKeys  = packed;
+            mInputTime = mKeyTime.load(std::memory_order_relaxed);
+        }
+
+        const auto keys = cee::Keys{uint16_t(packed), uint16_t(packed >> 16)};
+        if (mRecorder)
+            mRecorder->record(mCycles, keys);
+        mChip.updateKeys(keys);
+
+        mCycles += mScheduler.run(seconds);
+
+        if (mTimeline && frameDue)
+            mTimeline->push(mChip);
+    }
+
+    mLastRun = now;
+    publish();
+}
+
+void cee::Runner::setKeys(cee::Keys keys)
+{
+    mKeyTime.store(getTime(), std::memory_order_relaxed);
+    mKeys.store(keys.keysPressed | uint32_t(keys.lastKeyPressed) << 16, std::memory_order_release);
+    wake();
+}
+
+void cee::Runner::setRewinding(bool rewinding)
+{
+    mRewinding.store(rewinding, std::memory_order_relaxed);
+    wake();
+}
+
+bool cee::Runner::updateFrame()
+{
+    return mFrames.update();
+}
+
+const cee::Frame & cee::Runner::getFrame() const
+{
+    return mFrames.front();
+}
+
+uint64_t cee::Runner::getCycles() const
+{
+    return mCycles;
+}
+
+void cee::Runner::run()
+{
+    for (;;)
+    {
+        step();
+        if (mPublished)
+            mPublished();
+
+        // Waiting on a key, or for good, nothing changes until the keys
+        // do, unless there's a beep to stop. Key changes cut the sleep
+        // short either way, so they're taken in straight away.
+        const auto idle  = mChip.getIdle();
+        const auto waits = (idle == cee::Idle::Key || idle == cee::Idle::Halt) &&
+                           ! mChip.isBeeping() && ! mRewinding.load(std::memory_order_relaxed);
+        const auto until = mLastRun + std::chrono::duration_cast<Clock::duration>(
+                               std::chrono::duration<double>(waits ? IDLE_WAIT : STEP_TIME));
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWake.wait_until(lock, until, [this] { return mStopping || mWoken; });
+
+        if (mStopping)
+            return;
+        mWoken = false;
+    }
+}
+
+void cee::Runner::publish()
+{
+    // The display is copied as a whole every time, as the back slot may
+    // hold a frame from a couple of steps ago.
+    if (mChip.getDirtyRows() != 0)
+    {
+        mChip.clearDirtyRows();
+        mDisplay  += 1;
+        mShownTime = mInputTime;
+        mInputTime = 0;
+    }
+
+    auto & frame = mFrames.back();
+    frame.planes    = mChip.getPlanes();
+    frame.hires     = mChip.isHires();
+    frame.display   = mDisplay;
+    frame.inputTime = mShownTime;
+    frame.beeping   = mChip.isBeeping();
+    frame.pattern   = mChip.getAudioPattern();
+    frame.pitch     = mChip.getPitch();
+    frame.idle      = mChip.getIdle();
+
+    mFrames.publish();
+}
+
+void cee::Runner::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWoken = true;
+    }
+
+    mWake.notify_one();
+}
+
+int64_t cee::Runner::getTime()
+{
+    // The epoch of the steady clock is the same for every thread.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
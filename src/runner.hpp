@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef CEE_RUNNER_HPP
+#define CEE_RUNNER_HPP
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "chip8.hpp"
+#include "replay.hpp"
+#include "rewind.hpp"
+#include "scheduler.hpp"
+#include "triple.hpp"
+
+namespace cee
+{
+    // What the emulator shows and plays at the end of a step, as handed
+    // over to whoever presents it.
+    struct Frame
+    {
+        cee::GfxPlanes          planes;    // Every plane of the display
+        bool                    hires;     // Whether the display is in 128 x 64
+        uint64_t                display;   // Bumped whenever the display changes
+        int64_t                 inputTime; // Steady clock time in ns of the key change the display last changed after, 0 if none
+        bool                    beeping;   // Whether the sound timer runs
+        std::array<uint8_t, 16> pattern;   // XO-CHIP's audio pattern
+        uint8_t                 pitch;     // Playback rate of the pattern
+        cee::Idle               idle;      // What the program idles on
+    };
+
+    // Steps an emulator against the wall clock on a thread of its own,
+    // so that presenting frames never holds it up. Keys come in through
+    // an atomic bitmap, and frames go out through a triple buffer, the
+    // presenting thread picking up the newest one whenever it's ready.
+    // Without a thread, the same steps can be run by the caller.
+    class Runner
+    {
+    public:
+        Runner(cee::Chip8 & chip, uint32_t rate,
+               cee::InputRecorder * recorder = nullptr, cee::Rewind * timeline = nullptr);
+        ~Runner();
+
+        Runner(const Runner &) = delete;
+        Runner & operator=(const Runner &) = delete;
+
+        void start(std::function<void()> published);     // Steps on a thread of its own, calling published after each frame
+        void stop();                                     // Stops the thread, if started
+        void step();                                     // Emulates the time since the last step, on the calling thread
+        void setKeys(cee::Keys keys);                    // Updates key states, from any thread
+        void setRewinding(bool rewinding);               // Steps back a frame at a time instead, from any thread
+        bool updateFrame();                              // Picks up the newest frame, false if there's nothing newer
+        const cee::Frame & getFrame() const;             // Frame picked up last
+        uint64_t getCycles() const;                      // Cycles run, once stopped
+
+        static int64_t getTime();                        // Steady clock time in ns, as key changes are stamped with
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        cee::Chip8 &                mChip;       // Emulator being stepped
+        cee::Scheduler              mScheduler;  // Paces it against the wall clock
+        cee::InputRecorder *        mRecorder;   // Logs key changes, if recording
+        cee::Rewind *               mTimeline;   // Keeps frames to rewind through, if any
+        cee::TripleBuffer<cee::Frame> mFrames;   // Frames on their way to be presented
+        std::atomic<uint32_t>       mKeys;       // Key states, as keysPressed | lastKeyPressed << 16
+        std::atomic<int64_t>        mKeyTime;    // Steady clock time in ns of the last key change
+        std::atomic<bool>           mRewinding;  // Whether to step back rather than forwards
+        uint32_t                    mLastKeys;   // Key states of the last step
+        int64_t                     mInputTime;  // Time of the key change not yet shown on the display, 0 if none
+        int64_t                     mShownTime;  // Time of the key change the display last changed after
+        uint64_t                    mDisplay;    // Changes of the display so far
+        uint64_t                    mCycles;     // Cycles run so far
+        double                      mFrameDebt;  // Frames of time passed, not yet kept for rewinding
+        Clock::time_point           mLastRun;    // When the last step ran
+        std::thread                 mThread;     // Steps the emulator, once started
+        std::function<void()>       mPublished;  // Called after each frame
+        bool                        mStopping;   // The thread is asked to exit
+        bool                        mWoken;      // Keys changed since the thread went to sleep
+        std::mutex                  mMutex;
+        std::condition_variable     mWake;       // Signals mStopping or mWoken
+
+        void run();                                      // Thread loop
+        void publish();                                  // Hands the state of the emulator over as a frame
+        void wake();                                     // Cuts the thread's sleep short
+    };
+}
+
+#endif // CEE_RUNNER_HPP
@@ -0,0 +1,64 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// Longest stretch of time caught up with at once, so that a stall
+// (e.g. the window being dragged) doesn't turn into a burst of cycles.
+static constexpr double MAX_LAG = 0.25;
+
+// Time spent running unthrottled before returning to the caller.
+static constexpr double FRAME_TIME = 1.0 / 60.0;
+
+// Cycles run at a time when unthrottled, between looking at the clock.
+static constexpr size_t SLICE_CYCLES = 4096;
+
+cee::Scheduler::Scheduler(cee::Chip8 & chip, uint32_t rate)
+    : mChip(chip)
+    , mRate(rate)
+    , mCycleDebt(0.0)
+    , mTimerDebt(0.0)
+{
+    mChip.setCycleRate(rate);
+}
+
+uint32_t cee::Scheduler::getRate() const
+{
+    return mRate;
+}
+
+size_t cee::Scheduler::run(double seconds)
+{
+    seconds = std::min(std::max(seconds, 0.0), MAX_LAG);
+
+    if (mRate > 0)
+    {
+        mCycleDebt += seconds * mRate;
+
+        const auto cycles = static_cast<size_t>(mCycleDebt);
+        mCycleDebt -= cycles;
+
+        mChip.updateCycles(cycles);
+        return cycles;
+    }
+
+    // Unthrottled, the emulator doesn't tick the timers by itself.
+    mTimerDebt += seconds * TIMER_RATE;
+    for (; mTimerDebt >= 1.0; mTimerDebt -= 1.0)
+        mChip.updateTimers();
+
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() + std::chrono::duration<double>(FRAME_TIME);
+
+    // Once the program idles, running it any further changes nothing
+    // that the timers ticking by themselves wouldn't, so the rest of the
+    // frame is left to the caller to sleep through.
+    size_t cycles = 0;
+    while (Clock::now() < deadline && mChip.getIdle() == cee::Idle::None)
+    {
+        mChip.updateCycles(SLICE_CYCLES);
+        cycles += SLICE_CYCLES;
+    }
+
+    return cycles;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#ifndef CEE_SCHEDULER_HPP
+#define CEE_SCHEDULER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "chip8.hpp"
+
+namespace cee
+{
+    // Paces an emulator against the wall clock, independently of how
+    // often it's rendered. Instructions run at a fixed rate, and the
+    // emulator ticks its timers at 60 Hz of that emulated time. When
+    // unthrottled, instructions run as fast as they can for a frame at
+    // a time, while the timers keep ticking at 60 Hz of real time, and
+    // stop as soon as the program idles.
+    class Scheduler
+    {
+    public:
+        explicit Scheduler(cee::Chip8 & chip, uint32_t rate = cee::DEFAULT_CYCLE_RATE);
+
+        uint32_t getRate() const;                        // Instructions per second, 0 when unthrottled
+        size_t   run(double seconds);                    // Emulates the seconds passed since the last run, returns cycles run
+    private:
+        cee::Chip8 & mChip;       // Emulator being paced
+        uint32_t     mRate;       // Instructions per second, 0 when unthrottled
+        double       mCycleDebt;  // Fraction of a cycle left over from the last run
+        double       mTimerDebt;  // Fraction of a timer tick left over, when unthrottled
+    };
+}
+
+#endif // CEE_SCHEDULER_HPP
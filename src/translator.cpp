@@ -0,0 +1,359 @@
+#include "translator.hpp"
+#include "aot.hpp"
+#include "flow.hpp"
+#include "layout.hpp"
+
+#include <cinttypes>
+#include <cstdarg>
+
+#include <algorithm>
+
+// Column the comments of the translated code line up at.
+static constexpr int COMMENT_COLUMN = 48;
+
+// Names of the quirks profiles in C++, by cee::Quirks.
+static constexpr const char * QUIRKS_IDENTIFIERS[] = {"Modern", "CosmacVip", "Chip48", "SuperChip", "XoChip"};
+
+static void
+appendLine(std::string & body, uint16_t address, uint16_t opcode, const char * format, ...);
+
+cee::Translator::Translator(const uint8_t * program, size_t size, cee::Quirks quirks)
+    : mSize(size)
+    , mInstructions(0)
+    , mInterpreted(0)
+{
+    mChip.setQuirks(quirks);
+    mChip.loadProgram(program, size);
+
+    // Blocks are decoded into the cache of the emulator, as it would.
+    mChip.getCache();
+
+    recover();
+
+    for (const auto address : mBlocks)
+        mCode.push_back(translate(address));
+}
+
+size_t cee::Translator::getBlocks() const
+{
+    return mBlocks.size();
+}
+
+size_t cee::Translator::getInstructions() const
+{
+    return mInstructions;
+}
+
+size_t cee::Translator::getInterpreted() const
+{
+    return mInterpreted;
+}
+
+void cee::Translator::recover()
+{
+    const auto & ops    = *mChip.mOps;
+    const auto & memory = mChip.mMemory;
+    const auto & cache  = mChip.mCache->cache;
+
+    // Blocks are cut the way the emulator caches them, rather than at
+    // the leaders of the flow graph, but they lead on the same way.
+    const cee::FlowGraph graph(mChip, mSize);
+
+    std::vector<bool>     seen(memory.size(), false);
+    std::vector<uint16_t> pending = {cee::PROG_OFFSET};
+
+    const auto follow = [&](size_t address)
+    {
+        if (address + 1 < memory.size() && ! seen[address])
+            pending.push_back(address);
+    };
+
+    while (! pending.empty())
+    {
+        const auto address = pending.back();
+        pending.pop_back();
+
+        if (seen[address])
+            continue;
+        seen[address] = true;
+
+        if (cache[address].length == 0)
+            mChip.cacheBlock(address);
+
+        const size_t length = cache[address].length;
+        if (length == 0)
+            continue;
+
+        // Idle loops are skipped over rather than run, which cached
+        // blocks have to be around for.
+        const auto & first = cache[address];
+        mChip.mCounter = address;
+        if (! ops.idles[first.op] || mChip.getLoop(first) == cee::Idle::None)
+            mBlocks.push_back(address);
+
+        // Only the last instruction of a block leads anywhere else.
+        const auto in   = graph.decode(static_cast<uint16_t>(address + (length - 1) * 2));
+        const auto next = in.address + in.size;
+
+        switch (in.flow)
+        {
+        case cee::Flow::Next:
+            follow(next);
+            break;
+        case cee::Flow::Jump:
+            follow(in.target);
+            break;
+        case cee::Flow::Call:
+        case cee::Flow::Skip:
+            follow(in.target);
+            follow(next);
+            break;
+        default:
+            break;
+        }
+    }
+
+    std::sort(mBlocks.begin(), mBlocks.end());
+}
+
+std::string cee::Translator::translate(uint16_t address)
+{
+    const auto & ops    = *mChip.mOps;
+    const auto & memory = mChip.mMemory;
+    const auto & cache  = mChip.mCache->cache;
+
+    // Blocks starting inside others lose their length as those get
+    // cached over them, so each is cached again as it's translated.
+    mChip.cacheBlock(address);
+    const size_t length = cache[address].length;
+
+    std::string body;
+    size_t ticked    = 0;
+    bool   usesV     = false;
+    bool   usesIndex = false;
+    bool   usesPc    = false;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const uint16_t pc     = address + i * 2;
+        const uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
+        const auto &   in     = cache[pc];
+        const auto     x      = in.x;
+        const auto     y      = in.y;
+
+        // Same translations as cee::Jit, so both run programs alike.
+        const auto is = [&](uint16_t op)
+        {
+            return in.op == ops.index[(op & 0xF000) >> 4 | (op & 0x00FF)];
+        };
+
+        const auto skips  = ! ops.xoChip;
+        const auto source = ops.shiftVy ? y : x;
+        const unsigned next = pc + 2;
+        const unsigned over = pc + 4;
+
+        mInstructions += 1;
+
+        if (is(0x1000))
+        {
+            appendLine(body, pc, opcode, "pc = 0x%03X;", in.nnn);
+            usesPc = true;
+        }
+        else if (skips && (is(0x3000) || is(0x4000)))
+        {
+            appendLine(body, pc, opcode, "pc = v[0x%X] %s 0x%02X ? 0x%03X : 0x%03X;",
+                       x, is(0x3000) ? "==" : "!=", in.nn, over, next);
+            usesV = usesPc = true;
+        }
+        else if (skips && (is(0x5000) || is(0x9000)))
+        {
+            appendLine(body, pc, opcode, "pc = v[0x%X] %s v[0x%X] ? 0x%03X : 0x%03X;",
+                       x, is(0x5000) ? "==" : "!=", y, over, next);
+            usesV = usesPc = true;
+        }
+        else if (is(0x6000))
+        {
+            appendLine(body, pc, opcode, "v[0x%X] = 0x%02X;", x, in.nn);
+            usesV = true;
+        }
+        else if (is(0x7000))
+        {
+            appendLine(body, pc, opcode, "v[0x%X] += 0x%02X;", x, in.nn);
+            usesV = true;
+        }
+        else if (is(0x8000))
+        {
+            appendLine(body, pc, opcode, "v[0x%X] = v[0x%X];", x, y);
+            usesV = true;
+        }
+        else if (is(0x8001) || is(0x8002) || is(0x8003))
+        {
+            const auto op = is(0x8001) ? "|=" : is(0x8002) ? "&=" : "^=";
+            appendLine(body, pc, opcode, "v[0x%X] %s v[0x%X];", x, op, y);
+            if (ops.resetVf)
+                appendLine(body, pc, opcode, "v[0xF] = 0;");
+            usesV = true;
+        }
+        else if (is(0x8004))
+        {
+            // VX is written before VF, so that VF wins when X is F.
+            appendLine(body, pc, opcode, "{ const unsigned r = v[0x%X] + v[0x%X]; v[0x%X] = uint8_t(r); v[0xF] = r >> 8; }",
+                       x, y, x);
+            usesV = true;
+        }
+        else if (is(0x8005) || is(0x8007))
+        {
+            const auto lhs = is(0x8005) ? x : y;
+            const auto rhs = is(0x8005) ? y : x;
+            appendLine(body, pc, opcode, "{ const uint8_t a = v[0x%X], b = v[0x%X]; v[0x%X] = uint8_t(a - b); v[0xF] = a >= b; }",
+                       lhs, rhs, x);
+            usesV = true;
+        }
+        else if (is(0x8006) || is(0x800E))
+        {
+            // VF is set first, and the source is read again in case it's VF.
+            if (is(0x8006))
+            {
+                appendLine(body, pc, opcode, "v[0xF] = v[0x%X] & 1;", source);
+                appendLine(body, pc, opcode, "v[0x%X] = v[0x%X] >> 1;", x, source);
+            }
+            else
+            {
+                appendLine(body, pc, opcode, "v[0xF] = v[0x%X] >> 7;", source);
+                appendLine(body, pc, opcode, "v[0x%X] = uint8_t(v[0x%X] << 1);", x, source);
+            }
+            usesV = true;
+        }
+        else if (is(0xA000))
+        {
+            appendLine(body, pc, opcode, "i = 0x%03X;", in.nnn);
+            usesIndex = true;
+        }
+        else if (is(0xF01E))
+        {
+            appendLine(body, pc, opcode, "v[0xF] = i + v[0x%X] > 0xFFF;", x);
+            appendLine(body, pc, opcode, "i += v[0x%X];", x);
+            usesV = usesIndex = true;
+        }
+        else if (is(0xF029))
+        {
+            appendLine(body, pc, opcode, "i = v[0x%X] * 5;", x);
+            usesV = usesIndex = true;
+        }
+        else
+        {
+            // Everything else goes through the interpreter, which expects
+            // the timers and the program counter to be up to date.
+            if (i > ticked)
+                appendLine(body, pc, opcode, "Aot::advanceTimers(chip, %u);", unsigned(i - ticked));
+            ticked = i;
+
+            appendLine(body, pc, opcode, "pc = 0x%03X;", pc);
+            appendLine(body, pc, opcode, "Aot::interpret(chip);");
+            usesPc = true;
+            mInterpreted += 1;
+            continue;
+        }
+
+        // Blocks cut short by their length don't end with a branch.
+        if (i + 1 == length && ! ops.branches[in.op])
+        {
+            appendLine(body, pc, opcode, "pc = 0x%03X;", next);
+            usesPc = true;
+        }
+    }
+
+    appendLine(body, 0, 0, "Aot::advanceTimers(chip, %u);", unsigned(length - ticked));
+
+    // Only the parts of the emulator the block works on are looked up.
+    std::string head;
+    if (usesV)
+        head += "        uint8_t * const v  = Aot::registers(chip);\n";
+    if (usesIndex)
+        head += "        uint16_t &      i  = Aot::index(chip);\n";
+    if (usesPc)
+        head += "        uint16_t &      pc = Aot::counter(chip);\n";
+
+    return head.empty() ? body : head + "\n" + body;
+}
+
+void cee::Translator::write(FILE * file, const char * name) const
+{
+    // Names end up in a string literal.
+    std::string quoted;
+    for (const char * c = name; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            quoted += '\\';
+        quoted += *c;
+    }
+
+    const auto quirks = static_cast<size_t>(mChip.mOps->quirks);
+
+    fprintf(file, "// Translation of %s for the %s quirks profile, made by cee-aot.\n", name, cee::getName(mChip.mOps->quirks));
+    fprintf(file, "// Linked in, it runs with cee::Backend::Aot whenever the program is loaded.\n");
+    fprintf(file, "\n");
+    fprintf(file, "#include \"aot.hpp\"\n");
+    fprintf(file, "\n");
+    fprintf(file, "namespace\n");
+    fprintf(file, "{\n");
+    fprintf(file, "    using cee::Aot;\n");
+
+    for (size_t i = 0; i < mBlocks.size(); i++)
+    {
+        fprintf(file, "\n");
+        fprintf(file, "    void block%04X(cee::Chip8 * chip)\n", mBlocks[i]);
+        fprintf(file, "    {\n");
+        fprintf(file, "%s", mCode[i].c_str());
+        fprintf(file, "    }\n");
+    }
+
+    fprintf(file, "\n");
+    if (mBlocks.empty())
+    {
+        fprintf(file, "    const Aot::Entry * const BLOCKS = nullptr;\n");
+    }
+    else
+    {
+        fprintf(file, "    const Aot::Entry BLOCKS[] =\n");
+        fprintf(file, "    {\n");
+        for (const auto address : mBlocks)
+            fprintf(file, "        {0x%04X, %u, block%04X},\n", address, unsigned(mChip.mCache->cache[address].length), address);
+        fprintf(file, "    };\n");
+    }
+
+    fprintf(file, "\n");
+    fprintf(file, "    const Aot::Program PROGRAM =\n");
+    fprintf(file, "    {\n");
+    fprintf(file, "        %u,\n", cee::Aot::VERSION);
+    fprintf(file, "        0x%016" PRIX64 "ull,\n", mChip.mImage->hash);
+    fprintf(file, "        cee::Quirks::%s,\n", QUIRKS_IDENTIFIERS[quirks]);
+    fprintf(file, "        BLOCKS,\n");
+    fprintf(file, "        %zu,\n", mBlocks.size());
+    fprintf(file, "        \"%s\"\n", quoted.c_str());
+    fprintf(file, "    };\n");
+    fprintf(file, "\n");
+    fprintf(file, "    const Aot::Registration REGISTRATION(PROGRAM);\n");
+    fprintf(file, "}\n");
+}
+
+// Appends a statement to the body of a block, along with the address and
+// opcode of the instruction it came from, if any.
+void
+appendLine(std::string & body, uint16_t address, uint16_t opcode, const char * format, ...)
+{
+    char statement[160];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(statement, sizeof(statement), format, args);
+    va_end(args);
+
+    char line[224];
+    if (address != 0)
+        snprintf(line, sizeof(line), "        %-*s // 0x%03X: %04X\n", COMMENT_COLUMN - 8, statement, address, opcode);
+    else
+        snprintf(line, sizeof(line), "        %s\n", statement);
+
+    body += line;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef CEE_TRANSLATOR_HPP
+#define CEE_TRANSLATOR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "quirks.hpp"
+
+namespace cee
+{
+    // Translates a program to C++ ahead of time, for cee::Aot to run.
+    // Blocks are found by following the flow of the program from where
+    // it starts, through jumps, skips and calls, and assuming calls
+    // return. Jumps by V0 (BNNN) and returns lead wherever the program
+    // says at the time, so the blocks only reached through them are left
+    // to the interpreter, as are idle loops. Blocks are cut the same way
+    // the emulator caches them, so that each translation stands in for a
+    // cached block.
+    class Translator
+    {
+    public:
+        Translator(const uint8_t * program, size_t size, cee::Quirks quirks);
+
+        Translator(const Translator &) = delete;
+        Translator & operator=(const Translator &) = delete;
+
+        size_t getBlocks() const;                        // Number of blocks translated
+        size_t getInstructions() const;                  // Instructions in them
+        size_t getInterpreted() const;                   // Those of them calling into the interpreter
+        void   write(FILE * file, const char * name) const; // Writes out the translation unit
+    private:
+        cee::Chip8               mChip;         // Emulator holding the program, and decoding it
+        size_t                   mSize;         // Bytes of the program
+        std::vector<uint16_t>    mBlocks;       // Addresses of the blocks translated, in order
+        std::vector<std::string> mCode;         // Bodies of the functions running them
+        size_t                   mInstructions; // Instructions in the blocks
+        size_t                   mInterpreted;  // Those of them calling into the interpreter
+
+        void        recover();                           // Finds the blocks reachable from the start, along the flow graph
+        std::string translate(uint16_t address);         // Body of the function running the block at address
+    };
+}
+
+#endif // CEE_TRANSLATOR_HPP
@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef CEE_TRIPLE_HPP
+#define CEE_TRIPLE_HPP
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+
+namespace cee
+{
+    // Hands values from one thread to another without either of them
+    // ever waiting. The writer fills the back slot and publishes it as
+    // the latest, while the reader keeps the front one for as long as it
+    // likes. The slot in the middle changes hands by atomic exchanges,
+    // carrying a flag which tells the reader whether it holds anything
+    // newer than the front. Values published in between reads are
+    // simply overwritten, so the reader always gets the newest.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer()
+            : mSlots()
+            , mMiddle(1)
+            , mBack(0)
+            , mFront(2)
+        {
+        }
+
+        TripleBuffer(const TripleBuffer &) = delete;
+        TripleBuffer & operator=(const TripleBuffer &) = delete;
+
+        T & back()                                       // Slot the writer fills next
+        {
+            return mSlots[mBack];
+        }
+
+        void publish()                                   // Makes the back slot the latest, by the writer
+        {
+            mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        bool update()                                    // Moves the latest to the front by the reader, false if there's nothing newer
+        {
+            if ((mMiddle.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        const T & front() const                          // Slot the reader holds
+        {
+            return mSlots[mFront];
+        }
+    private:
+        static constexpr uint8_t INDEX = 0x3;            // Slot of the middle
+        static constexpr uint8_t FRESH = 0x4;            // Middle was published since the reader last took it
+
+        std::array<T, 3>     mSlots;  // Values, wherever they are in the hand-off
+        std::atomic<uint8_t> mMiddle; // Slot changing hands, along with FRESH
+        uint8_t              mBack;   // Slot of the writer
+        uint8_t              mFront;  // Slot of the reader
+    };
+}
+
+#endif // CEE_TRIPLE_HPP